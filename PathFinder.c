@@ -2,722 +2,8280 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include "PathFinder.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_KERNELS_X86
+#endif
 
 #define MAX_CARS 512
+#define BPTREE_MAX_KEYS 64
+#define BPTREE_MIN_KEYS (BPTREE_MAX_KEYS / 2)
+#define BPTREE_MAX_HEIGHT 16
+#define BPTREE_BULK_FILL 48
+#define POOL_SLAB_SIZE (64 * 1024)
+#define FLEET_SIZE_CLASSES 10
+#define MUTATION_LOG_SIZE 1024
+#define ROUTE_CACHE_DEFAULT_CAPACITY 1024
+#define ROUTE_CACHE_MAX_TEXT (16 * 1024)
+#define ROUTE_CACHE_MIN_TEXT 64
+#define ROUTE_CACHE_TEXT_CLASSES 9
+#define BATCH_MAX_QUERIES 8192
+#define VERSION_NODE_SIZE 32
+#define READER_QUEUE_SIZE 4096
+#define READER_ANSWER_SIZE 256
+#define SCAN_MASK_WIDTH 32
+#define BINARY_ADD_STATION 0x01
+#define BINARY_REMOVE_STATION 0x02
+#define BINARY_ADD_CAR 0x03
+#define BINARY_REMOVE_CAR 0x04
+#define BINARY_PLAN_ROUTE 0x05
+#define BINARY_SAVE 0x06
+#define BINARY_LOAD 0x07
+#define BINARY_STATS 0x08
+#define BINARY_PLAN_ROUTES 0x09
+#define SNAPSHOT_MAGIC "PFSNAPSH"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+#define LATENCY_SUB_BUCKETS 16
+#define LATENCY_BUCKETS (61 * LATENCY_SUB_BUCKETS)
+#define INPUT_BLOCK_SIZE (1 << 20)
+#define INPUT_RELEASE_SIZE (16 << 20)
+#define STATION_RUN_RETAINED (1 << 16)
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+#define OUTPUT_FLUSH_THRESHOLD (OUTPUT_BUFFER_SIZE - 4096)
+#define PIPELINE_RING_SIZE (1 << 16)
+#define PIPELINE_OUTPUT_BLOCKS 4
+#define PIPELINE_WAKE_BATCH 4096
+#define SPSC_RING_SPINS 256
+#define LAYER_POOL_CHUNK (1 << 14)
+#define LAYER_POOL_DEFAULT_THRESHOLD (1 << 20)
+#define SHARD_QUEUE_SIZE 4096
+#define SHARD_RING_SIZE (1 << 14)
+#define SHARD_WAKE_BATCH 256
+#define SHARD_HIGHWAYS_INITIAL 16
+
+#define writer_write_literal(out, text) writer_write((out), (text), sizeof(text) - 1)
+
+#ifdef PATHFINDER_INSTRUMENT
+#define instrument_count(counter, amount) __atomic_fetch_add(&instrumentation.counter, (amount), __ATOMIC_RELAXED)
+#define instrument_range(size) instrument_record_range(size)
+#else
+#define instrument_count(counter, amount) ((void)0)
+#define instrument_range(size) ((void)0)
+#endif
 
 // --------------------------------------------------------------------------- Structs ---------------------------------------------------------------------------
 
 /**
- * @brief A structure representing a MaxHeap.
+ * @brief A structure representing the header of a block of pool objects.
+ */
+typedef struct pool_slab {
+    struct pool_slab *next;  ///< Previously allocated slab.
+    size_t objects;          ///< Number of objects carved from the slab.
+} PoolSlab;
+
+/**
+ * @brief A structure representing a pool of fixed-size objects.
+ *
+ * Objects are carved from large slabs and freed objects are kept in a free-list, linked through their first bytes.
+ */
+typedef struct pool {
+    void *free_list;         ///< Freed objects ready to be reused.
+    PoolSlab *slabs;         ///< Allocated slabs, newest first.
+    char *cursor;            ///< First never used object of the newest slab.
+    char *limit;             ///< End of the newest slab.
+    size_t object_size;      ///< Size of each object.
+    size_t in_use;           ///< Number of objects currently allocated.
+    size_t capacity;         ///< Number of objects carved from all the slabs.
+    size_t slab_count;       ///< Number of allocated slabs.
+} Pool;
+
+/**
+ * @brief A structure representing the pools backing the station index.
+ */
+typedef struct arena {
+    Pool nodes;                           ///< Pool of B+-tree nodes.
+    Pool fleets;                          ///< Pool of Fleet structures.
+    Pool versions;                        ///< Pool of copy-on-write VersionNode structures.
+    Pool entries[FLEET_SIZE_CLASSES];     ///< Pools of Fleet entry arrays, the i-th holding 2^i entries.
+} Arena;
+
+/**
+ * @brief A structure representing a group of cars sharing the same autonomy.
+ */
+typedef struct fleet_entry {
+    int autonomy;            ///< Autonomy of the cars.
+    int count;               ///< Number of cars with this autonomy.
+} FleetEntry;
+
+/**
+ * @brief A structure representing the cars of a station as a counted sorted vector.
+ *
+ * Each distinct autonomy is stored once, so the maximum is the last entry and a car is found by binary search.
+ */
+typedef struct fleet {
+    FleetEntry *entries;     ///< Distinct autonomies in increasing order, NULL if the fleet has no cars.
+    unsigned short length;   ///< Number of distinct autonomies.
+    unsigned short capacity; ///< Number of allocated entries, a power of two or 0.
+    unsigned short size;     ///< Total number of cars, at most MAX_CARS.
+} Fleet;
+
+/**
+ * @brief A structure summarizing the reachability of a run of consecutive stations.
+ *
+ * A station is a gap when no previous station of the run reaches it, going forward, or no following station
+ * reaches it, going backward; the first, respectively last, station of the run is never a gap.
+ */
+typedef struct reach_summary {
+    long long max_reach;     ///< Highest key + autonomy, LLONG_MIN if the run is empty.
+    long long min_reach;     ///< Lowest key - autonomy, LLONG_MAX if the run is empty.
+    long long forward_gap;   ///< Highest key of a forward gap, LLONG_MIN if none.
+    long long reverse_gap;   ///< Lowest key of a backward gap, LLONG_MAX if none.
+    int first_key;           ///< Lowest key of the run.
+    int last_key;            ///< Highest key of the run.
+} ReachSummary;
+
+/**
+ * @brief A structure representing a node of the B+-tree station index.
+ *
+ * Internal nodes only route the searches, leaves store the stations and are linked in key order.
+ */
+typedef struct bptree_node {
+    int keys[BPTREE_MAX_KEYS + 1];                           ///< Sorted keys, with one spare slot used before a split.
+    int autonomies[BPTREE_MAX_KEYS + 1];                     ///< Maximum autonomy of each station of a leaf.
+    union {
+        struct bptree_node *children[BPTREE_MAX_KEYS + 2];   ///< Children of an internal node.
+        Fleet *cars[BPTREE_MAX_KEYS + 1];                    ///< Fleet of cars of each station of a leaf.
+    };
+    struct bptree_node *prev;                                ///< Previous leaf in key order.
+    struct bptree_node *next;                                ///< Next leaf in key order.
+    ReachSummary summary;                                    ///< Reachability of the stations of the subtree.
+    int size;                                                ///< Number of stations stored in the subtree.
+    unsigned short num_keys;                                 ///< Number of keys stored in the node.
+    bool is_leaf;                                            ///< True if the node is a leaf.
+} BPTreeNode;
+
+/**
+ * @brief A structure representing the B+-tree station index.
+ */
+typedef struct bptree {
+    BPTreeNode *root;        ///< Pointer to the root of the tree, NULL if the tree is empty.
+    int size;                ///< Number of stations stored in the tree.
+    Arena *arena;            ///< Pools the nodes and the fleets are allocated from.
+} BPTree;
+
+/**
+ * @brief A structure representing a read-only view over the stations of a range.
+ *
+ * The arrays either point straight into a leaf of the tree or into a buffer owned by the caller.
+ */
+typedef struct station_range {
+    const int *stations;     ///< Station keys in increasing order.
+    const int *autonomies;   ///< Maximum autonomy of each station.
+    int size;                ///< Number of stations in the range.
+} StationRange;
+
+/**
+ * @brief The algorithms available to plan a route.
+ */
+typedef enum planner_kind {
+    PLANNER_GREEDY,          ///< Linear-time sweep over the reachability layers.
+    PLANNER_BFS,             ///< Quadratic breadth-first search, kept as a reference.
+    PLANNER_JUMP             ///< Binary-lifting tables over a snapshot of the index, falling back to the sweep.
+} PlannerKind;
+
+/**
+ * @brief The encodings of the responses.
+ */
+typedef enum output_format {
+    OUTPUT_TEXT,             ///< The text protocol.
+    OUTPUT_BINARY,           ///< The binary protocol, every integer being a varint.
+    OUTPUT_KEYS              ///< Native ints, a route being its number of stations followed by their keys.
+} OutputFormat;
+
+/**
+ * @brief A structure representing an implementation of the scans over the station arrays of a range.
+ *
+ * Every implementation returns the same results; the vector ones are selected at startup when the CPU supports them.
+ */
+typedef struct scan_kernels {
+    const char *name;                                    ///< Name of the instruction set.
+    long long (*max_reach)(const int *stations, const int *autonomies, int low, int high);
+    long long (*min_reach)(const int *stations, const int *autonomies, int low, int high);
+    int (*forward_extent)(const int *stations, int from, int last, long long reach);
+    int (*reverse_extent)(const int *stations, int from, long long reach);
+    unsigned int (*reverse_mask)(const int *stations, const int *autonomies, int base, int from, int count);
+} ScanKernels;
+
+/**
+ * @brief A structure representing the buffers reused by every query.
+ *
+ * The buffers only grow, so once they fit the largest range seen the queries do not allocate anymore.
+ */
+typedef struct workspace {
+    int *stations;           ///< Station keys of a range that spans several leaves.
+    int *autonomies;         ///< Maximum autonomy of the same stations.
+    int *predecessors;       ///< Predecessor of each station of the range on the route.
+    int *frontier;           ///< Frontier of the breadth-first search, or stops of a jump route.
+    bool *visited;           ///< Stations already reached by the breadth-first search.
+    int *cars;               ///< Autonomies read by aggiungi-stazione, or targets read by pianifica-percorsi.
+    int capacity;            ///< Number of stations each range buffer can hold.
+    int search_capacity;     ///< Number of stations the frontier and visited buffers can hold.
+    int car_capacity;        ///< Number of autonomies the cars buffer can hold.
+    size_t allocations;      ///< Number of heap allocations made to grow the buffers.
+    size_t queries;          ///< Number of routes planned.
+} Workspace;
+
+/**
+ * @brief A structure representing the most recent mutations of the station index.
+ *
+ * Every mutation that can change a route bumps the version and records the key of the station it touched.
+ */
+typedef struct mutation_log {
+    int keys[MUTATION_LOG_SIZE];   ///< Touched keys, the one of version v stored at v % MUTATION_LOG_SIZE.
+    unsigned long long version;    ///< Number of mutations recorded so far.
+} MutationLog;
+
+/**
+ * @brief A structure representing a cached route.
+ */
+typedef struct route_cache_entry {
+    int start;                     ///< The starting key of the route.
+    int end;                       ///< The ending key of the route.
+    unsigned long long version;    ///< Version of the index the route was last known to be valid at.
+    char *text;                    ///< Formatted answer, a block of the text pool of its size class.
+    size_t length;                 ///< Length of the formatted answer.
+    int text_class;                ///< Size class of the text block.
+    int bucket_next;               ///< Next entry of the same hash bucket, -1 if none.
+    int lru_prev;                  ///< More recently used entry, -1 if none.
+    int lru_next;                  ///< Less recently used entry, -1 if none.
+} RouteCacheEntry;
+
+/**
+ * @brief A structure representing an LRU cache of formatted routes keyed by their endpoints.
+ */
+typedef struct route_cache {
+    RouteCacheEntry *entries;      ///< Entries, the first size ones are in use.
+    int *buckets;                  ///< First entry of each hash bucket, -1 if none.
+    int capacity;                  ///< Maximum number of entries, 0 if the cache is disabled.
+    int size;                      ///< Number of entries in use.
+    unsigned int bucket_mask;      ///< Number of buckets minus one.
+    int lru_head;                  ///< Most recently used entry, -1 if empty.
+    int lru_tail;                  ///< Least recently used entry, -1 if empty.
+    size_t hits;                   ///< Queries answered from the cache.
+    size_t misses;                 ///< Queries that had to be planned.
+    size_t invalidations;          ///< Misses caused by a mutation inside the route interval.
+    OutputFormat format;           ///< Encoding of the cached answers.
+    Pool texts[ROUTE_CACHE_TEXT_CLASSES]; ///< Pools of answer blocks, of ROUTE_CACHE_MIN_TEXT << i bytes in the i-th.
+    size_t allocations;            ///< Slabs allocated by the text pools.
+} RouteCache;
+
+/**
+ * @brief A structure representing the jump tables built over a snapshot of the whole index.
+ *
+ * The forward next hop of a station is the station with the farthest reach among the ones it reaches, the
+ * reverse one mirrors it; lifting tables hold the 2^k-th next hop of every station. Two segment trees over the
+ * reaches find the tie-broken predecessor of each stop of a route.
+ */
+typedef struct jump_tables {
+    int *stations;                 ///< Station keys of the snapshot, in increasing order.
+    int *autonomies;               ///< Maximum autonomy of each station.
+    int *reach_right;              ///< Index of the last station reachable from each station going forward.
+    int *reach_left;               ///< Index of the first station reachable from each station going backward.
+    int *lift_right;               ///< Forward lifting table, the 2^k-th next hop of station i at k * size + i.
+    int *lift_left;                ///< Reverse lifting table, with the same layout.
+    long long *right_tree;         ///< Max segment tree over key + autonomy.
+    long long *left_tree;          ///< Max segment tree over autonomy - key.
+    int size;                      ///< Number of stations of the snapshot.
+    int leaves;                    ///< Number of leaves of the segment trees, a power of two.
+    int levels;                    ///< Number of levels of the lifting tables.
+    int capacity;                  ///< Number of stations the buffers can hold.
+    bool built;                    ///< True once the tables have been built.
+    unsigned long long version;    ///< Version of the index the snapshot was taken at.
+    size_t debt;                   ///< Stations planned without the tables since they went stale.
+    size_t rebuilds;               ///< Number of times the tables were built.
+    size_t queries;                ///< Number of routes planned with the tables.
+    size_t allocations;            ///< Number of heap allocations made to grow the buffers.
+} JumpTables;
+
+/**
+ * @brief A structure representing a node of the copy-on-write snapshot of the station index.
+ *
+ * Published nodes are never modified: a mutation copies the path from the root to the leaf it touches.
+ */
+typedef struct version_node {
+    int keys[VERSION_NODE_SIZE + 1];                             ///< Leaf: station keys. Internal: lower bound of each child.
+    union {
+        int autonomies[VERSION_NODE_SIZE + 1];                   ///< Maximum autonomy of each station of a leaf.
+        struct version_node *children[VERSION_NODE_SIZE + 1];    ///< Children of an internal node.
+    };
+    struct version_node *retired_next;                           ///< Next retired node, in retirement order.
+    unsigned long long retired;                                  ///< First version the node is not part of.
+    unsigned short count;                                        ///< Number of keys stored in the node.
+    bool is_leaf;                                                ///< True if the node is a leaf.
+} VersionNode;
+
+/**
+ * @brief A structure representing the versions of the station index read by concurrent queries.
+ *
+ * Only the writer allocates and frees nodes. Replaced nodes are retired with the version that dropped them and
+ * reclaimed once every query pinned to an older version has been answered.
+ */
+typedef struct version_index {
+    VersionNode *root;                 ///< Root of the latest version, NULL if the index is empty.
+    unsigned long long version;        ///< Latest published version.
+    VersionNode *retired_head;         ///< Oldest retired node, NULL if none.
+    VersionNode *retired_tail;         ///< Newest retired node.
+    Pool *pool;                        ///< Pool the nodes are allocated from.
+    size_t retired_count;              ///< Number of retired nodes not reclaimed yet.
+    size_t reclaimed;                  ///< Number of nodes reclaimed so far.
+    bool enabled;                      ///< True if the mutations are mirrored in the index.
+} VersionIndex;
+
+/**
+ * @brief A structure representing a run of stations added past the last key of the index, not inserted yet.
+ *
+ * Each station of the run has a greater key than the previous one, so every addition succeeds and the run can be
+ * appended in a single bottom-up build once another command needs the index.
+ */
+typedef struct station_run {
+    int *keys;               ///< Keys of the stations, in increasing order.
+    Fleet **fleets;          ///< Fleets of the stations.
+    int count;               ///< Number of stations in the run.
+    int capacity;            ///< Number of stations the arrays can hold.
+    size_t builds;           ///< Number of runs appended with a bottom-up build.
+    size_t stations;         ///< Number of stations appended with a bottom-up build.
+} StationRun;
+
+/**
+ * @brief The phases a route over a long range is planned in, each one split in chunks of LAYER_POOL_CHUNK stations.
+ */
+typedef enum layer_phase {
+    LAYER_PHASE_EXTRACT,     ///< Copies a chunk of the range out of the leaves.
+    LAYER_PHASE_REACH,       ///< Computes the farthest reach of a chunk of the current layer.
+    LAYER_PHASE_LINK         ///< Links a chunk of the next layer to its predecessors in the current one.
+} LayerPhase;
+
+/**
+ * @brief A structure representing the threads planning the routes over long ranges one layer at a time.
+ *
+ * Every wide layer of the sweep is split in chunks that the workers grab in any order. The reach of the layer and
+ * the first predecessor of each chunk of the next layer are merged in key order, so the routes are the ones of the
+ * serial sweep. The index is read-only while the workers run.
+ */
+typedef struct layer_pool {
+    pthread_t *threads;               ///< Helper threads, the main thread being the first worker.
+    int thread_count;                 ///< Number of workers, the main thread included.
+    int threshold;                    ///< Minimum number of stations of a range planned by the pool.
+    const BPTree *tree;               ///< Index the range is extracted from.
+    int first;                        ///< Rank of the first station extracted.
+    int count;                        ///< Number of stations extracted.
+    int *extracted_stations;          ///< Array receiving the extracted station keys.
+    int *extracted_autonomies;        ///< Array receiving the extracted autonomies.
+    const int *stations;              ///< Station keys of the range being planned.
+    const int *autonomies;            ///< Maximum autonomy of each station of the range.
+    int *predecessors;                ///< Predecessor of each station of the range on the route.
+    bool forward;                     ///< True if the layers grow towards higher keys.
+    int layer_low;                    ///< Index of the first station of the current layer.
+    int layer_high;                   ///< Index of the last station of the current layer.
+    int next_low;                     ///< Index of the first station of the next layer.
+    int next_high;                    ///< Index of the last station of the next layer.
+    long long *reaches;               ///< Reach of each chunk of the current layer, then the running best.
+    int reach_count;                  ///< Number of chunks of the current layer.
+    int reach_capacity;               ///< Number of chunks the reaches array can hold.
+    LayerPhase phase;                 ///< Phase being executed.
+    int task_count;                   ///< Number of chunks of the current phase.
+    int next_task;                    ///< Next chunk to grab, incremented atomically.
+    int running;                      ///< Threads still working on the current phase.
+    unsigned int generation;          ///< Incremented every time a phase starts.
+    bool stop;                        ///< Set to make the threads exit.
+    pthread_mutex_t lock;             ///< Protects running, generation and stop.
+    pthread_cond_t start;             ///< Signaled when a phase starts.
+    pthread_cond_t done;              ///< Signaled when the last thread finishes a phase.
+    size_t sweeps;                    ///< Number of sweeps run by the pool.
+    size_t layers;                    ///< Number of layers split in chunks.
+    size_t tasks;                     ///< Number of chunks executed.
+    size_t extracted;                 ///< Number of stations extracted in chunks.
+    size_t allocations;               ///< Number of heap allocations made to grow the reaches array.
+} LayerPool;
+
+/**
+ * @brief A structure representing the station index together with the state used to query it.
+ */
+typedef struct engine {
+    Arena arena;             ///< Pools backing the station index.
+    BPTree tree;             ///< Station index.
+    Workspace workspace;     ///< Buffers reused by the queries.
+    MutationLog log;         ///< Recent mutations, used to validate the cached routes.
+    RouteCache cache;        ///< Cache of formatted routes.
+    JumpTables jumps;        ///< Jump tables, only used by PLANNER_JUMP.
+    VersionIndex versions;   ///< Snapshots read by the reader threads, only maintained when they run.
+    StationRun run;          ///< Stations added in increasing key order past the end of the index.
+    PlannerKind planner;     ///< Algorithm used to plan the routes.
+    LayerPool *layers;       ///< Threads planning the long ranges, NULL if every range is planned by the caller.
+    size_t gap_rejections;   ///< Routes rejected by the gap detector without extracting the range.
+} Engine;
+
+/**
+ * @brief A structure representing the header of a snapshot file.
+ *
+ * The header is followed by one SnapshotStation per station in increasing key order, then by the FleetEntry
+ * arrays of the stations in the same order. Every field is in the byte order of the machine that saved it.
+ */
+typedef struct snapshot_header {
+    char magic[8];                 ///< SNAPSHOT_MAGIC, without the terminator.
+    unsigned int version;          ///< SNAPSHOT_VERSION.
+    unsigned int byte_order;       ///< SNAPSHOT_BYTE_ORDER, as written by the saving machine.
+    unsigned long long stations;   ///< Number of stations.
+    unsigned long long entries;    ///< Total number of fleet entries.
+    unsigned long long checksum;   ///< FNV-1a hash of everything following the header.
+} SnapshotHeader;
+
+/**
+ * @brief A structure representing a station in a snapshot file.
+ */
+typedef struct snapshot_station {
+    int key;                       ///< Key of the station.
+    unsigned short length;         ///< Number of distinct autonomies of its fleet.
+    unsigned short size;           ///< Number of cars of its fleet.
+} SnapshotStation;
+
+/**
+ * @brief A structure representing a buffered reader over the command stream.
+ *
+ * Regular files are mapped in memory as a whole, any other input is read in large blocks.
+ */
+typedef struct input_reader {
+    int fd;                  ///< File descriptor of the input.
+    char *buffer;            ///< Start of the buffered or mapped bytes.
+    size_t capacity;         ///< Size of the buffer, or of the mapping.
+    const char *cursor;      ///< Next byte to parse.
+    const char *end;         ///< End of the valid bytes.
+    bool mapped;             ///< True if the buffer is a memory mapping of the whole input.
+    bool binary;             ///< True if the input is made of binary frames instead of text.
+    size_t released;         ///< Bytes at the start of the mapping already returned to the kernel.
+    struct spsc_ring *commands;  ///< Ring of the commands decoded by another thread, NULL if the reader parses them.
+    struct spsc_ring *decoded;   ///< Ring of the commands parsed so far, published before waiting for the input.
+} InputReader;
+
+/**
+ * @brief The commands of the text and binary protocols.
+ */
+typedef enum command_kind {
+    COMMAND_ADD_STATION,     ///< aggiungi-stazione
+    COMMAND_REMOVE_STATION,  ///< demolisci-stazione
+    COMMAND_ADD_CAR,         ///< aggiungi-auto
+    COMMAND_REMOVE_CAR,      ///< rottama-auto
+    COMMAND_PLAN_ROUTE,      ///< pianifica-percorso
+    COMMAND_PLAN_ROUTES,     ///< pianifica-percorsi, plans the routes from one station to several ones.
+    COMMAND_SAVE,            ///< salva, writes a snapshot of the index.
+    COMMAND_LOAD,            ///< carica, replaces the index with a snapshot.
+    COMMAND_STATS,           ///< statistiche, prints the statistics on stderr.
+    COMMAND_UNKNOWN          ///< Any other token, which is skipped.
+} CommandKind;
+
+/**
+ * @brief A structure representing the last value read for each argument of the commands.
+ *
+ * A missing argument keeps the value it last had, so a malformed command reuses the arguments of the previous ones.
+ */
+typedef struct command_arguments {
+    int key;                 ///< Key of the station of the command.
+    int fleet_size;          ///< Number of cars of a new station.
+    int element;             ///< Autonomy of a car, or key of a target station.
+    int start;               ///< Key of the station where the routes start.
+    int end;                 ///< Key of the station where the route ends.
+    int count;               ///< Number of target stations.
+} CommandArguments;
+
+/**
+ * @brief A structure representing a buffered writer for the responses.
+ *
+ * The buffer grows when a single response does not fit and is flushed between commands.
+ */
+typedef struct output_writer {
+    int fd;                  ///< File descriptor of the output.
+    char *buffer;            ///< Buffered bytes not yet written.
+    size_t length;           ///< Number of buffered bytes.
+    size_t capacity;         ///< Size of the buffer.
+    OutputFormat format;     ///< Encoding of the responses.
+    struct pipeline *pipeline;   ///< Pipeline whose writer thread writes the buffer, NULL if the writer writes it.
+    size_t allocations;      ///< Number of heap allocations made to grow the buffer.
+} OutputWriter;
+
+/**
+ * @brief How a query of a batch gets its answer.
+ */
+typedef enum batch_query_kind {
+    BATCH_QUERY_DONE,        ///< Answered while the batch was prepared.
+    BATCH_QUERY_RANGE,       ///< Planned over a slice of the range of its cluster.
+    BATCH_QUERY_JUMP         ///< Planned with the jump tables.
+} BatchQueryKind;
+
+/**
+ * @brief A structure representing a pianifica-percorso command waiting in a batch.
+ */
+typedef struct batch_query {
+    int start;               ///< The starting key.
+    int end;                 ///< The ending key.
+    int first;               ///< Rank of the first station of the range.
+    int count;               ///< Number of stations of the range.
+    int cluster;             ///< Cluster whose extraction holds the range.
+    int worker;              ///< Worker whose buffer holds the answer.
+    size_t offset;           ///< Offset of the answer in the buffer of the worker.
+    size_t length;           ///< Length of the answer.
+    BatchQueryKind kind;     ///< How the query gets its answer.
+    bool cached;             ///< True if the answer came from the route cache.
+} BatchQuery;
+
+/**
+ * @brief A structure representing a run of stations extracted once for overlapping queries.
+ */
+typedef struct batch_cluster {
+    int low;                 ///< Lowest key of the queries of the cluster.
+    int high;                ///< Highest key of the queries of the cluster.
+    int first;               ///< Rank of the first station of the cluster.
+    int count;               ///< Number of stations of the cluster.
+    size_t offset;           ///< Offset of the cluster in the shared extraction buffers.
+    const int *stations;     ///< Station keys, in a leaf or in the shared buffers.
+    const int *autonomies;   ///< Maximum autonomy of each station.
+} BatchCluster;
+
+/**
+ * @brief A structure pairing a range query with the rank of its first station, used to build the clusters.
+ */
+typedef struct batch_order {
+    int first;               ///< Rank of the first station of the range.
+    int index;               ///< Index of the query in the batch.
+} BatchOrder;
+
+/**
+ * @brief The phases a batch is executed in, each one split in independent tasks.
+ */
+typedef enum batch_phase {
+    BATCH_PHASE_EXTRACT,     ///< One task per cluster.
+    BATCH_PHASE_PLAN         ///< One task per query to plan.
+} BatchPhase;
+
+/**
+ * @brief A structure representing a thread planning the queries of a batch.
+ */
+typedef struct batch_worker {
+    pthread_t thread;                 ///< The thread, unused for the first worker which is the main thread.
+    struct batch_runner *runner;      ///< The runner the worker belongs to.
+    Workspace workspace;              ///< Buffers used by the planners.
+    OutputWriter answers;             ///< Answers planned by the worker, never flushed.
+} BatchWorker;
+
+/**
+ * @brief A structure representing the pool of threads executing runs of consecutive queries.
+ *
+ * Mutating commands end a batch, so the index is read-only while the workers run.
+ */
+typedef struct batch_runner {
+    Engine *engine;                   ///< The engine answering the queries.
+    BatchWorker *workers;             ///< The workers, the first one being the main thread.
+    int thread_count;                 ///< Number of workers.
+    BatchQuery queries[BATCH_MAX_QUERIES];   ///< Queries of the batch, in command order.
+    int size;                         ///< Number of queries of the batch.
+    int plans[BATCH_MAX_QUERIES];     ///< Queries to plan in the planning phase.
+    int plan_count;                   ///< Number of queries to plan.
+    int task_count;                   ///< Number of tasks of the current phase.
+    BatchOrder order[BATCH_MAX_QUERIES];     ///< Range queries sorted by first rank.
+    BatchCluster clusters[BATCH_MAX_QUERIES];///< Clusters of overlapping ranges.
+    int cluster_count;                ///< Number of clusters.
+    int *stations;                    ///< Shared buffer of the extracted station keys.
+    int *autonomies;                  ///< Shared buffer of the extracted autonomies.
+    size_t buffer_capacity;           ///< Number of stations the shared buffers can hold.
+    BatchPhase phase;                 ///< Phase being executed.
+    int next_task;                    ///< Next task to grab, incremented atomically.
+    int running;                      ///< Threads still working on the current phase.
+    unsigned int generation;          ///< Incremented every time a phase starts.
+    bool stop;                        ///< Set to make the threads exit.
+    pthread_mutex_t lock;             ///< Protects running, generation and stop.
+    pthread_cond_t start;             ///< Signaled when a phase starts.
+    pthread_cond_t done;              ///< Signaled when the last thread finishes a phase.
+    size_t batches;                   ///< Number of executed batches.
+    size_t planned;                   ///< Number of queries planned by the workers.
+    size_t extracted;                 ///< Number of stations extracted for the clusters.
+    size_t allocations;               ///< Number of heap allocations made to grow the shared buffers.
+} BatchRunner;
+
+/**
+ * @brief A structure representing a command waiting in the reorder buffer of the reader pool.
+ */
+typedef struct reader_task {
+    int start;                        ///< The starting key.
+    int end;                          ///< The ending key.
+    const VersionNode *root;          ///< Root of the snapshot the route is planned against.
+    unsigned long long version;       ///< Version of the snapshot, pinned until the answer is printed.
+    unsigned long long log_version;   ///< Version of the mutation log the answer is cached with.
+    OutputWriter answer;              ///< The answer, never flushed.
+    bool planned;                     ///< True if a reader plans the answer, false if it was written at submission.
+    bool done;                        ///< True once the answer is ready, accessed atomically.
+} ReaderTask;
+
+/**
+ * @brief A structure representing a thread planning routes against snapshots of the index.
+ */
+typedef struct reader_worker {
+    pthread_t thread;                 ///< The thread.
+    struct reader_pool *pool;         ///< The pool the reader belongs to.
+    Workspace workspace;              ///< Buffers used by the planners.
+} ReaderWorker;
+
+/**
+ * @brief A structure representing the reader threads and the reorder buffer printing their answers.
+ *
+ * The main thread applies the mutations and submits the queries, each pinned to the version of the index current
+ * at that point, so readers never wait for the writer and the answers match serial execution.
+ */
+typedef struct reader_pool {
+    Engine *engine;                          ///< The engine owning the index.
+    ReaderWorker *workers;                   ///< The reader threads.
+    int thread_count;                        ///< Number of reader threads.
+    ReaderTask tasks[READER_QUEUE_SIZE];     ///< Reorder buffer, task s stored at s % READER_QUEUE_SIZE.
+    unsigned long long submitted;            ///< Number of submitted tasks.
+    unsigned long long claimed;              ///< Number of tasks taken by the readers.
+    unsigned long long emitted;              ///< Number of answers printed.
+    bool stop;                               ///< Set to make the readers exit.
+    pthread_mutex_t lock;                    ///< Protects submitted, claimed and stop.
+    pthread_cond_t work;                     ///< Signaled when a task is submitted.
+    pthread_cond_t done;                     ///< Signaled when a reader finishes a task.
+    size_t planned;                          ///< Number of routes planned by the readers.
+    size_t immediate;                        ///< Number of answers written at submission.
+    size_t stalls;                           ///< Number of times the writer waited for a full buffer.
+} ReaderPool;
+
+/**
+ * @brief A structure representing a lock-free ring of integers with one producer thread and one consumer thread.
+ *
+ * Each side moves a private index and publishes it with a release store, reading the index of the other side only
+ * when its cached copy says the ring is full or empty. A side that cannot progress spins for a while and then sleeps,
+ * after publishing its own index, so the two sides never wait for each other. A sleeping side is woken up once a
+ * batch of slots is ready for it, so that on a busy or single CPU the threads do not switch at every command.
+ */
+typedef struct spsc_ring {
+    int *slots;                          ///< The slots, a power of two of them.
+    size_t mask;                         ///< Number of slots minus one.
+    size_t batch;                        ///< Number of slots ready for a sleeping side that wake it up.
+    int spins;                           ///< Number of times a side checks the other one before sleeping.
+    _Alignas(64) size_t head;            ///< Slots published by the producer, accessed atomically.
+    bool closed;                         ///< Set by the producer after its last slot, accessed atomically.
+    _Alignas(64) size_t tail;            ///< Slots released by the consumer, accessed atomically.
+    _Alignas(64) size_t produced;        ///< Slots written by the producer, published or not.
+    size_t tail_cache;                   ///< Tail last read by the producer.
+    size_t producer_waits;               ///< Number of times the producer slept on a full ring.
+    _Alignas(64) size_t consumed;        ///< Slots read by the consumer, released or not.
+    size_t head_cache;                   ///< Head last read by the consumer.
+    size_t consumer_waits;               ///< Number of times the consumer slept on an empty ring.
+    _Alignas(64) int sleeping;           ///< Number of sides sleeping, accessed atomically.
+    pthread_mutex_t lock;                ///< Protects the sleeps.
+    pthread_cond_t wake;                 ///< Signaled when an index is published while a side sleeps.
+} SpscRing;
+
+/**
+ * @brief A structure representing a buffer of responses travelling between the main thread and the writer thread.
+ */
+typedef struct output_block {
+    char *buffer;            ///< The responses.
+    size_t length;           ///< Number of bytes of responses.
+    size_t capacity;         ///< Size of the buffer.
+} OutputBlock;
+
+/**
+ * @brief A structure representing the parse, execute and write stages of the pipelined mode.
+ *
+ * The parser thread decodes the input into the command ring, each command being its kind followed by its integer
+ * arguments. The main thread executes the commands and formats their responses in a block, handed to the writer
+ * thread through the full ring once it reaches the flush threshold; written blocks come back through the free ring.
+ */
+typedef struct pipeline {
+    InputReader input;                           ///< Reader of the parser thread.
+    int fd;                                      ///< File descriptor the writer thread writes to.
+    SpscRing commands;                           ///< Decoded commands, from the parser to the main thread.
+    SpscRing full;                               ///< Blocks to write, from the main thread to the writer thread.
+    SpscRing free;                               ///< Written blocks, from the writer thread to the main thread.
+    OutputBlock blocks[PIPELINE_OUTPUT_BLOCKS];  ///< The blocks of responses.
+    int block;                                   ///< Block the main thread formats the responses in.
+    pthread_t parser;                            ///< The parser thread.
+    pthread_t writer;                            ///< The writer thread.
+} Pipeline;
+
+/**
+ * @brief A structure representing a highway of the sharded mode, with the engine of its stations.
  */
-typedef struct max_heap {
-    int *elements;           ///< Array of elements in the heap.
-    unsigned short size;     ///< Current size of the heap.
-} MaxHeap;
+typedef struct highway {
+    int id;                  ///< Identifier of the highway.
+    Engine *engine;          ///< Stations, fleets and planners of the highway, NULL if the slot is free.
+} Highway;
 
 /**
- * @brief A structure representing a node in the binary search tree.
+ * @brief A structure representing a command waiting in the reorder buffer of the shard pool.
  */
-typedef struct tree_node {
-    int key;                 ///< Key of the node.
-    MaxHeap *cars;           ///< MaxHeap of cars associated with the node.
-    struct tree_node *left;  ///< Pointer to the left child.
-    struct tree_node *right; ///< Pointer to the right child.
-} TreeNode;
+typedef struct shard_task {
+    OutputWriter answer;     ///< The answer, never flushed.
+    bool done;               ///< True once the answer is ready, accessed atomically.
+} ShardTask;
 
 /**
- * @brief A structure representing an edge.
+ * @brief A structure representing a thread executing the commands of the highways hashed to it.
  */
-typedef struct edge {
-    int cost;                ///< Cost associated with the edge.
-    int from_index;          ///< Starting index of the edge.
-    int to_index;            ///< Ending index of the edge.
-} Edge;
+typedef struct shard {
+    pthread_t thread;                ///< The thread.
+    struct shard_pool *pool;         ///< The pool the shard belongs to.
+    SpscRing commands;               ///< Commands from the main thread, each preceded by its task and its highway.
+    InputReader reader;              ///< Reader decoding the commands of the ring.
+    Highway *highways;               ///< Open-addressing table of the highways of the shard.
+    int highway_count;               ///< Number of highways of the shard.
+    int highway_capacity;            ///< Number of slots of the table, a power of two.
+    size_t executed;                 ///< Number of commands executed.
+} Shard;
 
 /**
- * @brief A structure representing a node in the queue.
+ * @brief A structure representing the shard threads and the reorder buffer printing their answers.
+ *
+ * Every highway has its own engine, owned by the shard its id hashes to, so the shards share no state. The main thread
+ * parses the commands, hands each one to the ring of its shard and prints the answers in command order.
  */
-typedef struct queue_node {
-    Edge edge;               ///< Edge contained in the queue node.
-    struct queue_node *next; ///< Pointer to the next node in the queue.
-} QueueNode;
+typedef struct shard_pool {
+    Shard *shards;                           ///< The shards.
+    int shard_count;                         ///< Number of shards.
+    PlannerKind planner;                     ///< Planner of the engines of the highways.
+    int cache_capacity;                      ///< Capacity of the route caches of the highways.
+    OutputFormat format;                     ///< Format of the answers of the current run.
+    ShardTask tasks[SHARD_QUEUE_SIZE];       ///< Reorder buffer, task s stored at s % SHARD_QUEUE_SIZE.
+    unsigned long long submitted;            ///< Number of submitted tasks.
+    unsigned long long emitted;              ///< Number of answers printed.
+    int awaited;                             ///< Task the main thread waits for, -1 if none, accessed atomically.
+    pthread_mutex_t lock;                    ///< Protects the waits of the main thread.
+    pthread_cond_t done;                     ///< Signaled when a shard finishes the awaited task.
+    size_t stalls;                           ///< Number of times the main thread waited for a full buffer.
+} ShardPool;
 
 /**
- * @brief A structure representing a queue.
+ * @brief A structure representing the distribution of the latencies of a kind of command.
+ *
+ * Latencies are bucketed by power of two, each power split in LATENCY_SUB_BUCKETS linear buckets, so a percentile
+ * is reported with a relative error below 1 / LATENCY_SUB_BUCKETS.
  */
-typedef struct queue {
-    QueueNode *head;         ///< Pointer to the head of the queue.
-    QueueNode *tail;         ///< Pointer to the tail of the queue.
-} Queue;
+typedef struct latency_histogram {
+    unsigned long long counts[LATENCY_BUCKETS];   ///< Number of samples of each bucket.
+    unsigned long long samples;                   ///< Number of samples.
+    unsigned long long total;                     ///< Sum of the samples, in nanoseconds.
+    unsigned long long max;                       ///< Highest sample, in nanoseconds.
+} LatencyHistogram;
+
+/**
+ * @brief A structure representing the heap allocations made on the query path, by kind of buffer.
+ *
+ * Every buffer only grows, so once the counts stop increasing the queries do not allocate anymore.
+ */
+typedef struct query_allocations {
+    size_t workspaces;               ///< Growths of the workspaces of the planners, of the engines and of the threads.
+    size_t route_cache;              ///< Slabs of the text pools of the route caches.
+    size_t jump_tables;              ///< Growths of the jump tables.
+    size_t answers;                  ///< Growths of the answer buffers, of the command loop and of the threads.
+    size_t threads;                  ///< Growths of the shared buffers of the batch runner and of the layer pool.
+} QueryAllocations;
+
+/**
+ * @brief A structure representing an engine handle of the library, with the threads of its command loop.
+ */
+struct pathfinder {
+    Engine engine;                   ///< The station index and its planners.
+    BatchRunner *runner;             ///< Threads answering runs of queries, NULL if the queries are answered in order.
+    ReaderPool *readers;             ///< Reader threads, NULL if the queries are planned by the main thread.
+    Pipeline *pipeline;              ///< Parser and writer threads, NULL if the main thread parses and writes.
+    ShardPool *shards;               ///< Shard threads owning one engine per highway, NULL if there is one highway.
+    LatencyHistogram *latencies;     ///< Latency histograms indexed by CommandKind, NULL if they are not measured.
+    unsigned long long run_start;    ///< Start of the measured run, in nanoseconds.
+    bool binary;                     ///< True if the command loop speaks the binary protocol.
+    size_t answer_allocations;       ///< Heap allocations made to grow the writers of the command loops run so far.
+    OutputWriter answer;             ///< Routes planned by the typed calls, in the key format.
+};
+
+/**
+ * @brief Scan kernels used by the planners, selected once at startup.
+ */
+static const ScanKernels *scan_kernels;
+
+#ifdef PATHFINDER_INSTRUMENT
+/**
+ * @brief A structure representing the hot-path counters of an instrumented build.
+ *
+ * Counters are updated with relaxed atomics, since the batch and reader threads plan routes concurrently.
+ */
+typedef struct instrumentation {
+    unsigned long long tree_lookups;     ///< Descents from the root of the B+-tree.
+    unsigned long long tree_nodes;       ///< Nodes visited by the descents, leaves included.
+    unsigned long long fleet_searches;   ///< Binary searches in a fleet.
+    unsigned long long fleet_probes;     ///< Entries compared by the fleet searches.
+    unsigned long long bfs_enqueues;     ///< Stations pushed on the frontier of the breadth-first search.
+    unsigned long long greedy_layers;    ///< Layers built by the greedy planner.
+    LatencyHistogram ranges;             ///< Sizes of the planned ranges, bucketed like the latencies.
+} Instrumentation;
+
+/**
+ * @brief Hot-path counters, only compiled in with -DPATHFINDER_INSTRUMENT.
+ */
+static Instrumentation instrumentation;
+#endif
 
 // --------------------------------------------------------------------------- Structs ---------------------------------------------------------------------------
 
 // -------------------------------------------------------------------- Functions declaration --------------------------------------------------------------------
 
 /**
- * @brief Creates a MaxHeap.
- * @param size The initial size of the heap.
- * @param elements Array of elements to initialize the heap.
- * @return A pointer to the created MaxHeap.
+ * @brief Initializes an empty pool.
+ * @param pool Pointer to the pool.
+ * @param object_size The size of the objects of the pool.
  */
-MaxHeap *max_heap_create(int size, const int *elements);
+void pool_init(Pool *pool, size_t object_size);
 
 /**
- * @brief Inserts an element into the MaxHeap.
- * @param max_heap Pointer to the MaxHeap.
- * @param element The element to insert.
+ * @brief Allocates an object from a pool, reusing a freed one if available.
+ * @param pool Pointer to the pool.
+ * @return A pointer to the object.
  */
-void max_heap_insert(MaxHeap *max_heap, int element);
+void *pool_alloc(Pool *pool);
 
 /**
- * @brief Maintains the MaxHeap property by bubbling up an element.
- * @param max_heap Pointer to the MaxHeap.
- * @param index Index of the element to bubble up.
+ * @brief Gives an object back to its pool.
+ * @param pool Pointer to the pool.
+ * @param object Pointer to the object.
  */
-void max_heapify_bottom_up(MaxHeap *max_heap, int index);
+void pool_free(Pool *pool, void *object);
 
 /**
- * @brief Maintains the MaxHeap property by trickling down an element.
- * @param max_heap Pointer to the MaxHeap.
- * @param index Index of the element to trickle down.
+ * @brief Releases every slab of a pool.
+ * @param pool Pointer to the pool.
  */
-void max_heapify_top_down(MaxHeap *max_heap, int index);
+void pool_destroy(Pool *pool);
 
 /**
- * @brief Gets the index of an element in the MaxHeap.
- * @param max_heap Pointer to the MaxHeap.
- * @param element The element to find.
- * @return The index of the element, or -1 if not found.
+ * @brief Initializes the pools of an arena.
+ * @param arena Pointer to the arena.
  */
-int max_heap_get_index(MaxHeap *max_heap, int element);
+void arena_init(Arena *arena);
 
 /**
- * @brief Gets the parent index of a given index.
- * @param index The index to find the parent for.
- * @return The parent index.
+ * @brief Releases every pool of an arena.
+ * @param arena Pointer to the arena.
  */
-int max_heap_get_parent(int index);
+void arena_destroy(Arena *arena);
 
 /**
- * @brief Moves an element up in the MaxHeap.
- * @param max_heap Pointer to the MaxHeap.
- * @param index Index of the element to move up.
+ * @brief Prints the occupancy of every pool of an arena.
+ * @param arena Pointer to the arena.
+ * @param stream The stream to print to.
  */
-void max_heap_move_up(MaxHeap *max_heap, int index);
+void arena_report(const Arena *arena, FILE *stream);
 
 /**
- * @brief Removes an element from the MaxHeap.
- * @param max_heap Pointer to the MaxHeap.
- * @param element The element to remove.
+ * @brief Gets the size class of an entry array.
+ * @param length The number of entries to store.
+ * @return The smallest class whose arrays can hold length entries.
  */
-void max_heap_remove(MaxHeap *max_heap, int element);
+int fleet_size_class(int length);
 
 /**
- * @brief Creates a new tree node.
- * @param key The key of the node.
- * @param car_heap Pointer to the MaxHeap of cars.
- * @return A pointer to the created TreeNode.
+ * @brief Moves the entries of a Fleet into an array of another size class.
+ * @param arena Pointer to the arena.
+ * @param fleet Pointer to the Fleet.
+ * @param size_class The size class of the new array.
  */
-TreeNode *tree_create_node(int key, MaxHeap *car_heap);
+void fleet_resize(Arena *arena, Fleet *fleet, int size_class);
 
 /**
- * @brief Searches for a node in the tree.
- * @param root Pointer to the root of the tree.
- * @param key The key to search for.
- * @return A pointer to the found TreeNode, or NULL if not found.
+ * @brief Creates a Fleet.
+ *
+ * Only the first MAX_CARS autonomies are kept, like consecutive insertions would do.
+ * @param arena Pointer to the arena.
+ * @param size The number of autonomies.
+ * @param autonomies Array of autonomies, sorted in place.
+ * @return A pointer to the created Fleet.
  */
-TreeNode *tree_search_node(TreeNode *root, int key);
+Fleet *fleet_create(Arena *arena, int size, int *autonomies);
 
 /**
- * @brief Inserts a node into the tree.
- * @param root Pointer to the root of the tree.
- * @param key The key of the node to insert.
- * @param car_heap Pointer to the MaxHeap of cars.
- * @return A pointer to the root of the tree.
+ * @brief Creates a Fleet from its distinct autonomies.
+ * @param arena Pointer to the arena.
+ * @param entries The distinct autonomies in increasing order, with their number of cars.
+ * @param length The number of entries.
+ * @param size The total number of cars.
+ * @return A pointer to the created Fleet.
  */
-TreeNode *tree_insert_node(TreeNode *root, int key, MaxHeap *car_heap);
+Fleet *fleet_create_entries(Arena *arena, const FleetEntry *entries, int length, int size);
 
 /**
- * @brief Gets the node with the minimum key in the tree.
- * @param root Pointer to the root of the tree.
- * @return A pointer to the node with the minimum key.
+ * @brief Compares two autonomies for qsort.
+ * @param a Pointer to the first autonomy.
+ * @param b Pointer to the second autonomy.
+ * @return A negative, zero or positive value if a is lower, equal or greater than b.
  */
-TreeNode *tree_get_min_node(TreeNode *root);
+int fleet_compare(const void *a, const void *b);
 
 /**
- * @brief Removes a node from the tree.
- * @param root Pointer to the root of the tree.
- * @param key The key of the node to remove.
- * @return A pointer to the root of the tree.
+ * @brief Finds the first entry whose autonomy is not lower than a given one.
+ * @param fleet Pointer to the Fleet.
+ * @param autonomy The autonomy to find.
+ * @return The index of the entry, or the number of entries if every autonomy is lower.
  */
-TreeNode *tree_remove_node(TreeNode *root, int key);
+int fleet_lower_bound(const Fleet *fleet, int autonomy);
 
 /**
- * @brief Creates a new queue.
- * @return A pointer to the created Queue.
+ * @brief Inserts a car into the Fleet, unless it already holds MAX_CARS cars.
+ * @param arena Pointer to the arena.
+ * @param fleet Pointer to the Fleet.
+ * @param autonomy The autonomy of the car.
  */
-Queue *queue_create();
+void fleet_insert(Arena *arena, Fleet *fleet, int autonomy);
 
 /**
- * @brief Checks if the queue is empty.
- * @param queue Pointer to the Queue.
- * @return 1 if the queue is empty, 0 otherwise.
+ * @brief Removes a car from the Fleet, shrinking its entries when they are mostly unused.
+ * @param arena Pointer to the arena.
+ * @param fleet Pointer to the Fleet.
+ * @param autonomy The autonomy of the car.
+ * @return True if the car was removed, false if it was not found.
  */
-int queue_is_empty(Queue *queue);
+bool fleet_remove(Arena *arena, Fleet *fleet, int autonomy);
 
 /**
- * @brief Adds an edge to the queue.
- * @param queue Pointer to the Queue.
- * @param edge The Edge to add.
+ * @brief Gets the maximum autonomy of the Fleet.
+ * @param fleet Pointer to the Fleet.
+ * @return The maximum autonomy, or 0 if the fleet is empty.
  */
-void queue_enqueue(Queue *queue, Edge edge);
+int fleet_get_max(const Fleet *fleet);
 
 /**
- * @brief Removes and returns an edge from the queue.
- * @param queue Pointer to the Queue.
- * @return The Edge removed from the queue.
+ * @brief Destroys a Fleet.
+ * @param arena Pointer to the arena.
+ * @param fleet Pointer to the Fleet.
  */
-Edge queue_dequeue(Queue *queue);
+void fleet_destroy(Arena *arena, Fleet *fleet);
 
 /**
- * @brief Destroys the queue.
- * @param queue Pointer to the Queue.
+ * @brief Creates a new B+-tree node.
+ * @param arena Pointer to the arena.
+ * @param is_leaf True to create a leaf, false to create an internal node.
+ * @return A pointer to the created BPTreeNode.
  */
-void queue_destroy(Queue *queue);
+BPTreeNode *bptree_create_node(Arena *arena, bool is_leaf);
 
 /**
- * @brief Creates arrays representing the path between start and end.
- * @param root Pointer to the root of the tree.
- * @param start The starting key.
- * @param end The ending key.
+ * @brief Gets the first slot of a node whose key is not less than the given key.
+ * @param node Pointer to the node.
+ * @param key The key to search for.
+ * @return The slot index, num_keys if every key is less than the given key.
+ */
+int bptree_lower_bound(const BPTreeNode *node, int key);
+
+/**
+ * @brief Gets the first slot of a node whose key is greater than the given key.
+ * @param node Pointer to the node.
+ * @param key The key to search for.
+ * @return The slot index, num_keys if no key is greater than the given key.
+ */
+int bptree_upper_bound(const BPTreeNode *node, int key);
+
+/**
+ * @brief Gets the leaf that contains, or would contain, a key.
+ * @param tree Pointer to the tree.
+ * @param key The key to search for.
+ * @return A pointer to the leaf, or NULL if the tree is empty.
+ */
+BPTreeNode *bptree_find_leaf(const BPTree *tree, int key);
+
+/**
+ * @brief Locates a station in the tree.
+ * @param tree Pointer to the tree.
+ * @param key The key to search for.
+ * @param leaf Pointer where the leaf holding the station is stored.
+ * @param slot Pointer where the slot of the station in the leaf is stored.
+ * @return True if the station was found, false otherwise.
+ */
+bool bptree_find_station(const BPTree *tree, int key, BPTreeNode **leaf, int *slot);
+
+/**
+ * @brief Counts the stations whose key is less than (or equal to) a key.
+ * @param tree Pointer to the tree.
+ * @param key The key to rank.
+ * @param inclusive True to also count a station placed exactly at the key.
+ * @return The number of stations before the key.
+ */
+int bptree_rank(const BPTree *tree, int key, bool inclusive);
+
+/**
+ * @brief Computes the size of a range and, when possible, a view over it that needs no copy.
+ * @param tree Pointer to the tree.
+ * @param low The lowest key of the range.
+ * @param high The highest key of the range.
+ * @param range Pointer to the view to fill; its size is always set.
+ * @return True if the range lies in a single leaf and the view points into it, false if it must be copied.
+ */
+bool bptree_range_view(const BPTree *tree, int low, int high, StationRange *range);
+
+/**
+ * @brief Copies the keys and maximum autonomies of a range of stations.
+ * @param tree Pointer to the tree.
+ * @param low The lowest key of the range.
+ * @param count Number of stations to copy, as computed by bptree_range_view.
  * @param stations Array to store station keys.
  * @param autonomies Array to store autonomies.
- * @param size Pointer to the size of the arrays.
  */
-void path_array_create(TreeNode *root, int start, int end, int *stations, int *autonomies, int *size);
+void bptree_range_copy(const BPTree *tree, int low, int count, int *stations, int *autonomies);
 
 /**
- * @brief Calculates the path between start and end.
- * @param stations Array of station keys.
- * @param autonomies Array of autonomies.
- * @param size Size of the arrays.
+ * @brief Finds the leaf holding the station of a given rank, using the sizes of the subtrees.
+ * @param tree Pointer to the tree.
+ * @param rank Rank of the station, lower than the size of the tree.
+ * @param slot Pointer to store the position of the station in the leaf.
+ * @return The leaf holding the station.
+ */
+const BPTreeNode *bptree_select(const BPTree *tree, int rank, int *slot);
+
+/**
+ * @brief Copies the keys and maximum autonomies of the stations following a position, across the linked leaves.
+ * @param leaf The leaf holding the first station.
+ * @param slot Position of the first station in the leaf.
+ * @param count Number of stations to copy.
+ * @param stations Array to store station keys.
+ * @param autonomies Array to store autonomies.
+ */
+void bptree_leaf_copy(const BPTreeNode *leaf, int slot, int count, int *stations, int *autonomies);
+
+/**
+ * @brief Gets the summary of an empty run of stations.
+ * @return The empty summary.
+ */
+ReachSummary reach_summary_empty();
+
+/**
+ * @brief Appends a station to a summary.
+ * @param summary Pointer to the summary of the stations preceding the new one.
+ * @param key The key of the station.
+ * @param autonomy The maximum autonomy of the station.
+ */
+void reach_summary_append(ReachSummary *summary, int key, int autonomy);
+
+/**
+ * @brief Combines the summaries of two adjacent runs of stations.
+ * @param left The summary of the run with the lower keys.
+ * @param right The summary of the run with the higher keys.
+ * @return The summary of the concatenation of the two runs.
+ */
+ReachSummary reach_summary_combine(const ReachSummary *left, const ReachSummary *right);
+
+/**
+ * @brief Recomputes the summary of a node from its stations or from the summaries of its children.
+ * @param node Pointer to the node.
+ */
+void bptree_refresh_summary(BPTreeNode *node);
+
+/**
+ * @brief Recomputes the summaries of the nodes on the path to a key, from the leaf up to the root.
+ * @param tree Pointer to the tree.
+ * @param key The key of the station whose autonomy changed.
+ */
+void bptree_refresh_path(BPTree *tree, int key);
+
+/**
+ * @brief Summarizes the stations of a subtree whose keys are between low and high.
+ * @param node Pointer to the root of the subtree.
+ * @param low The lowest key.
+ * @param high The highest key.
+ * @param above_low True if every key of the subtree is known to be at least low.
+ * @param below_high True if every key of the subtree is known to be at most high.
+ * @return The summary of the stations in the range.
+ */
+ReachSummary bptree_summary_between(const BPTreeNode *node, int low, int high, bool above_low, bool below_high);
+
+/**
+ * @brief Checks in O(B log n) whether a route between two keys is blocked by a gap.
+ * @param tree Pointer to the tree.
  * @param start The starting key.
  * @param end The ending key.
+ * @return True if some station between the endpoints cannot be reached, false otherwise.
  */
-void path_calculate(int *stations, int *autonomies, int size, int start, int end);
+bool bptree_has_gap(const BPTree *tree, int start, int end);
 
 /**
- * @brief Prints the path in reverse order.
- * @param stations Array of station keys.
- * @param predecessors Array of predecessors.
- * @param size Size of the arrays.
+ * @brief Splits an overflowing node in two halves.
+ * @param arena Pointer to the arena.
+ * @param node Pointer to the node to split, it keeps the lower half.
+ * @param separator Pointer where the key separating the two halves is stored.
+ * @return A pointer to the new node holding the upper half.
+ */
+BPTreeNode *bptree_split_node(Arena *arena, BPTreeNode *node, int *separator);
+
+/**
+ * @brief Inserts a station into the tree.
+ * @param tree Pointer to the tree.
+ * @param key The key of the station to insert.
+ * @param cars Pointer to the Fleet of cars, owned by the tree on success.
+ * @return True if the station was inserted, false if the key was already present.
+ */
+bool bptree_insert(BPTree *tree, int key, Fleet *cars);
+
+/**
+ * @brief Moves the last entry of the left sibling into an underflowing child.
+ * @param parent Pointer to the parent node.
+ * @param slot Slot of the underflowing child in the parent.
+ */
+void bptree_borrow_from_left(BPTreeNode *parent, int slot);
+
+/**
+ * @brief Moves the first entry of the right sibling into an underflowing child.
+ * @param parent Pointer to the parent node.
+ * @param slot Slot of the underflowing child in the parent.
+ */
+void bptree_borrow_from_right(BPTreeNode *parent, int slot);
+
+/**
+ * @brief Merges two adjacent children of a node into the left one.
+ * @param arena Pointer to the arena.
+ * @param parent Pointer to the parent node.
+ * @param slot Slot of the left child in the parent.
+ */
+void bptree_merge_children(Arena *arena, BPTreeNode *parent, int slot);
+
+/**
+ * @brief Restores the minimum occupancy of a child after a removal.
+ * @param arena Pointer to the arena.
+ * @param parent Pointer to the parent node.
+ * @param slot Slot of the underflowing child in the parent.
+ * @return True if two children were merged and the parent lost a key, false otherwise.
+ */
+bool bptree_fix_underflow(Arena *arena, BPTreeNode *parent, int slot);
+
+/**
+ * @brief Removes a station from the tree and destroys its cars.
+ * @param tree Pointer to the tree.
+ * @param key The key of the station to remove.
+ * @return True if the station was removed, false if it was not found.
+ */
+bool bptree_remove(BPTree *tree, int key);
+
+/**
+ * @brief Adds a car to a station.
+ * @param tree Pointer to the tree.
+ * @param key The key of the station.
+ * @param autonomy The autonomy of the car.
+ * @param changed Pointer set to true if the maximum autonomy of the station changed, false otherwise.
+ * @return True if the station was found, false otherwise.
+ */
+bool bptree_add_car(BPTree *tree, int key, int autonomy, bool *changed);
+
+/**
+ * @brief Removes a car from a station.
+ * @param tree Pointer to the tree.
+ * @param key The key of the station.
+ * @param autonomy The autonomy of the car.
+ * @param changed Pointer set to true if the maximum autonomy of the station changed, false otherwise.
+ * @return True if the car was removed, false if the station or the car was not found.
+ */
+bool bptree_remove_car(BPTree *tree, int key, int autonomy, bool *changed);
+
+/**
+ * @brief Initializes an empty workspace.
+ * @param workspace Pointer to the workspace.
+ */
+void workspace_init(Workspace *workspace);
+
+/**
+ * @brief Releases the buffers of a workspace.
+ * @param workspace Pointer to the workspace.
+ */
+void workspace_destroy(Workspace *workspace);
+
+/**
+ * @brief Grows the range buffers of a workspace so that they hold at least a number of stations.
+ * @param workspace Pointer to the workspace.
+ * @param size The number of stations.
+ */
+void workspace_reserve(Workspace *workspace, int size);
+
+/**
+ * @brief Grows the frontier and visited buffers of a workspace, only used by the breadth-first search and the jump
+ * routes, so that they hold at least a number of stations.
+ * @param workspace Pointer to the workspace.
+ * @param size The number of stations.
+ */
+void workspace_reserve_search(Workspace *workspace, int size);
+
+/**
+ * @brief Grows the cars buffer of a workspace so that it holds at least a number of autonomies.
+ * @param workspace Pointer to the workspace.
+ * @param size The number of autonomies.
+ * @return A pointer to the cars buffer.
  */
-void path_print_reverse(const int *stations, const unsigned short *predecessors, int size);
+int *workspace_reserve_cars(Workspace *workspace, int size);
+
+/**
+ * @brief Records a mutation of the station index.
+ * @param log Pointer to the log.
+ * @param key The key of the station touched by the mutation.
+ */
+void mutation_log_record(MutationLog *log, int key);
+
+/**
+ * @brief Checks whether a mutation recorded after a version touched a key interval.
+ * @param log Pointer to the log.
+ * @param version The version to check from.
+ * @param low The lowest key of the interval.
+ * @param high The highest key of the interval.
+ * @return True if a later mutation touched the interval or the log no longer covers the version, false otherwise.
+ */
+bool mutation_log_touches(const MutationLog *log, unsigned long long version, int low, int high);
+
+/**
+ * @brief Records a mutation touching every key, used when the whole index is replaced.
+ * @param log Pointer to the log.
+ */
+void mutation_log_record_all(MutationLog *log);
+
+/**
+ * @brief Initializes an empty route cache.
+ * @param cache Pointer to the cache.
+ * @param capacity The maximum number of cached routes, 0 to disable the cache.
+ */
+void route_cache_init(RouteCache *cache, int capacity);
+
+/**
+ * @brief Switches the cache to the answers of another encoding, dropping the cached ones if it changes.
+ * @param cache Pointer to the cache.
+ * @param format The encoding of the answers stored from now on.
+ */
+void route_cache_set_format(RouteCache *cache, OutputFormat format);
+
+/**
+ * @brief Releases every entry of a route cache.
+ * @param cache Pointer to the cache.
+ */
+void route_cache_destroy(RouteCache *cache);
+
+/**
+ * @brief Gets the size class of the text block holding an answer.
+ * @param length The length of the answer, at most ROUTE_CACHE_MAX_TEXT.
+ * @return The index of the smallest class holding it.
+ */
+int route_cache_text_class(size_t length);
+
+/**
+ * @brief Gets the hash bucket of a route.
+ * @param cache Pointer to the cache.
+ * @param start The starting key.
+ * @param end The ending key.
+ * @return The index of the bucket.
+ */
+unsigned int route_cache_bucket(const RouteCache *cache, int start, int end);
+
+/**
+ * @brief Finds a cached route.
+ * @param cache Pointer to the cache.
+ * @param start The starting key.
+ * @param end The ending key.
+ * @return The index of the entry, or -1 if the route is not cached.
+ */
+int route_cache_find(const RouteCache *cache, int start, int end);
+
+/**
+ * @brief Unlinks an entry from the LRU list.
+ * @param cache Pointer to the cache.
+ * @param index The index of the entry.
+ */
+void route_cache_lru_unlink(RouteCache *cache, int index);
+
+/**
+ * @brief Marks an entry as the most recently used one.
+ * @param cache Pointer to the cache.
+ * @param index The index of the entry.
+ */
+void route_cache_touch(RouteCache *cache, int index);
+
+/**
+ * @brief Stores a formatted route, replacing the least recently used one if the cache is full.
+ *
+ * The answer is copied into a block of the smallest size class holding it, taken from the free list of its pool, so
+ * storing a route only allocates when that pool needs a new slab.
+ * @param cache Pointer to the cache.
+ * @param start The starting key.
+ * @param end The ending key.
+ * @param version Version of the index the route was planned at.
+ * @param text The formatted answer.
+ * @param length The length of the formatted answer.
+ */
+void route_cache_store(RouteCache *cache, int start, int end, unsigned long long version, const char *text, size_t length);
+
+/**
+ * @brief Initializes empty jump tables.
+ * @param jumps Pointer to the tables.
+ */
+void jump_tables_init(JumpTables *jumps);
+
+/**
+ * @brief Releases the buffers of the jump tables.
+ * @param jumps Pointer to the tables.
+ */
+void jump_tables_destroy(JumpTables *jumps);
+
+/**
+ * @brief Builds the jump tables over the current content of the index.
+ * @param jumps Pointer to the tables.
+ * @param tree Pointer to the tree.
+ * @param version Version of the index.
+ */
+void jump_tables_build(JumpTables *jumps, const BPTree *tree, unsigned long long version);
+
+/**
+ * @brief Gets the maximum of a slice of a max segment tree.
+ * @param tree The segment tree.
+ * @param leaves The number of leaves of the tree.
+ * @param low The first index of the slice.
+ * @param high The last index of the slice.
+ * @return The maximum value of the slice.
+ */
+long long jump_range_max(const long long *tree, int leaves, int low, int high);
+
+/**
+ * @brief Finds the first index, not lower than a given one, whose value is at least a threshold.
+ * @param tree The max segment tree.
+ * @param leaves The number of leaves of the tree.
+ * @param from The first index to consider.
+ * @param value The threshold.
+ * @return The index found, or -1 if every following value is lower.
+ */
+int jump_first_at_least(const long long *tree, int leaves, int from, long long value);
+
+/**
+ * @brief Counts the stops of the shortest route between two stations of the snapshot.
+ * @param jumps Pointer to the tables.
+ * @param source Index of the first station of the route.
+ * @param target Index of the last station of the route, different from the source.
+ * @return The number of hops, or -1 if the target is not reachable.
+ */
+int jump_hops(const JumpTables *jumps, int source, int target);
+
+/**
+ * @brief Plans a route with the jump tables and prints it.
+ *
+ * Forward, the predecessor of a stop is the first station from the source that reaches it. Backward, it is
+ * the first station of the previous layer that reaches it, the layer bounds being read along the next hops.
+ * @param jumps Pointer to the tables, up to date for the stations between start and end.
+ * @param start The starting key.
+ * @param end The ending key.
+ * @param workspace Pointer to the workspace holding the stops.
+ * @param out Pointer to the writer receiving the route.
+ */
+void jump_plan(const JumpTables *jumps, int start, int end, Workspace *workspace, OutputWriter *out);
+
+/**
+ * @brief Initializes an empty, disabled version index.
+ * @param index Pointer to the index.
+ * @param pool Pool the nodes are allocated from.
+ */
+void version_index_init(VersionIndex *index, Pool *pool);
+
+/**
+ * @brief Publishes a version with a new station.
+ * @param index Pointer to the index.
+ * @param key The key of the station, not in the index.
+ * @param autonomy The maximum autonomy of the station.
+ */
+void version_index_insert(VersionIndex *index, int key, int autonomy);
+
+/**
+ * @brief Publishes a version without a station.
+ * @param index Pointer to the index.
+ * @param key The key of the station, in the index.
+ */
+void version_index_remove(VersionIndex *index, int key);
+
+/**
+ * @brief Publishes a version where a station has a different maximum autonomy.
+ * @param index Pointer to the index.
+ * @param key The key of the station, in the index.
+ * @param autonomy The new maximum autonomy.
+ */
+void version_index_update(VersionIndex *index, int key, int autonomy);
+
+/**
+ * @brief Publishes a version holding the stations of a tree, built bottom-up.
+ * @param index Pointer to the index.
+ * @param tree Pointer to the tree.
+ */
+void version_index_build(VersionIndex *index, const BPTree *tree);
+
+/**
+ * @brief Retires every node of a subtree.
+ * @param index Pointer to the index.
+ * @param node Root of the subtree.
+ */
+void version_node_retire_tree(VersionIndex *index, VersionNode *node);
+
+/**
+ * @brief Frees the retired nodes no query can reach anymore.
+ * @param index Pointer to the index.
+ * @param oldest Oldest version still pinned by a query.
+ */
+void version_index_reclaim(VersionIndex *index, unsigned long long oldest);
+
+/**
+ * @brief Copies the stations of a snapshot between two keys into the range buffers of a workspace.
+ * @param root Root of the snapshot.
+ * @param low The lowest key.
+ * @param high The highest key.
+ * @param workspace Pointer to the workspace receiving the stations.
+ * @return The number of copied stations.
+ */
+int version_index_collect(const VersionNode *root, int low, int high, Workspace *workspace);
+
+/**
+ * @brief Copies a node for the version being built, retiring the original.
+ * @param index Pointer to the index.
+ * @param node The node to copy.
+ * @return The copy.
+ */
+VersionNode *version_node_copy(VersionIndex *index, VersionNode *node);
+
+/**
+ * @brief Retires a node dropped by the version being built.
+ * @param index Pointer to the index.
+ * @param node The node to retire.
+ */
+void version_node_retire(VersionIndex *index, VersionNode *node);
+
+/**
+ * @brief Moves the upper half of an overflowing node to a new sibling.
+ * @param index Pointer to the index.
+ * @param node The node to split, not published yet.
+ * @return The new sibling.
+ */
+VersionNode *version_node_split(VersionIndex *index, VersionNode *node);
+
+/**
+ * @brief Finds the child of an internal node whose keys may contain a key.
+ * @param node The internal node.
+ * @param key The key.
+ * @return The slot of the child.
+ */
+int version_node_child(const VersionNode *node, int key);
+
+/**
+ * @brief Inserts a station in the subtree of a node, copying the path to its leaf.
+ * @param index Pointer to the index.
+ * @param node Root of the subtree.
+ * @param key The key of the station.
+ * @param autonomy The maximum autonomy of the station.
+ * @param sibling Set to the new right sibling if the node was split, NULL otherwise.
+ * @return The copy of the node.
+ */
+VersionNode *version_node_insert(VersionIndex *index, VersionNode *node, int key, int autonomy, VersionNode **sibling);
+
+/**
+ * @brief Removes a station from the subtree of a node, copying the path to its leaf.
+ *
+ * Nodes are not merged: emptied nodes are dropped, so the height only depends on past insertions.
+ * @param index Pointer to the index.
+ * @param node Root of the subtree.
+ * @param key The key of the station.
+ * @return The copy of the node, NULL if the subtree became empty.
+ */
+VersionNode *version_node_remove(VersionIndex *index, VersionNode *node, int key);
+
+/**
+ * @brief Sets the maximum autonomy of a station of the subtree of a node, copying the path to its leaf.
+ * @param index Pointer to the index.
+ * @param node Root of the subtree.
+ * @param key The key of the station.
+ * @param autonomy The new maximum autonomy.
+ * @return The copy of the node.
+ */
+VersionNode *version_node_update(VersionIndex *index, VersionNode *node, int key, int autonomy);
+
+/**
+ * @brief Appends the stations of the subtree of a node between two keys to the range buffers of a workspace.
+ * @param node Root of the subtree.
+ * @param low The lowest key.
+ * @param high The highest key.
+ * @param workspace Pointer to the workspace receiving the stations.
+ * @param count Pointer to the number of stations already appended.
+ */
+void version_node_collect(const VersionNode *node, int low, int high, Workspace *workspace, int *count);
+
+/**
+ * @brief Initializes an empty engine.
+ *
+ * The engine must not be moved afterwards, since its tree points to its arena.
+ * @param engine Pointer to the engine.
+ * @param planner The algorithm used to plan the routes.
+ * @param cache_capacity The maximum number of cached routes, 0 to disable the cache.
+ */
+void engine_init(Engine *engine, PlannerKind planner, int cache_capacity);
+
+/**
+ * @brief Releases every station and buffer of an engine.
+ * @param engine Pointer to the engine.
+ */
+void engine_destroy(Engine *engine);
+
+/**
+ * @brief Adds a station to the engine.
+ * @param engine Pointer to the engine.
+ * @param key The key of the station.
+ * @param size The number of cars of the station.
+ * @param autonomies Array of autonomies of the cars, sorted in place.
+ * @return True if the station was added, false if the key was already present.
+ */
+bool engine_add_station(Engine *engine, int key, int size, int *autonomies);
+
+/**
+ * @brief Inserts the pending run of stations in the index.
+ *
+ * A run at least as long as the index is merged with it in a single bottom-up build, a shorter one is inserted one
+ * station at a time. Every command other than aggiungi-stazione must be preceded by a flush.
+ * @param engine Pointer to the engine.
+ */
+void engine_flush_run(Engine *engine);
+
+/**
+ * @brief Removes a station from the engine.
+ * @param engine Pointer to the engine.
+ * @param key The key of the station.
+ * @return True if the station was removed, false if it was not found.
+ */
+bool engine_remove_station(Engine *engine, int key);
+
+/**
+ * @brief Adds a car to a station of the engine.
+ * @param engine Pointer to the engine.
+ * @param key The key of the station.
+ * @param autonomy The autonomy of the car.
+ * @return True if the station was found, false otherwise, even if the car was ignored because the fleet is full.
+ */
+bool engine_add_car(Engine *engine, int key, int autonomy);
+
+/**
+ * @brief Removes a car from a station of the engine.
+ * @param engine Pointer to the engine.
+ * @param key The key of the station.
+ * @param autonomy The autonomy of the car.
+ * @return True if the car was removed, false if the station or the car was not found.
+ */
+bool engine_remove_car(Engine *engine, int key, int autonomy);
+
+/**
+ * @brief Publishes the new maximum autonomy of a station in the version index, if it is enabled.
+ * @param engine Pointer to the engine.
+ * @param key The key of the station.
+ */
+void engine_publish_autonomy(Engine *engine, int key);
+
+/**
+ * @brief Plans a route between two stations and prints it.
+ * @param engine Pointer to the engine.
+ * @param start The starting key.
+ * @param end The ending key.
+ * @param out Pointer to the writer receiving the route.
+ */
+void engine_plan_route(Engine *engine, int start, int end, OutputWriter *out);
+
+/**
+ * @brief Plans the routes from a station to several ones and prints them in order.
+ *
+ * The range covering every target is extracted once and planned with one pass in each direction; the predecessors
+ * of a pass answer all the targets on its side with the tie-break of a single query. If a key is not a station, or
+ * with the breadth-first planner, every route is planned on its own.
+ * @param engine Pointer to the engine.
+ * @param start The starting key.
+ * @param targets The ending keys.
+ * @param count The number of targets.
+ * @param out Pointer to the writer receiving the routes.
+ */
+void engine_plan_routes(Engine *engine, int start, const int *targets, int count, OutputWriter *out);
+
+/**
+ * @brief Reads the arguments of a command and runs it on the engine.
+ *
+ * The statistics command, which is about the whole run, is left to the caller.
+ * @param engine Pointer to the engine.
+ * @param kind The kind of the command, already read.
+ * @param reader Pointer to the reader of the arguments.
+ * @param arguments Pointer to the last value read for each argument.
+ * @param out Pointer to the writer receiving the response.
+ */
+void engine_execute(Engine *engine, CommandKind kind, InputReader *reader, CommandArguments *arguments,
+                    OutputWriter *out);
+
+/**
+ * @brief Gets the stations between two keys, as a view into a leaf or copied into the workspace.
+ *
+ * The workspace always grows to hold the predecessors of the range. Ranges of at least the threshold of the layer
+ * pool are copied by its threads.
+ * @param engine Pointer to the engine.
+ * @param low The lowest key of the range.
+ * @param high The highest key of the range.
+ * @param range Pointer to the range to fill.
+ */
+void engine_extract_range(Engine *engine, int low, int high, StationRange *range);
+
+/**
+ * @brief Prints the occupancy of the pools, the workspace and the route cache of an engine.
+ * @param engine Pointer to the engine.
+ * @param stream The stream to print to.
+ */
+void engine_report(const Engine *engine, FILE *stream);
+
+/**
+ * @brief Adds the heap allocations made by the buffers an engine plans its routes with.
+ * @param engine Pointer to the engine.
+ * @param allocations The counters to add to.
+ */
+void engine_count_allocations(const Engine *engine, QueryAllocations *allocations);
+
+/**
+ * @brief Writes the stations and their fleets to a snapshot file.
+ * @param engine Pointer to the engine.
+ * @param path The path of the file.
+ * @return True on success, false if the file could not be written.
+ */
+bool engine_save(const Engine *engine, const char *path);
+
+/**
+ * @brief Replaces every station with the ones of a snapshot file.
+ *
+ * The file is mapped in memory and fully validated before the index is touched; the index is then built bottom-up
+ * in linear time.
+ * @param engine Pointer to the engine.
+ * @param path The path of the file.
+ * @return True on success, false if the file is missing, truncated, corrupted or of another version.
+ */
+bool engine_load(Engine *engine, const char *path);
+
+/**
+ * @brief Computes the FNV-1a hash of a buffer.
+ * @param hash The hash of the preceding bytes, or the FNV offset basis.
+ * @param data The buffer.
+ * @param size The size of the buffer.
+ * @return The hash including the buffer.
+ */
+unsigned long long snapshot_checksum(unsigned long long hash, const void *data, size_t size);
+
+/**
+ * @brief Checks that the content of a snapshot describes a valid index.
+ * @param stations The stations of the snapshot.
+ * @param count The number of stations.
+ * @param entries The fleet entries of the snapshot.
+ * @param entry_count The number of fleet entries.
+ * @return True if the keys are increasing and every fleet is well formed.
+ */
+bool snapshot_validate(const SnapshotStation *stations, size_t count, const FleetEntry *entries, size_t entry_count);
+
+/**
+ * @brief Releases every node and fleet of the tree, leaving it empty.
+ * @param tree Pointer to the tree.
+ */
+void bptree_clear(BPTree *tree);
+
+/**
+ * @brief Moves the keys and fleets of the tree to two arrays and releases its nodes, leaving it empty.
+ * @param tree Pointer to the tree.
+ * @param keys Array receiving the keys in increasing order, with room for every station.
+ * @param fleets Array receiving the fleets, in the same order.
+ */
+void bptree_detach(BPTree *tree, int *keys, Fleet **fleets);
+
+/**
+ * @brief Releases a subtree, and its fleets if asked.
+ * @param arena Pointer to the arena.
+ * @param node Root of the subtree.
+ * @param fleets True to release the fleets of the subtree too.
+ */
+void bptree_destroy_node(Arena *arena, BPTreeNode *node, bool fleets);
+
+/**
+ * @brief Gets the greatest key of the tree by following its rightmost children.
+ * @param tree Pointer to the tree.
+ * @return The greatest key, INT_MIN if the tree is empty.
+ */
+int bptree_max_key(const BPTree *tree);
+
+/**
+ * @brief Builds the tree bottom-up from sorted stations, filling the nodes to BPTREE_BULK_FILL keys.
+ * @param tree Pointer to the tree, empty.
+ * @param keys The keys of the stations, in increasing order.
+ * @param fleets The fleets of the stations, owned by the tree afterwards.
+ * @param count The number of stations.
+ */
+void bptree_build(BPTree *tree, const int *keys, Fleet **fleets, int count);
+
+/**
+ * @brief Gets the number of nodes a level of a bulk-built tree is split in.
+ * @param count The number of keys or children of the level.
+ * @param capacity The maximum number of keys or children of a node.
+ * @return The number of nodes, each holding at least half of the capacity unless the level fits in one node.
+ */
+int bptree_build_groups(int count, int capacity);
+
+/**
+ * @brief Makes sure that the jump tables can answer a query, rebuilding them if it pays off.
+ *
+ * Tables are still valid for a query if no mutation touched its interval since they were built. Otherwise
+ * they are rebuilt once the stations planned without them add up to the size of the index.
+ * @param engine Pointer to the engine.
+ * @param low The lowest key of the query.
+ * @param high The highest key of the query.
+ * @return True if the tables can answer the query, false if it must be planned over the range.
+ */
+bool engine_jump_tables_ready(Engine *engine, int low, int high);
+
+/**
+ * @brief Starts the worker threads of a batch runner.
+ * @param runner Pointer to the runner.
+ * @param engine Pointer to the engine answering the queries.
+ * @param thread_count Number of workers, the main thread included.
+ */
+void batch_runner_init(BatchRunner *runner, Engine *engine, int thread_count);
+
+/**
+ * @brief Stops the worker threads of a batch runner and releases its buffers.
+ * @param runner Pointer to the runner.
+ */
+void batch_runner_destroy(BatchRunner *runner);
+
+/**
+ * @brief Adds a query to the batch, executing the batch if it is full.
+ * @param runner Pointer to the runner.
+ * @param start The starting key.
+ * @param end The ending key.
+ * @param out Pointer to the writer receiving the answers.
+ */
+void batch_runner_add(BatchRunner *runner, int start, int end, OutputWriter *out);
+
+/**
+ * @brief Executes the queries of the batch and prints their answers in command order.
+ * @param runner Pointer to the runner.
+ * @param out Pointer to the writer receiving the answers.
+ */
+void batch_runner_run(BatchRunner *runner, OutputWriter *out);
+
+/**
+ * @brief Answers the trivial, cached, blocked and empty queries and groups the other ones in clusters.
+ * @param runner Pointer to the runner.
+ */
+void batch_runner_prepare(BatchRunner *runner);
+
+/**
+ * @brief Runs a phase on every worker, the main thread included, and waits for its end.
+ * @param runner Pointer to the runner.
+ * @param phase The phase to run.
+ * @param task_count Number of tasks of the phase.
+ */
+void batch_runner_dispatch(BatchRunner *runner, BatchPhase phase, int task_count);
+
+/**
+ * @brief Grabs and executes tasks of the current phase until none is left.
+ * @param runner Pointer to the runner.
+ * @param worker Pointer to the worker executing the tasks.
+ */
+void batch_runner_work(BatchRunner *runner, BatchWorker *worker);
+
+/**
+ * @brief Body of the worker threads.
+ * @param argument Pointer to the BatchWorker of the thread.
+ * @return Always NULL.
+ */
+void *batch_worker_main(void *argument);
+
+/**
+ * @brief Compares two batch orders by first rank for qsort.
+ * @param a Pointer to the first order.
+ * @param b Pointer to the second order.
+ * @return A negative, zero or positive value if a is lower, equal or greater than b.
+ */
+int batch_order_compare(const void *a, const void *b);
+
+/**
+ * @brief Prints the counters of a batch runner.
+ * @param runner Pointer to the runner.
+ * @param stream The stream to print to.
+ */
+void batch_runner_report(const BatchRunner *runner, FILE *stream);
+
+/**
+ * @brief Adds the heap allocations made by the buffers of a batch runner and of its workers.
+ * @param runner Pointer to the runner, with no batch running.
+ * @param allocations The counters to add to.
+ */
+void batch_runner_count_allocations(const BatchRunner *runner, QueryAllocations *allocations);
+
+/**
+ * @brief Starts the reader threads and mirrors the station index of the engine in its version index.
+ * @param pool Pointer to the pool.
+ * @param engine Pointer to the engine, still empty.
+ * @param thread_count Number of reader threads.
+ */
+void reader_pool_init(ReaderPool *pool, Engine *engine, int thread_count);
+
+/**
+ * @brief Waits for every pending answer and prints it.
+ * @param pool Pointer to the pool.
+ * @param out Pointer to the writer receiving the answers.
+ */
+void reader_pool_finish(ReaderPool *pool, OutputWriter *out);
+
+/**
+ * @brief Stops the reader threads and releases the buffers, once every answer was printed by reader_pool_finish.
+ * @param pool Pointer to the pool.
+ */
+void reader_pool_destroy(ReaderPool *pool);
+
+/**
+ * @brief Submits a pianifica-percorso command, answering it at once when no planning is needed.
+ * @param pool Pointer to the pool.
+ * @param start The starting key.
+ * @param end The ending key.
+ * @param out Pointer to the writer receiving the answers.
+ */
+void reader_pool_submit(ReaderPool *pool, int start, int end, OutputWriter *out);
+
+/**
+ * @brief Gets the writer the answer of a command must go to to keep the command order.
+ * @param pool Pointer to the pool.
+ * @param out Pointer to the writer receiving the answers.
+ * @return The writer itself if no answer is pending, the buffer of a new task otherwise.
+ */
+OutputWriter *reader_pool_sink(ReaderPool *pool, OutputWriter *out);
+
+/**
+ * @brief Takes the next slot of the reorder buffer, waiting for the readers if it is full.
+ * @param pool Pointer to the pool.
+ * @param out Pointer to the writer receiving the answers.
+ * @return The task of the slot.
+ */
+ReaderTask *reader_pool_reserve(ReaderPool *pool, OutputWriter *out);
+
+/**
+ * @brief Prints the answers ready at the head of the reorder buffer and reclaims the versions nobody reads anymore.
+ * @param pool Pointer to the pool.
+ * @param out Pointer to the writer receiving the answers.
+ */
+void reader_pool_drain(ReaderPool *pool, OutputWriter *out);
+
+/**
+ * @brief Body of the reader threads.
+ * @param argument Pointer to the ReaderWorker of the thread.
+ * @return Always NULL.
+ */
+void *reader_worker_main(void *argument);
+
+/**
+ * @brief Prints the counters of a reader pool.
+ * @param pool Pointer to the pool.
+ * @param stream The stream to print to.
+ */
+void reader_pool_report(const ReaderPool *pool, FILE *stream);
+
+/**
+ * @brief Adds the heap allocations made by the workspaces of the readers and by the answers of the reorder buffer.
+ * @param pool Pointer to the pool, with every submitted answer printed.
+ * @param allocations The counters to add to.
+ */
+void reader_pool_count_allocations(const ReaderPool *pool, QueryAllocations *allocations);
+
+/**
+ * @brief Allocates an empty ring.
+ * @param ring Pointer to the ring.
+ * @param size Number of slots, a power of two.
+ * @param batch Number of slots ready for a sleeping side that wake it up, at most size.
+ */
+void spsc_ring_init(SpscRing *ring, size_t size, size_t batch);
+
+/**
+ * @brief Releases the slots of a ring.
+ * @param ring Pointer to the ring.
+ */
+void spsc_ring_destroy(SpscRing *ring);
+
+/**
+ * @brief Writes a value in the next slot, waiting for the consumer if the ring is full. Called by the producer.
+ *
+ * The value is visible to the consumer once published.
+ * @param ring Pointer to the ring.
+ * @param value The value.
+ */
+void spsc_ring_push(SpscRing *ring, int value);
+
+/**
+ * @brief Makes the written slots visible to the consumer, waking it up if it sleeps. Called by the producer.
+ * @param ring Pointer to the ring.
+ * @param urgent True to wake the consumer up even if less than a batch of slots is ready, because the producer is
+ *               about to block.
+ */
+void spsc_ring_publish(SpscRing *ring, bool urgent);
+
+/**
+ * @brief Publishes the written slots and marks the end of the stream. Called by the producer.
+ * @param ring Pointer to the ring.
+ */
+void spsc_ring_close(SpscRing *ring);
+
+/**
+ * @brief Reads the next slot, waiting for the producer if the ring is empty. Called by the consumer.
+ *
+ * The slot can be overwritten once released.
+ * @param ring Pointer to the ring.
+ * @param value Pointer where the value is stored.
+ * @return True if a value was read, false if the ring is empty and closed.
+ */
+bool spsc_ring_pop(SpscRing *ring, int *value);
+
+/**
+ * @brief Gives the read slots back to the producer, waking it up if it sleeps. Called by the consumer.
+ * @param ring Pointer to the ring.
+ */
+void spsc_ring_release(SpscRing *ring);
+
+/**
+ * @brief Waits until an index of the ring moves or the ring is closed, spinning first and then sleeping.
+ * @param ring Pointer to the ring.
+ * @param index The index of the other side.
+ * @param value The value of the index the caller cannot progress with.
+ * @param waits Counter of the sleeps of the caller.
+ */
+void spsc_ring_wait(SpscRing *ring, const size_t *index, size_t value, size_t *waits);
+
+/**
+ * @brief Wakes up the side sleeping on a ring, if any, after an index was published.
+ * @param ring Pointer to the ring.
+ */
+void spsc_ring_wake(SpscRing *ring);
+
+/**
+ * @brief Starts the parser and writer threads, after which the reader and the writer go through the pipeline.
+ * @param pipeline Pointer to the pipeline.
+ * @param reader Pointer to the reader of the input, whose state moves to the parser thread.
+ * @param out Pointer to the writer of the responses, whose buffer becomes the first block.
+ */
+void pipeline_start(Pipeline *pipeline, InputReader *reader, OutputWriter *out);
+
+/**
+ * @brief Hands the last block to the writer thread, joins the threads and gives the reader its input back.
+ *
+ * Must be called once the reader reached the end of the commands.
+ * @param pipeline Pointer to the pipeline.
+ * @param reader Pointer to the reader given to pipeline_start.
+ * @param out Pointer to the writer given to pipeline_start.
+ */
+void pipeline_stop(Pipeline *pipeline, InputReader *reader, OutputWriter *out);
+
+/**
+ * @brief Hands the responses of the writer to the writer thread and takes a written block in exchange.
+ * @param pipeline Pointer to the pipeline.
+ * @param out Pointer to the writer.
+ */
+void pipeline_flush(Pipeline *pipeline, OutputWriter *out);
+
+/**
+ * @brief Reads the next decoded command, giving the slots of the previous one back to the thread decoding them.
+ * @param commands Pointer to the ring of the decoded commands.
+ * @param kind Pointer where the kind of the command is stored.
+ * @return True if a command was read, false at the end of the input.
+ */
+bool pipeline_next_command(SpscRing *commands, CommandKind *kind);
+
+/**
+ * @brief Reads a path decoded by another thread into the buffer of the reader.
+ * @param reader Pointer to the reader consuming the ring of the decoded commands.
+ * @param token Pointer where the start of the path is stored.
+ * @param length Pointer where the length of the path is stored.
+ * @return True if the decoder read a token, false at the end of the input.
+ */
+bool pipeline_next_token(InputReader *reader, const char **token, int *length);
+
+/**
+ * @brief Reads the arguments of a command and pushes the command with its arguments onto a ring.
+ *
+ * A missing argument is sent as the value it last had, as the main loop reads it when it parses the input itself.
+ * @param reader Pointer to the reader parsing the input.
+ * @param kind The kind of the command, already read.
+ * @param arguments Pointer to the last value read for each argument.
+ * @param commands Pointer to the ring receiving the command.
+ */
+void command_encode(InputReader *reader, CommandKind kind, CommandArguments *arguments, SpscRing *commands);
+
+/**
+ * @brief Body of the parser thread: decodes every command with its arguments into the command ring.
+ * @param argument Pointer to the Pipeline.
+ * @return Always NULL.
+ */
+void *pipeline_parser_main(void *argument);
+
+/**
+ * @brief Body of the writer thread: writes the blocks of responses in the order they are handed over.
+ * @param argument Pointer to the Pipeline.
+ * @return Always NULL.
+ */
+void *pipeline_writer_main(void *argument);
+
+/**
+ * @brief Prints the counters of a pipeline.
+ * @param pipeline Pointer to the pipeline.
+ * @param stream The stream to print to.
+ */
+void pipeline_report(const Pipeline *pipeline, FILE *stream);
+
+/**
+ * @brief Initializes a shard pool with no highway.
+ * @param pool Pointer to the pool.
+ * @param shard_count Number of shard threads.
+ * @param planner Planner of the engines of the highways.
+ * @param cache_capacity Capacity of the route caches of the highways.
+ */
+void shard_pool_init(ShardPool *pool, int shard_count, PlannerKind planner, int cache_capacity);
+
+/**
+ * @brief Releases the highways of a shard pool and its buffers.
+ * @param pool Pointer to the pool.
+ */
+void shard_pool_destroy(ShardPool *pool);
+
+/**
+ * @brief Executes every command of the input on the shard threads, started for the run, and prints the answers.
+ *
+ * Each command is preceded by the id of its highway; a text command without one belongs to highway 0. A snapshot is
+ * saved or loaded once every previous command is done, and before any following one starts, as snapshot files can be
+ * shared between highways.
+ * @param pool Pointer to the pool.
+ * @param reader Pointer to the reader of the input.
+ * @param out Pointer to the writer receiving the answers in command order.
+ * @param latencies The latency histograms indexed by CommandKind, NULL if the latencies are not measured.
+ */
+void shard_pool_run(ShardPool *pool, InputReader *reader, OutputWriter *out, LatencyHistogram *latencies);
+
+/**
+ * @brief Gets a free task of the reorder buffer, waiting for the oldest one if the buffer is full.
+ * @param pool Pointer to the pool.
+ * @param out Pointer to the writer receiving the answers.
+ * @return The index of the task in the buffer.
+ */
+int shard_pool_reserve(ShardPool *pool, OutputWriter *out);
+
+/**
+ * @brief Hands every queued command to its shard and waits until a number of answers are printed.
+ * @param pool Pointer to the pool.
+ * @param out Pointer to the writer receiving the answers.
+ * @param emitted Number of answers printed since the pool was created, at most the number of submitted tasks.
+ */
+void shard_pool_wait(ShardPool *pool, OutputWriter *out, unsigned long long emitted);
+
+/**
+ * @brief Prints the answers of the oldest tasks, up to the first one not done yet.
+ * @param pool Pointer to the pool.
+ * @param out Pointer to the writer receiving the answers.
+ */
+void shard_pool_drain(ShardPool *pool, OutputWriter *out);
+
+/**
+ * @brief Hashes the id of a highway, to pick its shard and its slot in the table of the shard.
+ * @param id The id of the highway.
+ * @return The hash.
+ */
+unsigned int highway_hash(int id);
+
+/**
+ * @brief Finds the engine of a highway of a shard, creating it with no station the first time.
+ * @param shard Pointer to the shard.
+ * @param id The id of the highway.
+ * @return Pointer to the engine.
+ */
+Engine *shard_highway(Shard *shard, int id);
+
+/**
+ * @brief Body of a shard thread: executes the commands of its ring on the engines of their highways.
+ * @param argument Pointer to the Shard.
+ * @return Always NULL.
+ */
+void *shard_main(void *argument);
+
+/**
+ * @brief Prints the counters of a shard pool, with the stations and route cache counters of all its highways.
+ * @param pool Pointer to the pool.
+ * @param stream The stream to print to.
+ */
+void shard_pool_report(const ShardPool *pool, FILE *stream);
+
+/**
+ * @brief Adds the heap allocations made by the engines of all the highways and by the answers of the reorder buffer.
+ * @param pool Pointer to the pool, with every submitted answer printed.
+ * @param allocations The counters to add to.
+ */
+void shard_pool_count_allocations(const ShardPool *pool, QueryAllocations *allocations);
+
+/**
+ * @brief Starts the threads of a layer pool.
+ * @param pool Pointer to the pool.
+ * @param thread_count Number of workers, the main thread included.
+ * @param threshold Minimum number of stations of a range planned by the pool.
+ */
+void layer_pool_init(LayerPool *pool, int thread_count, int threshold);
+
+/**
+ * @brief Stops the threads of a layer pool and releases its buffers.
+ * @param pool Pointer to the pool.
+ */
+void layer_pool_destroy(LayerPool *pool);
+
+/**
+ * @brief Copies the keys and maximum autonomies of a range of stations, one chunk per task.
+ * @param pool Pointer to the pool.
+ * @param tree Pointer to the tree.
+ * @param first Rank of the first station of the range.
+ * @param count Number of stations to copy.
+ * @param stations Array to store station keys.
+ * @param autonomies Array to store autonomies.
+ */
+void layer_pool_extract(LayerPool *pool, const BPTree *tree, int first, int count, int *stations, int *autonomies);
+
+/**
+ * @brief Plans a route between start and end with the layer sweep and prints it, as path_plan does.
+ * @param pool Pointer to the pool.
+ * @param range Pointer to the stations between start and end, in increasing key order.
+ * @param start The starting key.
+ * @param end The ending key.
+ * @param predecessors Array of at least range->size elements receiving the predecessors.
+ * @param out Pointer to the writer receiving the route.
+ */
+void layer_pool_plan(LayerPool *pool, const StationRange *range, int start, int end, int *predecessors,
+                     OutputWriter *out);
+
+/**
+ * @brief Computes the same layers and predecessors as path_plan_forward_extent, splitting the wide layers.
+ * @param pool Pointer to the pool.
+ * @param range Pointer to the stations, in increasing key order.
+ * @param predecessors Array where the predecessor of every reached station is stored.
+ * @return The index of the last reachable station; every station up to it is reachable.
+ */
+int layer_pool_forward_extent(LayerPool *pool, const StationRange *range, int *predecessors);
+
+/**
+ * @brief Computes the same layers and predecessors as path_plan_reverse_extent, splitting the wide layers.
+ * @param pool Pointer to the pool.
+ * @param range Pointer to the stations, in increasing key order.
+ * @param predecessors Array where the predecessor of every reached station is stored.
+ * @return The index of the first reachable station; every station from it on is reachable.
+ */
+int layer_pool_reverse_extent(LayerPool *pool, const StationRange *range, int *predecessors);
+
+/**
+ * @brief Computes the reach of the current layer, the highest key + autonomy going forward or the lowest key -
+ *        autonomy going backward.
+ *
+ * The reach of every chunk of the layer is then replaced by the best reach of the chunks up to it, in increasing key
+ * order, so that the first chunk holding a predecessor of a station can be found with a binary search.
+ * @param pool Pointer to the pool.
+ * @return The reach of the layer.
+ */
+long long layer_pool_reach(LayerPool *pool);
+
+/**
+ * @brief Finds the first chunk of the current layer holding a station that reaches a key.
+ * @param pool Pointer to the pool, after layer_pool_reach.
+ * @param key The key to reach, within the reach of the layer.
+ * @return The index of the chunk, in increasing key order.
+ */
+int layer_pool_first_chunk(const LayerPool *pool, int key);
+
+/**
+ * @brief Runs a phase on every worker, the main thread included, and waits for its end.
+ *
+ * A phase with a single task is run by the main thread alone.
+ * @param pool Pointer to the pool.
+ * @param phase The phase to run.
+ * @param task_count Number of tasks of the phase.
+ */
+void layer_pool_dispatch(LayerPool *pool, LayerPhase phase, int task_count);
+
+/**
+ * @brief Grabs and executes tasks of the current phase until none is left.
+ * @param pool Pointer to the pool.
+ */
+void layer_pool_work(LayerPool *pool);
+
+/**
+ * @brief Body of the threads of a layer pool.
+ * @param argument Pointer to the LayerPool.
+ * @return Always NULL.
+ */
+void *layer_worker_main(void *argument);
+
+/**
+ * @brief Prints the counters of a layer pool.
+ * @param pool Pointer to the pool.
+ * @param stream The stream to print to.
+ */
+void layer_pool_report(const LayerPool *pool, FILE *stream);
+
+/**
+ * @brief Calculates the path between start and end.
+ * @param range Pointer to the stations between start and end, in increasing key order.
+ * @param start The starting key.
+ * @param end The ending key.
+ * @param workspace Pointer to a workspace holding at least range->size stations.
+ * @param out Pointer to the writer receiving the route.
+ */
+void path_calculate(const StationRange *range, int start, int end, Workspace *workspace, OutputWriter *out);
+
+/**
+ * @brief Plans a route between start and end and prints it.
+ * @param range Pointer to the stations between start and end, in increasing key order.
+ * @param start The starting key.
+ * @param end The ending key.
+ * @param planner The algorithm used to compute the route.
+ * @param workspace Pointer to a workspace holding at least range->size stations.
+ * @param out Pointer to the writer receiving the route.
+ */
+void path_plan(const StationRange *range, int start, int end, PlannerKind planner, Workspace *workspace, OutputWriter *out);
+
+/**
+ * @brief Computes the shortest routes from the first station of a range towards the following ones.
+ *
+ * The stations are split in layers of equal distance from the source; each station gets as predecessor
+ * the first station of the previous layer that reaches it, which selects the route preferring the
+ * stops closest to the start of the highway.
+ * @param range Pointer to the stations, in increasing key order.
+ * @param predecessors Array where the predecessor of every reached station is stored.
+ * @return True if the last station of the range is reachable, false otherwise.
+ */
+bool path_plan_forward(const StationRange *range, int *predecessors);
+
+/**
+ * @brief Computes the shortest routes from the first station of a range as far as they go.
+ *
+ * Same layers and predecessors as path_plan_forward. The predecessors of a station depend only on the stations
+ * before it, so they are the ones a query ending at that station would compute.
+ * @param range Pointer to the stations, in increasing key order.
+ * @param predecessors Array where the predecessor of every reached station is stored.
+ * @return The index of the last reachable station; every station up to it is reachable.
+ */
+int path_plan_forward_extent(const StationRange *range, int *predecessors);
+
+/**
+ * @brief Computes the shortest routes from the last station of a range towards the previous ones.
+ *
+ * Mirror of path_plan_forward: the layers grow towards lower keys and each station gets as predecessor
+ * the first station of the previous layer, in increasing key order, that reaches it.
+ * @param range Pointer to the stations, in increasing key order.
+ * @param predecessors Array where the predecessor of every reached station is stored.
+ * @return True if the first station of the range is reachable, false otherwise.
+ */
+bool path_plan_reverse(const StationRange *range, int *predecessors);
+
+/**
+ * @brief Computes the shortest routes from the last station of a range towards the previous ones, as far as they go.
+ * @param range Pointer to the stations, in increasing key order.
+ * @param predecessors Array where the predecessor of every reached station is stored.
+ * @return The index of the first reachable station; every station from it on is reachable.
+ */
+int path_plan_reverse_extent(const StationRange *range, int *predecessors);
+
+/**
+ * @brief Finds a station in a range.
+ * @param range Pointer to the stations, in increasing key order.
+ * @param key The key of the station.
+ * @return The index of the station, -1 if the range does not hold it.
+ */
+int path_find_station(const StationRange *range, int key);
+
+/**
+ * @brief Finds the first station of a run whose key is at least a given value.
+ * @param stations Station keys, in increasing order.
+ * @param low Index of the first station of the run.
+ * @param high Index of the last station of the run.
+ * @param key The value to compare the keys to.
+ * @return The index of the station, high + 1 if every key of the run is lower.
+ */
+int path_lower_index(const int *stations, int low, int high, long long key);
+
+/**
+ * @brief Finds the first station of a run farther than a reach, as ScanKernels.forward_extent does.
+ *
+ * The first LAYER_POOL_CHUNK stations are scanned, then the rest of the run is binary searched, so that narrow layers
+ * cost as much as with the scan and wide ones do not pay for their width.
+ * @param stations Station keys, in increasing order.
+ * @param from Index of the first station of the run.
+ * @param last Index of the last station of the run.
+ * @param reach The reach.
+ * @return The index of the first station whose key is greater than the reach, last + 1 if none.
+ */
+int path_gallop_forward(const int *stations, int from, int last, long long reach);
+
+/**
+ * @brief Finds the first station of a run from the start of the array that is within a reach, as
+ *        ScanKernels.reverse_extent does, scanning the last LAYER_POOL_CHUNK stations before a binary search.
+ * @param stations Station keys, in increasing order.
+ * @param from Index of the last station of the run.
+ * @param reach The reach.
+ * @return The index of the first station of the suffix whose keys are at least the reach, from + 1 if none.
+ */
+int path_gallop_reverse(const int *stations, int from, long long reach);
+
+/**
+ * @brief Links the stations of a forward layer to the first station of the previous layer reaching them.
+ * @param stations Station keys.
+ * @param autonomies Maximum autonomy of each station.
+ * @param predecessors Array where the predecessors are stored.
+ * @param from Index of the first station of the previous layer reaching the station at low.
+ * @param low Index of the first station to link.
+ * @param high Index of the last station to link.
+ */
+void path_link_forward(const int *stations, const int *autonomies, int *predecessors, int from, int low, int high);
+
+/**
+ * @brief Links the stations of a backward layer to the first station of the previous layer reaching them.
+ * @param stations Station keys.
+ * @param autonomies Maximum autonomy of each station.
+ * @param predecessors Array where the predecessors are stored.
+ * @param from Index of the first station of the previous layer reaching the station at high.
+ * @param high Index of the first station to link, the highest one.
+ * @param low Index of the last station to link.
+ */
+void path_link_reverse(const int *stations, const int *autonomies, int *predecessors, int from, int high, int low);
+
+/**
+ * @brief Gets the highest key + autonomy of a run of stations.
+ * @param stations Station keys.
+ * @param autonomies Maximum autonomy of each station.
+ * @param low Index of the first station of the run.
+ * @param high Index of the last station of the run.
+ * @return The highest reach.
+ */
+long long scan_max_reach_scalar(const int *stations, const int *autonomies, int low, int high);
+
+/**
+ * @brief Gets the lowest key - autonomy of a run of stations.
+ * @param stations Station keys.
+ * @param autonomies Maximum autonomy of each station.
+ * @param low Index of the first station of the run.
+ * @param high Index of the last station of the run.
+ * @return The lowest reach.
+ */
+long long scan_min_reach_scalar(const int *stations, const int *autonomies, int low, int high);
+
+/**
+ * @brief Finds the first station going forward whose key is over a reach.
+ * @param stations Station keys, in increasing order.
+ * @param from Index the scan starts from.
+ * @param last Index of the last station to scan.
+ * @param reach The reach.
+ * @return The index of the first station over the reach, last + 1 if none.
+ */
+int scan_forward_extent_scalar(const int *stations, int from, int last, long long reach);
+
+/**
+ * @brief Finds the lowest station of the run of stations going backward whose keys are not under a reach.
+ * @param stations Station keys, in increasing order.
+ * @param from Index the scan starts from.
+ * @param reach The reach.
+ * @return The index of the lowest station of the run, from + 1 if stations[from] is under the reach.
+ */
+int scan_reverse_extent_scalar(const int *stations, int from, long long reach);
+
+/**
+ * @brief Tests which stations of a block reach a previous station, going backward.
+ * @param stations Station keys, in increasing order.
+ * @param autonomies Maximum autonomy of each station.
+ * @param base Key of the station to reach, not greater than the keys of the block.
+ * @param from Index of the first station of the block.
+ * @param count Number of stations of the block, at most SCAN_MASK_WIDTH.
+ * @return A mask whose bit i is set if station from + i reaches base.
+ */
+unsigned int scan_reverse_mask_scalar(const int *stations, const int *autonomies, int base, int from, int count);
+
+#ifdef SCAN_KERNELS_X86
+/**
+ * @brief SSE4.2 version of scan_max_reach_scalar.
+ */
+long long scan_max_reach_sse4(const int *stations, const int *autonomies, int low, int high);
+
+/**
+ * @brief SSE4.2 version of scan_min_reach_scalar.
+ */
+long long scan_min_reach_sse4(const int *stations, const int *autonomies, int low, int high);
+
+/**
+ * @brief SSE4.2 version of scan_forward_extent_scalar.
+ */
+int scan_forward_extent_sse4(const int *stations, int from, int last, long long reach);
+
+/**
+ * @brief SSE4.2 version of scan_reverse_extent_scalar.
+ */
+int scan_reverse_extent_sse4(const int *stations, int from, long long reach);
+
+/**
+ * @brief SSE4.2 version of scan_reverse_mask_scalar.
+ */
+unsigned int scan_reverse_mask_sse4(const int *stations, const int *autonomies, int base, int from, int count);
+
+/**
+ * @brief AVX2 version of scan_max_reach_scalar.
+ */
+long long scan_max_reach_avx2(const int *stations, const int *autonomies, int low, int high);
+
+/**
+ * @brief AVX2 version of scan_min_reach_scalar.
+ */
+long long scan_min_reach_avx2(const int *stations, const int *autonomies, int low, int high);
+
+/**
+ * @brief AVX2 version of scan_forward_extent_scalar.
+ */
+int scan_forward_extent_avx2(const int *stations, int from, int last, long long reach);
+
+/**
+ * @brief AVX2 version of scan_reverse_extent_scalar.
+ */
+int scan_reverse_extent_avx2(const int *stations, int from, long long reach);
+
+/**
+ * @brief AVX2 version of scan_reverse_mask_scalar.
+ */
+unsigned int scan_reverse_mask_avx2(const int *stations, const int *autonomies, int base, int from, int count);
+#endif
+
+/**
+ * @brief Selects the scan kernels.
+ * @param name Name of the instruction set to use, or NULL to pick the best one supported by the CPU.
+ * @return The kernels, NULL if the instruction set is unknown or not supported.
+ */
+const ScanKernels *scan_kernels_select(const char *name);
+
+/**
+ * @brief Measures every supported scan kernel on synthetic ranges of 10^3 to 10^6 stations.
+ * @param stream The stream to print the timings to.
+ */
+void scan_kernels_benchmark(FILE *stream);
+
+/**
+ * @brief Reads the monotonic clock.
+ * @return The time in nanoseconds.
+ */
+unsigned long long latency_now();
+
+/**
+ * @brief Gets the bucket of a latency.
+ * @param nanoseconds The latency.
+ * @return The index of the bucket.
+ */
+int latency_bucket(unsigned long long nanoseconds);
+
+/**
+ * @brief Adds a sample to a histogram.
+ * @param histogram Pointer to the histogram.
+ * @param nanoseconds The latency.
+ */
+void latency_record(LatencyHistogram *histogram, unsigned long long nanoseconds);
+
+/**
+ * @brief Gets a percentile of a histogram.
+ * @param histogram Pointer to the histogram.
+ * @param fraction The fraction of the samples below the percentile, between 0 and 1.
+ * @return The lower bound of the bucket holding the percentile, in nanoseconds.
+ */
+unsigned long long latency_percentile(const LatencyHistogram *histogram, double fraction);
+
+/**
+ * @brief Prints the throughput and the latency percentiles of every kind of command.
+ * @param histograms The histograms, indexed by CommandKind.
+ * @param elapsed Wall time of the whole run, in nanoseconds.
+ * @param stream The stream to print to.
+ */
+void latency_report(const LatencyHistogram *histograms, unsigned long long elapsed, FILE *stream);
+
+#ifdef PATHFINDER_INSTRUMENT
+/**
+ * @brief Adds the size of a planned range to the instrumentation counters.
+ * @param size The number of stations of the range.
+ */
+void instrument_record_range(int size);
+#endif
+
+/**
+ * @brief Prints the hot-path counters, or a note if the build is not instrumented.
+ * @param stream The stream to print to.
+ */
+void instrumentation_report(FILE *stream);
+
+/**
+ * @brief Prints every statistic available for the run.
+ * @param engine Pointer to the engine.
+ * @param runner Pointer to the batch runner, NULL if none.
+ * @param readers Pointer to the reader pool, NULL if none.
+ * @param pipeline Pointer to the pipeline, NULL if none.
+ * @param shards Pointer to the shard pool, NULL if none.
+ * @param latencies The latency histograms indexed by CommandKind, NULL if the latencies are not measured.
+ * @param elapsed Wall time of the run so far, in nanoseconds.
+ * @param answers Heap allocations made by the answer buffers not owned by the engine or the pools.
+ * @param stream The stream to print to.
+ */
+void stats_report(const Engine *engine, const BatchRunner *runner, const ReaderPool *readers, const Pipeline *pipeline,
+                  const ShardPool *shards, const LatencyHistogram *latencies, unsigned long long elapsed,
+                  size_t answers, FILE *stream);
+
+/**
+ * @brief Prints the route ending at a station, from its source to the station itself.
+ *
+ * The route is measured first and then formatted backwards straight into the output buffer.
+ * @param stations Array of station keys.
+ * @param predecessors Array of predecessors computed by the planner.
+ * @param source Index of the first station of the route.
+ * @param target Index of the last station of the route.
+ * @param out Pointer to the writer receiving the route.
+ */
+void path_print_route(const int *stations, const int *predecessors, int source, int target, OutputWriter *out);
+
+/**
+ * @brief Prints the path in reverse order.
+ * @param stations Array of station keys.
+ * @param predecessors Array of predecessors.
+ * @param size Size of the arrays.
+ * @param out Pointer to the writer receiving the route.
+ */
+void path_print_reverse(const int *stations, const int *predecessors, int size, OutputWriter *out);
+
+/**
+ * @brief Prints the path in decreasing key order, following the predecessors from the last station.
+ * @param stations Array of station keys.
+ * @param predecessors Array of predecessors.
+ * @param size Size of the arrays.
+ * @param out Pointer to the writer receiving the route.
+ */
+void path_print_reverse2(const int *stations, const int *predecessors, int size, OutputWriter *out);
+
+/**
+ * @brief Prints a route in the binary or the key format, following the predecessors from its last station.
+ * @param stations Array of station keys.
+ * @param predecessors Array of predecessors computed by the planner.
+ * @param first Index of the station where the predecessors end.
+ * @param last Index of the station where the predecessors start.
+ * @param walk_order True to print the last station first, false to print the first station first.
+ * @param out Pointer to the writer receiving the route.
+ */
+void path_print_binary(const int *stations, const int *predecessors, int first, int last, bool walk_order,
+                       OutputWriter *out);
+
+/**
+ * @brief Prints a route stored from its last stop back to its first one.
+ * @param stations Array of station keys.
+ * @param chain Indices of the stops, the last stop first.
+ * @param count Number of stops.
+ * @param out Pointer to the writer receiving the route.
+ */
+void path_print_chain(const int *stations, const int *chain, int count, OutputWriter *out);
+
+/**
+ * @brief Opens a reader over a file descriptor, mapping it in memory when it is a regular file.
+ * @param reader Pointer to the reader to initialize.
+ * @param fd The file descriptor to read.
+ * @return True on success, false if the buffer could not be allocated.
+ */
+bool reader_open(InputReader *reader, int fd);
+
+/**
+ * @brief Releases the buffer or the mapping of a reader.
+ * @param reader Pointer to the reader.
+ */
+void reader_close(InputReader *reader);
+
+/**
+ * @brief Reads the next block of input, keeping the unparsed bytes at the start of the buffer.
+ * @param reader Pointer to the reader.
+ * @return True if new bytes were read, false at the end of the input.
+ */
+bool reader_refill(InputReader *reader);
+
+/**
+ * @brief Skips the whitespace before the next token.
+ * @param reader Pointer to the reader.
+ * @return True if a token follows, false at the end of the input.
+ */
+bool reader_skip_spaces(InputReader *reader);
+
+/**
+ * @brief Reads the next whitespace-delimited token.
+ * @param reader Pointer to the reader.
+ * @param token Pointer where the start of the token is stored; it is valid until the next read.
+ * @param length Pointer where the length of the token is stored.
+ * @return True if a token was read, false at the end of the input.
+ */
+bool reader_next_token(InputReader *reader, const char **token, int *length);
+
+/**
+ * @brief Reads the next decimal integer, with an optional sign.
+ * @param reader Pointer to the reader.
+ * @param value Pointer where the integer is stored; it is left untouched on failure.
+ * @return True if an integer was read, false if the next token is not a number or the input ended.
+ */
+bool reader_next_int(InputReader *reader, int *value);
+
+/**
+ * @brief Returns the pages of a mapped input already parsed to the kernel, so that a long input does not stay
+ * resident as a whole.
+ * @param reader Pointer to the reader, over a mapping.
+ */
+void reader_release(InputReader *reader);
+
+/**
+ * @brief Reads the next unsigned LEB128 varint of the binary protocol.
+ * @param reader Pointer to the reader.
+ * @param value Pointer where the 32-bit value is stored, reinterpreted as a signed integer.
+ * @return True if a varint was read, false if the input ended or the varint is longer than 5 bytes.
+ */
+bool reader_next_varint(InputReader *reader, unsigned int *value);
+
+/**
+ * @brief Reads the next command, a token of the text protocol or an opcode of the binary protocol.
+ * @param reader Pointer to the reader.
+ * @param kind Pointer where the command is stored.
+ * @return True if a command was read, false at the end of the input.
+ */
+bool reader_next_command(InputReader *reader, CommandKind *kind);
+
+/**
+ * @brief Recognizes a command from its token.
+ * @param token The token to recognize.
+ * @param length The length of the token.
+ * @return The recognized command, or COMMAND_UNKNOWN.
+ */
+CommandKind command_parse(const char *token, int length);
+
+/**
+ * @brief Recognizes a command from its opcode.
+ * @param opcode The opcode to recognize.
+ * @return The recognized command, or COMMAND_UNKNOWN.
+ */
+CommandKind command_decode(unsigned char opcode);
+
+/**
+ * @brief Opens a buffered writer over a file descriptor.
+ * @param out Pointer to the writer to initialize.
+ * @param fd The file descriptor to write.
+ * @return True on success, false if the buffer could not be allocated.
+ */
+bool writer_open(OutputWriter *out, int fd);
+
+/**
+ * @brief Flushes a writer and releases its buffer.
+ * @param out Pointer to the writer.
+ */
+void writer_close(OutputWriter *out);
+
+/**
+ * @brief Writes every buffered byte to the file descriptor, or hands them to the writer thread of the pipeline.
+ * @param out Pointer to the writer.
+ */
+void writer_flush(OutputWriter *out);
+
+/**
+ * @brief Writes bytes to a file descriptor, retrying short and interrupted writes.
+ * @param fd The file descriptor.
+ * @param bytes The bytes to write.
+ * @param length Number of bytes to write.
+ */
+void writer_send(int fd, const char *bytes, size_t length);
+
+/**
+ * @brief Flushes the writer if the buffered bytes went over the flush threshold.
+ * @param out Pointer to the writer.
+ */
+void writer_end_command(OutputWriter *out);
+
+/**
+ * @brief Appends uninitialized bytes to the buffer, growing it if needed.
+ * @param out Pointer to the writer.
+ * @param size Number of bytes to append.
+ * @return A pointer to the appended bytes, to be filled by the caller.
+ */
+char *writer_reserve(OutputWriter *out, size_t size);
+
+/**
+ * @brief Appends bytes to the buffer.
+ * @param out Pointer to the writer.
+ * @param text The bytes to append.
+ * @param length Number of bytes to append.
+ */
+void writer_write(OutputWriter *out, const char *text, size_t length);
+
+/**
+ * @brief Appends an integer in decimal notation to the buffer.
+ * @param out Pointer to the writer.
+ * @param value The integer to append.
+ */
+void writer_write_int(OutputWriter *out, int value);
+
+/**
+ * @brief Appends the outcome of an update: one of two texts, or a 1 or 0 byte in binary.
+ * @param out Pointer to the writer.
+ * @param success The outcome.
+ * @param success_text The text printed on success.
+ * @param failure_text The text printed on failure.
+ */
+void writer_write_outcome(OutputWriter *out, bool success, const char *success_text, const char *failure_text);
+
+/**
+ * @brief Appends a route made of a single station.
+ * @param out Pointer to the writer.
+ * @param key The key of the station.
+ */
+void writer_write_station_route(OutputWriter *out, int key);
+
+/**
+ * @brief Appends the answer of a query without a route: "nessun percorso", or an empty route in the other formats.
+ * @param out Pointer to the writer.
+ */
+void writer_write_no_route(OutputWriter *out);
+
+/**
+ * @brief Appends an unsigned LEB128 varint to the buffer.
+ * @param out Pointer to the writer.
+ * @param value The value to append.
+ */
+void writer_write_varint(OutputWriter *out, unsigned int value);
+
+/**
+ * @brief Appends an integer of a route in a non-text format: a varint in binary, a native int in the key format.
+ * @param out Pointer to the writer.
+ * @param value The integer to append.
+ */
+void writer_write_key(OutputWriter *out, int value);
+
+/**
+ * @brief Formats an unsigned LEB128 varint starting at a position.
+ * @param position Pointer to the first byte to write.
+ * @param value The value to format.
+ * @return A pointer just past the last byte written.
+ */
+char *writer_format_varint(char *position, unsigned int value);
+
+/**
+ * @brief Counts the bytes of an unsigned LEB128 varint.
+ * @param value The value to measure.
+ * @return The number of bytes, from 1 to 5.
+ */
+int writer_varint_length(unsigned int value);
+
+/**
+ * @brief Formats an integer in decimal notation, ending right before a position.
+ * @param end Pointer just past the last digit to write.
+ * @param value The integer to format.
+ * @return A pointer to the first character written.
+ */
+char *writer_format_int(char *end, int value);
+
+/**
+ * @brief Counts the characters of an integer in decimal notation.
+ * @param value The integer to measure.
+ * @return The number of characters, sign included.
+ */
+int writer_int_length(int value);
+
+// -------------------------------------------------------------------- Functions declaration --------------------------------------------------------------------
+
+// ---------------------------------------------------------------------- Library interface ----------------------------------------------------------------------
+
+void pathfinder_options_init(PathFinderOptions *options) {
+    options->planner = PATHFINDER_PLANNER_GREEDY;
+    options->cache_capacity = ROUTE_CACHE_DEFAULT_CAPACITY;
+    options->threads = 1;
+    options->readers = 0;
+    options->binary = false;
+    options->pipeline = false;
+    options->latency = false;
+    options->parallel = 1;
+    options->parallel_threshold = LAYER_POOL_DEFAULT_THRESHOLD;
+    options->shards = 0;
+}
+
+bool pathfinder_options_valid(const PathFinderOptions *options) {
+    return options->threads >= 1 && options->readers >= 0 && !(options->threads > 1 && options->readers > 0) &&
+           options->parallel >= 1 && options->parallel_threshold >= 1 &&
+           !(options->parallel > 1 && (options->threads > 1 || options->readers > 0)) && options->shards >= 0 &&
+           !(options->shards > 0 &&
+             (options->threads > 1 || options->readers > 0 || options->parallel > 1 || options->pipeline));
+}
+
+PathFinder *pathfinder_create(const PathFinderOptions *options) {
+    PathFinderOptions defaults;
+    PathFinder *pathfinder;
+
+    if (options == NULL) {
+        pathfinder_options_init(&defaults);
+        options = &defaults;
+    }
+    if (!pathfinder_options_valid(options)) {
+        return NULL;
+    }
+    if (scan_kernels == NULL) {
+        scan_kernels = scan_kernels_select(NULL);
+    }
+
+    pathfinder = (PathFinder *)malloc(sizeof(PathFinder));
+    if (pathfinder == NULL) {
+        return NULL;
+    }
+    engine_init(&pathfinder->engine,
+                options->planner == PATHFINDER_PLANNER_BFS    ? PLANNER_BFS
+                : options->planner == PATHFINDER_PLANNER_JUMP ? PLANNER_JUMP
+                                                              : PLANNER_GREEDY,
+                options->cache_capacity);
+    pathfinder->runner = NULL;
+    pathfinder->readers = NULL;
+    pathfinder->pipeline = NULL;
+    pathfinder->shards = NULL;
+    pathfinder->latencies = NULL;
+    pathfinder->run_start = latency_now();
+    pathfinder->binary = options->binary;
+    pathfinder->answer_allocations = 0;
+    if (!writer_open(&pathfinder->answer, -1)) {
+        engine_destroy(&pathfinder->engine);
+        free(pathfinder);
+        return NULL;
+    }
+    pathfinder->answer.format = OUTPUT_KEYS;
+
+    if (options->threads > 1) {
+        pathfinder->runner = (BatchRunner *)malloc(sizeof(BatchRunner));
+        if (pathfinder->runner == NULL) {
+            pathfinder_destroy(pathfinder);
+            return NULL;
+        }
+        batch_runner_init(pathfinder->runner, &pathfinder->engine, options->threads);
+    }
+    if (options->readers > 0) {
+        pathfinder->readers = (ReaderPool *)malloc(sizeof(ReaderPool));
+        if (pathfinder->readers == NULL) {
+            pathfinder_destroy(pathfinder);
+            return NULL;
+        }
+        reader_pool_init(pathfinder->readers, &pathfinder->engine, options->readers);
+    }
+    if (options->parallel > 1) {
+        pathfinder->engine.layers = (LayerPool *)malloc(sizeof(LayerPool));
+        if (pathfinder->engine.layers == NULL) {
+            pathfinder_destroy(pathfinder);
+            return NULL;
+        }
+        layer_pool_init(pathfinder->engine.layers, options->parallel, options->parallel_threshold);
+    }
+    if (options->pipeline) {
+        pathfinder->pipeline = (Pipeline *)calloc(1, sizeof(Pipeline));
+        if (pathfinder->pipeline == NULL) {
+            pathfinder_destroy(pathfinder);
+            return NULL;
+        }
+    }
+    if (options->shards > 0) {
+        pathfinder->shards = (ShardPool *)malloc(sizeof(ShardPool));
+        if (pathfinder->shards == NULL) {
+            pathfinder_destroy(pathfinder);
+            return NULL;
+        }
+        shard_pool_init(pathfinder->shards, options->shards, pathfinder->engine.planner, options->cache_capacity);
+    }
+    if (options->latency) {
+        pathfinder->latencies = (LatencyHistogram *)calloc(COMMAND_UNKNOWN + 1, sizeof(LatencyHistogram));
+        if (pathfinder->latencies == NULL) {
+            pathfinder_destroy(pathfinder);
+            return NULL;
+        }
+    }
+    return pathfinder;
+}
+
+void pathfinder_destroy(PathFinder *pathfinder) {
+    if (pathfinder == NULL) {
+        return;
+    }
+    if (pathfinder->runner != NULL) {
+        batch_runner_destroy(pathfinder->runner);
+        free(pathfinder->runner);
+    }
+    if (pathfinder->readers != NULL) {
+        reader_pool_destroy(pathfinder->readers);
+        free(pathfinder->readers);
+    }
+    if (pathfinder->engine.layers != NULL) {
+        layer_pool_destroy(pathfinder->engine.layers);
+        free(pathfinder->engine.layers);
+    }
+    if (pathfinder->shards != NULL) {
+        shard_pool_destroy(pathfinder->shards);
+        free(pathfinder->shards);
+    }
+    free(pathfinder->pipeline);
+    free(pathfinder->latencies);
+    free(pathfinder->answer.buffer);
+    engine_destroy(&pathfinder->engine);
+    free(pathfinder);
+}
+
+bool pathfinder_add_station(PathFinder *pathfinder, int distance, const int *autonomies, int count) {
+    int *cars = workspace_reserve_cars(&pathfinder->engine.workspace, count);
+
+    if (count > 0) {
+        memcpy(cars, autonomies, count * sizeof(int));
+    }
+    return engine_add_station(&pathfinder->engine, distance, count, cars);
+}
+
+bool pathfinder_remove_station(PathFinder *pathfinder, int distance) {
+    engine_flush_run(&pathfinder->engine);
+    return engine_remove_station(&pathfinder->engine, distance);
+}
+
+bool pathfinder_add_car(PathFinder *pathfinder, int distance, int autonomy) {
+    engine_flush_run(&pathfinder->engine);
+    return engine_add_car(&pathfinder->engine, distance, autonomy);
+}
+
+bool pathfinder_remove_car(PathFinder *pathfinder, int distance, int autonomy) {
+    engine_flush_run(&pathfinder->engine);
+    return engine_remove_car(&pathfinder->engine, distance, autonomy);
+}
+
+int pathfinder_plan_route(PathFinder *pathfinder, int start, int end, int *stations, int capacity) {
+    OutputWriter *answer = &pathfinder->answer;
+    int size;
+
+    engine_flush_run(&pathfinder->engine);
+    route_cache_set_format(&pathfinder->engine.cache, OUTPUT_KEYS);
+    answer->length = 0;
+    engine_plan_route(&pathfinder->engine, start, end, answer);
+
+    memcpy(&size, answer->buffer, sizeof(int));
+    if (size > 0 && size <= capacity) {
+        memcpy(stations, answer->buffer + sizeof(int), size * sizeof(int));
+    }
+    return size;
+}
+
+int pathfinder_plan_routes(PathFinder *pathfinder, int start, const int *targets, int count, int *stations,
+                           int capacity, int *lengths) {
+    OutputWriter *answer = &pathfinder->answer;
+    int total = 0;
+
+    engine_flush_run(&pathfinder->engine);
+    route_cache_set_format(&pathfinder->engine.cache, OUTPUT_KEYS);
+    answer->length = 0;
+    engine_plan_routes(&pathfinder->engine, start, targets, count, answer);
+
+    const char *route = answer->buffer;
+    for (int i = 0; i < count; i++) {
+        memcpy(&lengths[i], route, sizeof(int));
+        route += (lengths[i] + 1) * sizeof(int);
+        total += lengths[i];
+    }
+    if (total <= capacity) {
+        route = answer->buffer;
+        for (int i = 0; i < count; i++) {
+            if (lengths[i] > 0) {
+                memcpy(stations, route + sizeof(int), lengths[i] * sizeof(int));
+            }
+            stations += lengths[i];
+            route += (lengths[i] + 1) * sizeof(int);
+        }
+    }
+    return total;
+}
+
+bool pathfinder_save(PathFinder *pathfinder, const char *path) {
+    engine_flush_run(&pathfinder->engine);
+    return engine_save(&pathfinder->engine, path);
+}
+
+bool pathfinder_load(PathFinder *pathfinder, const char *path) {
+    engine_flush_run(&pathfinder->engine);
+    return engine_load(&pathfinder->engine, path);
+}
+
+bool pathfinder_serve(PathFinder *pathfinder, int input_fd, int output_fd) {
+    CommandArguments arguments = {0};
+    Engine *engine = &pathfinder->engine;
+    BatchRunner *runner = pathfinder->runner;
+    ReaderPool *readers = pathfinder->readers;
+    LatencyHistogram *latencies = pathfinder->latencies;
+    unsigned long long command_start = 0;
+    InputReader reader;
+    OutputWriter out;
+
+    if (!reader_open(&reader, input_fd)) {
+        return false;
+    }
+    if (!writer_open(&out, output_fd)) {
+        reader_close(&reader);
+        return false;
+    }
+    reader.binary = pathfinder->binary;
+    out.format = pathfinder->binary ? OUTPUT_BINARY : OUTPUT_TEXT;
+    route_cache_set_format(&engine->cache, out.format);
+    if (pathfinder->pipeline != NULL) {
+        pipeline_start(pathfinder->pipeline, &reader, &out);
+    }
+
+    if (latencies != NULL) {
+        pathfinder->run_start = command_start = latency_now();
+    }
+    if (pathfinder->shards != NULL) {
+        shard_pool_run(pathfinder->shards, &reader, &out, latencies);
+        pathfinder->answer_allocations += out.allocations;
+        writer_close(&out);
+        reader_close(&reader);
+        return true;
+    }
+    CommandKind kind;
+    while (reader_next_command(&reader, &kind)) {
+        OutputWriter *sink = &out;
+
+        if (runner != NULL && kind != COMMAND_PLAN_ROUTE && runner->size > 0) {
+            batch_runner_run(runner, &out);
+        }
+        if (kind != COMMAND_ADD_STATION) {
+            engine_flush_run(engine);
+        }
+        if (readers != NULL && kind != COMMAND_PLAN_ROUTE && kind != COMMAND_STATS && kind != COMMAND_UNKNOWN) {
+            sink = reader_pool_sink(readers, &out);
+        }
+
+        if (kind == COMMAND_PLAN_ROUTE && (runner != NULL || readers != NULL)) {
+            reader_next_int(&reader, &arguments.start);
+            reader_next_int(&reader, &arguments.end);
+            if (runner != NULL) {
+                batch_runner_add(runner, arguments.start, arguments.end, &out);
+            } else {
+                reader_pool_submit(readers, arguments.start, arguments.end, &out);
+            }
+
+        } else if (kind == COMMAND_STATS) {
+            if (readers != NULL) {
+                reader_pool_finish(readers, &out);
+            }
+            writer_flush(&out);
+            pathfinder->answer_allocations += out.allocations;
+            out.allocations = 0;
+            pathfinder_report(pathfinder, stderr);
+
+        } else {
+            engine_execute(engine, kind, &reader, &arguments, sink);
+        }
+
+        if (readers != NULL) {
+            reader_pool_drain(readers, &out);
+        }
+        writer_end_command(&out);
+        if (latencies != NULL) {
+            unsigned long long now = latency_now();
+            latency_record(&latencies[kind], now - command_start);
+            command_start = now;
+        }
+    }
+
+    if (runner != NULL) {
+        batch_runner_run(runner, &out);
+    }
+    engine_flush_run(engine);
+    if (readers != NULL) {
+        reader_pool_finish(readers, &out);
+    }
+    if (pathfinder->pipeline != NULL) {
+        pipeline_stop(pathfinder->pipeline, &reader, &out);
+    }
+    pathfinder->answer_allocations += out.allocations;
+    writer_close(&out);
+    reader_close(&reader);
+    return true;
+}
+
+void pathfinder_report(const PathFinder *pathfinder, FILE *stream) {
+    const LatencyHistogram *latencies = pathfinder->latencies;
+
+    stats_report(&pathfinder->engine, pathfinder->runner, pathfinder->readers, pathfinder->pipeline,
+                 pathfinder->shards, latencies, latencies != NULL ? latency_now() - pathfinder->run_start : 0,
+                 pathfinder->answer_allocations + pathfinder->answer.allocations, stream);
+}
+
+void pathfinder_report_latency(const PathFinder *pathfinder, FILE *stream) {
+    if (pathfinder->latencies != NULL) {
+        latency_report(pathfinder->latencies, latency_now() - pathfinder->run_start, stream);
+    }
+}
+
+bool pathfinder_select_kernels(const char *name) {
+    const ScanKernels *kernels = scan_kernels_select(name);
+
+    if (kernels == NULL) {
+        return false;
+    }
+    scan_kernels = kernels;
+    return true;
+}
+
+void pathfinder_benchmark_kernels(FILE *stream) {
+    scan_kernels_benchmark(stream);
+}
+
+// ---------------------------------------------------------------------- Library interface ----------------------------------------------------------------------
+
+// ------------------------------------------------------------------- Functions implementation ------------------------------------------------------------------
+
+/**
+ * @brief Checks whether a byte is whitespace, like isspace in the C locale.
+ */
+static inline bool reader_is_space(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+void pool_init(Pool *pool, size_t object_size) {
+    if (object_size < sizeof(void *)) {
+        object_size = sizeof(void *);
+    }
+    pool->object_size = (object_size + sizeof(void *) - 1) / sizeof(void *) * sizeof(void *);
+    pool->free_list = NULL;
+    pool->slabs = NULL;
+    pool->cursor = pool->limit = NULL;
+    pool->in_use = 0;
+    pool->capacity = 0;
+    pool->slab_count = 0;
+}
+
+void *pool_alloc(Pool *pool) {
+    void *object = pool->free_list;
+
+    if (object != NULL) {
+        pool->free_list = *(void **)object;
+        pool->in_use++;
+        return object;
+    }
+
+    if (pool->cursor == pool->limit) {
+        size_t objects = POOL_SLAB_SIZE / pool->object_size;
+        if (objects == 0) {
+            objects = 1;
+        }
+
+        PoolSlab *slab = (PoolSlab *)malloc(sizeof(PoolSlab) + objects * pool->object_size);
+        if (slab == NULL) {
+            printf("memory allocation error!\n");
+            exit(1);
+        }
+        slab->next = pool->slabs;
+        slab->objects = objects;
+        pool->slabs = slab;
+        pool->cursor = (char *)(slab + 1);
+        pool->limit = pool->cursor + objects * pool->object_size;
+        pool->capacity += objects;
+        pool->slab_count++;
+    }
+
+    object = pool->cursor;
+    pool->cursor += pool->object_size;
+    pool->in_use++;
+    return object;
+}
+
+void pool_free(Pool *pool, void *object) {
+    *(void **)object = pool->free_list;
+    pool->free_list = object;
+    pool->in_use--;
+}
+
+void pool_destroy(Pool *pool) {
+    while (pool->slabs != NULL) {
+        PoolSlab *next = pool->slabs->next;
+        free(pool->slabs);
+        pool->slabs = next;
+    }
+    pool_init(pool, pool->object_size);
+}
+
+void arena_init(Arena *arena) {
+    pool_init(&arena->nodes, sizeof(BPTreeNode));
+    pool_init(&arena->fleets, sizeof(Fleet));
+    pool_init(&arena->versions, sizeof(VersionNode));
+    for (int i = 0; i < FLEET_SIZE_CLASSES; i++) {
+        pool_init(&arena->entries[i], ((size_t)1 << i) * sizeof(FleetEntry));
+    }
+}
+
+void arena_destroy(Arena *arena) {
+    pool_destroy(&arena->nodes);
+    pool_destroy(&arena->fleets);
+    pool_destroy(&arena->versions);
+    for (int i = 0; i < FLEET_SIZE_CLASSES; i++) {
+        pool_destroy(&arena->entries[i]);
+    }
+}
+
+void arena_report(const Arena *arena, FILE *stream) {
+    const Pool *pools[FLEET_SIZE_CLASSES + 3] = {&arena->nodes, &arena->fleets, &arena->versions};
+    char name[32];
+    size_t total = 0;
+
+    for (int i = 0; i < FLEET_SIZE_CLASSES; i++) {
+        pools[i + 3] = &arena->entries[i];
+    }
+
+    fprintf(stream, "%-12s %10s %10s %8s %12s\n", "pool", "in use", "capacity", "slabs", "bytes");
+    for (int i = 0; i < FLEET_SIZE_CLASSES + 3; i++) {
+        const Pool *pool = pools[i];
+        size_t bytes = pool->slab_count * sizeof(PoolSlab) + pool->capacity * pool->object_size;
+
+        if (i == 0) {
+            snprintf(name, sizeof(name), "nodes");
+        } else if (i == 1) {
+            snprintf(name, sizeof(name), "fleets");
+        } else if (i == 2) {
+            snprintf(name, sizeof(name), "versions");
+        } else {
+            snprintf(name, sizeof(name), "entries[%d]", 1 << (i - 3));
+        }
+        fprintf(stream, "%-12s %10zu %10zu %8zu %12zu\n", name, pool->in_use, pool->capacity, pool->slab_count, bytes);
+        total += bytes;
+    }
+    fprintf(stream, "%-12s %10s %10s %8s %12zu\n", "total", "", "", "", total);
+}
+
+int fleet_size_class(int length) {
+    int size_class = 0;
+
+    while ((1 << size_class) < length) {
+        size_class++;
+    }
+    return size_class;
+}
+
+void fleet_resize(Arena *arena, Fleet *fleet, int size_class) {
+    FleetEntry *entries = (FleetEntry *)pool_alloc(&arena->entries[size_class]);
+
+    if (fleet->entries != NULL) {
+        memcpy(entries, fleet->entries, fleet->length * sizeof(FleetEntry));
+        pool_free(&arena->entries[fleet_size_class(fleet->capacity)], fleet->entries);
+    }
+    fleet->entries = entries;
+    fleet->capacity = 1 << size_class;
+}
+
+Fleet *fleet_create(Arena *arena, int size, int *autonomies) {
+    Fleet *fleet = (Fleet *)pool_alloc(&arena->fleets);
+
+    if (size > MAX_CARS) {
+        size = MAX_CARS;
+    }
+    fleet->entries = NULL;
+    fleet->length = 0;
+    fleet->capacity = 0;
+    fleet->size = 0;
+    if (size <= 0) {
+        return fleet;
+    }
+
+    qsort(autonomies, size, sizeof(int), fleet_compare);
+    int length = 1;
+    for (int i = 1; i < size; i++) {
+        if (autonomies[i] != autonomies[i - 1]) {
+            length++;
+        }
+    }
+
+    fleet_resize(arena, fleet, fleet_size_class(length));
+    for (int i = 0; i < size; i++) {
+        if (fleet->length > 0 && fleet->entries[fleet->length - 1].autonomy == autonomies[i]) {
+            fleet->entries[fleet->length - 1].count++;
+        } else {
+            fleet->entries[fleet->length].autonomy = autonomies[i];
+            fleet->entries[fleet->length].count = 1;
+            fleet->length++;
+        }
+    }
+    fleet->size = size;
+    return fleet;
+}
+
+Fleet *fleet_create_entries(Arena *arena, const FleetEntry *entries, int length, int size) {
+    Fleet *fleet = (Fleet *)pool_alloc(&arena->fleets);
+
+    fleet->entries = NULL;
+    fleet->length = 0;
+    fleet->capacity = 0;
+    fleet->size = size;
+    if (length > 0) {
+        fleet_resize(arena, fleet, fleet_size_class(length));
+        memcpy(fleet->entries, entries, length * sizeof(FleetEntry));
+        fleet->length = length;
+    }
+    return fleet;
+}
+
+int fleet_compare(const void *a, const void *b) {
+    int left = *(const int *)a;
+    int right = *(const int *)b;
+
+    return (left > right) - (left < right);
+}
+
+int fleet_lower_bound(const Fleet *fleet, int autonomy) {
+    int low = 0;
+    int high = fleet->length;
+
+    instrument_count(fleet_searches, 1);
+    while (low < high) {
+        int middle = (low + high) / 2;
+        instrument_count(fleet_probes, 1);
+        if (fleet->entries[middle].autonomy < autonomy) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+void fleet_insert(Arena *arena, Fleet *fleet, int autonomy) {
+    if (fleet->size >= MAX_CARS) {
+        return;
+    }
+
+    int index = fleet_lower_bound(fleet, autonomy);
+    if (index < fleet->length && fleet->entries[index].autonomy == autonomy) {
+        fleet->entries[index].count++;
+        fleet->size++;
+        return;
+    }
+
+    if (fleet->length == fleet->capacity) {
+        fleet_resize(arena, fleet, fleet_size_class(fleet->length + 1));
+    }
+    memmove(&fleet->entries[index + 1], &fleet->entries[index], (fleet->length - index) * sizeof(FleetEntry));
+    fleet->entries[index].autonomy = autonomy;
+    fleet->entries[index].count = 1;
+    fleet->length++;
+    fleet->size++;
+}
+
+bool fleet_remove(Arena *arena, Fleet *fleet, int autonomy) {
+    int index = fleet_lower_bound(fleet, autonomy);
+
+    if (index == fleet->length || fleet->entries[index].autonomy != autonomy) {
+        return false;
+    }
+    fleet->size--;
+    if (--fleet->entries[index].count == 0) {
+        memmove(&fleet->entries[index], &fleet->entries[index + 1], (fleet->length - index - 1) * sizeof(FleetEntry));
+        fleet->length--;
+
+        if (fleet->length == 0) {
+            pool_free(&arena->entries[fleet_size_class(fleet->capacity)], fleet->entries);
+            fleet->entries = NULL;
+            fleet->capacity = 0;
+        } else if (fleet->length <= fleet->capacity / 4) {
+            fleet_resize(arena, fleet, fleet_size_class(fleet->capacity / 2));
+        }
+    }
+    return true;
+}
+
+int fleet_get_max(const Fleet *fleet) {
+    if (fleet->length > 0) {
+        return fleet->entries[fleet->length - 1].autonomy;
+    }
+    return 0;
+}
+
+void fleet_destroy(Arena *arena, Fleet *fleet) {
+    if (fleet->entries != NULL) {
+        pool_free(&arena->entries[fleet_size_class(fleet->capacity)], fleet->entries);
+    }
+    pool_free(&arena->fleets, fleet);
+}
+
+BPTreeNode *bptree_create_node(Arena *arena, bool is_leaf) {
+    BPTreeNode *node = (BPTreeNode *)pool_alloc(&arena->nodes);
+
+    node->num_keys = 0;
+    node->size = 0;
+    node->is_leaf = is_leaf;
+    node->prev = node->next = NULL;
+    return node;
+}
+
+int bptree_lower_bound(const BPTreeNode *node, int key) {
+    int low = 0;
+    int high = node->num_keys;
+
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (node->keys[mid] < key) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+int bptree_upper_bound(const BPTreeNode *node, int key) {
+    int low = 0;
+    int high = node->num_keys;
+
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (node->keys[mid] <= key) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+BPTreeNode *bptree_find_leaf(const BPTree *tree, int key) {
+    BPTreeNode *node = tree->root;
+
+    if (node == NULL) {
+        return NULL;
+    }
+    instrument_count(tree_lookups, 1);
+    instrument_count(tree_nodes, 1);
+    while (!node->is_leaf) {
+        node = node->children[bptree_upper_bound(node, key)];
+        instrument_count(tree_nodes, 1);
+    }
+    return node;
+}
+
+bool bptree_find_station(const BPTree *tree, int key, BPTreeNode **leaf, int *slot) {
+    *leaf = bptree_find_leaf(tree, key);
+
+    if (*leaf == NULL) {
+        return false;
+    }
+
+    *slot = bptree_lower_bound(*leaf, key);
+    return *slot < (*leaf)->num_keys && (*leaf)->keys[*slot] == key;
+}
+
+int bptree_rank(const BPTree *tree, int key, bool inclusive) {
+    BPTreeNode *node = tree->root;
+    int rank = 0;
+
+    if (node == NULL) {
+        return 0;
+    }
+    instrument_count(tree_lookups, 1);
+    instrument_count(tree_nodes, 1);
+    while (!node->is_leaf) {
+        int slot = bptree_upper_bound(node, key);
+        for (int i = 0; i < slot; i++) {
+            rank += node->children[i]->size;
+        }
+        node = node->children[slot];
+        instrument_count(tree_nodes, 1);
+    }
+    return rank + (inclusive ? bptree_upper_bound(node, key) : bptree_lower_bound(node, key));
+}
+
+bool bptree_range_view(const BPTree *tree, int low, int high, StationRange *range) {
+    range->size = bptree_rank(tree, high, true) - bptree_rank(tree, low, false);
+    if (range->size == 0) {
+        range->stations = range->autonomies = NULL;
+        return true;
+    }
+
+    BPTreeNode *leaf = bptree_find_leaf(tree, low);
+    int slot = bptree_lower_bound(leaf, low);
+    if (slot + range->size > leaf->num_keys) {
+        return false;
+    }
+
+    range->stations = &leaf->keys[slot];
+    range->autonomies = &leaf->autonomies[slot];
+    return true;
+}
+
+void bptree_range_copy(const BPTree *tree, int low, int count, int *stations, int *autonomies) {
+    BPTreeNode *leaf = bptree_find_leaf(tree, low);
+
+    bptree_leaf_copy(leaf, bptree_lower_bound(leaf, low), count, stations, autonomies);
+}
+
+const BPTreeNode *bptree_select(const BPTree *tree, int rank, int *slot) {
+    const BPTreeNode *node = tree->root;
+
+    while (!node->is_leaf) {
+        int child = 0;
+        while (rank >= node->children[child]->size) {
+            rank -= node->children[child]->size;
+            child++;
+        }
+        node = node->children[child];
+    }
+    *slot = rank;
+    return node;
+}
+
+void bptree_leaf_copy(const BPTreeNode *leaf, int slot, int count, int *stations, int *autonomies) {
+    while (count > 0) {
+        int chunk = leaf->num_keys - slot;
+        if (chunk > count) {
+            chunk = count;
+        }
+        memcpy(stations, &leaf->keys[slot], chunk * sizeof(int));
+        memcpy(autonomies, &leaf->autonomies[slot], chunk * sizeof(int));
+        stations += chunk;
+        autonomies += chunk;
+        count -= chunk;
+
+        leaf = leaf->next;
+        slot = 0;
+    }
+}
+
+ReachSummary reach_summary_empty() {
+    ReachSummary summary = {LLONG_MIN, LLONG_MAX, LLONG_MIN, LLONG_MAX, 0, 0};
+
+    return summary;
+}
+
+void reach_summary_append(ReachSummary *summary, int key, int autonomy) {
+    ReachSummary station = {(long long)key + autonomy, (long long)key - autonomy, LLONG_MIN, LLONG_MAX, key, key};
+
+    *summary = reach_summary_combine(summary, &station);
+}
+
+ReachSummary reach_summary_combine(const ReachSummary *left, const ReachSummary *right) {
+    if (left->max_reach == LLONG_MIN) {
+        return *right;
+    }
+    if (right->max_reach == LLONG_MIN) {
+        return *left;
+    }
+
+    ReachSummary summary;
+    long long right_gap = right->forward_gap != LLONG_MIN ? right->forward_gap : right->first_key;
+    long long left_gap = left->reverse_gap != LLONG_MAX ? left->reverse_gap : left->last_key;
+
+    summary.max_reach = left->max_reach > right->max_reach ? left->max_reach : right->max_reach;
+    summary.min_reach = left->min_reach < right->min_reach ? left->min_reach : right->min_reach;
+    summary.forward_gap = right_gap > left->max_reach ? right_gap : left->forward_gap;
+    summary.reverse_gap = left_gap < right->min_reach ? left_gap : right->reverse_gap;
+    summary.first_key = left->first_key;
+    summary.last_key = right->last_key;
+    return summary;
+}
+
+void bptree_refresh_summary(BPTreeNode *node) {
+    ReachSummary summary = reach_summary_empty();
+
+    if (node->is_leaf) {
+        for (int i = 0; i < node->num_keys; i++) {
+            reach_summary_append(&summary, node->keys[i], node->autonomies[i]);
+        }
+    } else {
+        for (int i = 0; i <= node->num_keys; i++) {
+            summary = reach_summary_combine(&summary, &node->children[i]->summary);
+        }
+    }
+    node->summary = summary;
+}
+
+void bptree_refresh_path(BPTree *tree, int key) {
+    BPTreeNode *path[BPTREE_MAX_HEIGHT];
+    BPTreeNode *node = tree->root;
+    int depth = 0;
+
+    while (!node->is_leaf) {
+        path[depth++] = node;
+        node = node->children[bptree_upper_bound(node, key)];
+    }
+    bptree_refresh_summary(node);
+    while (depth > 0) {
+        bptree_refresh_summary(path[--depth]);
+    }
+}
+
+ReachSummary bptree_summary_between(const BPTreeNode *node, int low, int high, bool above_low, bool below_high) {
+    if (above_low && below_high) {
+        return node->summary;
+    }
+
+    ReachSummary summary = reach_summary_empty();
+    if (node->is_leaf) {
+        int last = below_high ? node->num_keys : bptree_upper_bound(node, high);
+        for (int i = above_low ? 0 : bptree_lower_bound(node, low); i < last; i++) {
+            reach_summary_append(&summary, node->keys[i], node->autonomies[i]);
+        }
+        return summary;
+    }
+
+    int first = above_low ? 0 : bptree_upper_bound(node, low);
+    int last = below_high ? node->num_keys : bptree_upper_bound(node, high);
+    for (int i = first; i <= last; i++) {
+        ReachSummary child = bptree_summary_between(node->children[i], low, high, above_low || i > first,
+                                                    below_high || i < last);
+        summary = reach_summary_combine(&summary, &child);
+    }
+    return summary;
+}
+
+bool bptree_has_gap(const BPTree *tree, int start, int end) {
+    if (tree->root == NULL || start == end) {
+        return false;
+    }
+
+    int low = start < end ? start : end;
+    int high = start < end ? end : start;
+    ReachSummary summary = bptree_summary_between(tree->root, low, high, false, false);
+    if (start < end) {
+        return summary.forward_gap != LLONG_MIN;
+    }
+    return summary.reverse_gap != LLONG_MAX;
+}
+
+BPTreeNode *bptree_split_node(Arena *arena, BPTreeNode *node, int *separator) {
+    BPTreeNode *sibling = bptree_create_node(arena, node->is_leaf);
+    int half = node->num_keys / 2;
+
+    if (node->is_leaf) {
+        sibling->num_keys = node->num_keys - half;
+        sibling->size = sibling->num_keys;
+        memcpy(sibling->keys, &node->keys[half], sibling->num_keys * sizeof(int));
+        memcpy(sibling->autonomies, &node->autonomies[half], sibling->num_keys * sizeof(int));
+        memcpy(sibling->cars, &node->cars[half], sibling->num_keys * sizeof(Fleet *));
+        *separator = sibling->keys[0];
+
+        sibling->next = node->next;
+        if (sibling->next != NULL) {
+            sibling->next->prev = sibling;
+        }
+        sibling->prev = node;
+        node->next = sibling;
+    } else {
+        sibling->num_keys = node->num_keys - half - 1;
+        memcpy(sibling->keys, &node->keys[half + 1], sibling->num_keys * sizeof(int));
+        memcpy(sibling->children, &node->children[half + 1], (sibling->num_keys + 1) * sizeof(BPTreeNode *));
+        *separator = node->keys[half];
+        for (int i = 0; i <= sibling->num_keys; i++) {
+            sibling->size += sibling->children[i]->size;
+        }
+    }
+    node->size -= sibling->size;
+    node->num_keys = half;
+    return sibling;
+}
+
+bool bptree_insert(BPTree *tree, int key, Fleet *cars) {
+    BPTreeNode *path[BPTREE_MAX_HEIGHT];
+    int slots[BPTREE_MAX_HEIGHT];
+    int depth = 0;
+
+    if (tree->root == NULL) {
+        tree->root = bptree_create_node(tree->arena, true);
+        tree->root->keys[0] = key;
+        tree->root->autonomies[0] = fleet_get_max(cars);
+        tree->root->cars[0] = cars;
+        tree->root->num_keys = tree->root->size = 1;
+        tree->size = 1;
+        bptree_refresh_summary(tree->root);
+        return true;
+    }
+
+    BPTreeNode *node = tree->root;
+    while (!node->is_leaf) {
+        path[depth] = node;
+        slots[depth] = bptree_upper_bound(node, key);
+        node = node->children[slots[depth]];
+        depth++;
+    }
+    instrument_count(tree_lookups, 1);
+    instrument_count(tree_nodes, depth + 1);
+
+    int slot = bptree_lower_bound(node, key);
+    if (slot < node->num_keys && node->keys[slot] == key) {
+        return false;
+    }
+
+    memmove(&node->keys[slot + 1], &node->keys[slot], (node->num_keys - slot) * sizeof(int));
+    memmove(&node->autonomies[slot + 1], &node->autonomies[slot], (node->num_keys - slot) * sizeof(int));
+    memmove(&node->cars[slot + 1], &node->cars[slot], (node->num_keys - slot) * sizeof(Fleet *));
+    node->keys[slot] = key;
+    node->autonomies[slot] = fleet_get_max(cars);
+    node->cars[slot] = cars;
+    node->num_keys++;
+    node->size++;
+    for (int i = 0; i < depth; i++) {
+        path[i]->size++;
+    }
+    tree->size++;
+
+    while (node->num_keys > BPTREE_MAX_KEYS) {
+        int separator;
+        BPTreeNode *sibling = bptree_split_node(tree->arena, node, &separator);
+        bptree_refresh_summary(node);
+        bptree_refresh_summary(sibling);
+
+        if (depth == 0) {
+            BPTreeNode *root = bptree_create_node(tree->arena, false);
+            root->keys[0] = separator;
+            root->children[0] = node;
+            root->children[1] = sibling;
+            root->num_keys = 1;
+            root->size = node->size + sibling->size;
+            bptree_refresh_summary(root);
+            tree->root = root;
+            return true;
+        }
+
+        depth--;
+        BPTreeNode *parent = path[depth];
+        slot = slots[depth];
+        memmove(&parent->keys[slot + 1], &parent->keys[slot], (parent->num_keys - slot) * sizeof(int));
+        memmove(&parent->children[slot + 2], &parent->children[slot + 1], (parent->num_keys - slot) * sizeof(BPTreeNode *));
+        parent->keys[slot] = separator;
+        parent->children[slot + 1] = sibling;
+        parent->num_keys++;
+        node = parent;
+    }
+
+    bptree_refresh_summary(node);
+    while (depth > 0) {
+        bptree_refresh_summary(path[--depth]);
+    }
+    return true;
+}
+
+void bptree_borrow_from_left(BPTreeNode *parent, int slot) {
+    BPTreeNode *left = parent->children[slot - 1];
+    BPTreeNode *node = parent->children[slot];
+
+    memmove(&node->keys[1], &node->keys[0], node->num_keys * sizeof(int));
+    if (node->is_leaf) {
+        memmove(&node->autonomies[1], &node->autonomies[0], node->num_keys * sizeof(int));
+        memmove(&node->cars[1], &node->cars[0], node->num_keys * sizeof(Fleet *));
+        node->keys[0] = left->keys[left->num_keys - 1];
+        node->autonomies[0] = left->autonomies[left->num_keys - 1];
+        node->cars[0] = left->cars[left->num_keys - 1];
+        parent->keys[slot - 1] = node->keys[0];
+        left->size--;
+        node->size++;
+    } else {
+        memmove(&node->children[1], &node->children[0], (node->num_keys + 1) * sizeof(BPTreeNode *));
+        node->keys[0] = parent->keys[slot - 1];
+        node->children[0] = left->children[left->num_keys];
+        parent->keys[slot - 1] = left->keys[left->num_keys - 1];
+        left->size -= node->children[0]->size;
+        node->size += node->children[0]->size;
+    }
+    left->num_keys--;
+    node->num_keys++;
+}
+
+void bptree_borrow_from_right(BPTreeNode *parent, int slot) {
+    BPTreeNode *node = parent->children[slot];
+    BPTreeNode *right = parent->children[slot + 1];
+
+    if (node->is_leaf) {
+        node->keys[node->num_keys] = right->keys[0];
+        node->autonomies[node->num_keys] = right->autonomies[0];
+        node->cars[node->num_keys] = right->cars[0];
+        memmove(&right->keys[0], &right->keys[1], (right->num_keys - 1) * sizeof(int));
+        memmove(&right->autonomies[0], &right->autonomies[1], (right->num_keys - 1) * sizeof(int));
+        memmove(&right->cars[0], &right->cars[1], (right->num_keys - 1) * sizeof(Fleet *));
+        parent->keys[slot] = right->keys[0];
+        right->size--;
+        node->size++;
+    } else {
+        node->keys[node->num_keys] = parent->keys[slot];
+        node->children[node->num_keys + 1] = right->children[0];
+        parent->keys[slot] = right->keys[0];
+        right->size -= right->children[0]->size;
+        node->size += right->children[0]->size;
+        memmove(&right->keys[0], &right->keys[1], (right->num_keys - 1) * sizeof(int));
+        memmove(&right->children[0], &right->children[1], right->num_keys * sizeof(BPTreeNode *));
+    }
+    right->num_keys--;
+    node->num_keys++;
+}
+
+void bptree_merge_children(Arena *arena, BPTreeNode *parent, int slot) {
+    BPTreeNode *left = parent->children[slot];
+    BPTreeNode *right = parent->children[slot + 1];
+
+    if (left->is_leaf) {
+        memcpy(&left->keys[left->num_keys], right->keys, right->num_keys * sizeof(int));
+        memcpy(&left->autonomies[left->num_keys], right->autonomies, right->num_keys * sizeof(int));
+        memcpy(&left->cars[left->num_keys], right->cars, right->num_keys * sizeof(Fleet *));
+        left->num_keys += right->num_keys;
+
+        left->next = right->next;
+        if (left->next != NULL) {
+            left->next->prev = left;
+        }
+    } else {
+        left->keys[left->num_keys] = parent->keys[slot];
+        memcpy(&left->keys[left->num_keys + 1], right->keys, right->num_keys * sizeof(int));
+        memcpy(&left->children[left->num_keys + 1], right->children, (right->num_keys + 1) * sizeof(BPTreeNode *));
+        left->num_keys += right->num_keys + 1;
+    }
+    left->size += right->size;
+    pool_free(&arena->nodes, right);
+
+    memmove(&parent->keys[slot], &parent->keys[slot + 1], (parent->num_keys - slot - 1) * sizeof(int));
+    memmove(&parent->children[slot + 1], &parent->children[slot + 2], (parent->num_keys - slot - 1) * sizeof(BPTreeNode *));
+    parent->num_keys--;
+}
+
+bool bptree_fix_underflow(Arena *arena, BPTreeNode *parent, int slot) {
+    BPTreeNode *left = slot > 0 ? parent->children[slot - 1] : NULL;
+    BPTreeNode *right = slot < parent->num_keys ? parent->children[slot + 1] : NULL;
+
+    if (left != NULL && left->num_keys > BPTREE_MIN_KEYS) {
+        bptree_borrow_from_left(parent, slot);
+        bptree_refresh_summary(left);
+        bptree_refresh_summary(parent->children[slot]);
+        return false;
+    }
+    if (right != NULL && right->num_keys > BPTREE_MIN_KEYS) {
+        bptree_borrow_from_right(parent, slot);
+        bptree_refresh_summary(parent->children[slot]);
+        bptree_refresh_summary(right);
+        return false;
+    }
+
+    if (left != NULL) {
+        bptree_merge_children(arena, parent, slot - 1);
+        bptree_refresh_summary(left);
+    } else {
+        bptree_merge_children(arena, parent, slot);
+        bptree_refresh_summary(parent->children[slot]);
+    }
+    return true;
+}
+
+bool bptree_remove(BPTree *tree, int key) {
+    BPTreeNode *path[BPTREE_MAX_HEIGHT];
+    int slots[BPTREE_MAX_HEIGHT];
+    int depth = 0;
+
+    if (tree->root == NULL) {
+        return false;
+    }
+
+    BPTreeNode *node = tree->root;
+    while (!node->is_leaf) {
+        path[depth] = node;
+        slots[depth] = bptree_upper_bound(node, key);
+        node = node->children[slots[depth]];
+        depth++;
+    }
+    instrument_count(tree_lookups, 1);
+    instrument_count(tree_nodes, depth + 1);
+
+    int slot = bptree_lower_bound(node, key);
+    if (slot == node->num_keys || node->keys[slot] != key) {
+        return false;
+    }
+
+    fleet_destroy(tree->arena, node->cars[slot]);
+    memmove(&node->keys[slot], &node->keys[slot + 1], (node->num_keys - slot - 1) * sizeof(int));
+    memmove(&node->autonomies[slot], &node->autonomies[slot + 1], (node->num_keys - slot - 1) * sizeof(int));
+    memmove(&node->cars[slot], &node->cars[slot + 1], (node->num_keys - slot - 1) * sizeof(Fleet *));
+    node->num_keys--;
+    node->size--;
+    for (int i = 0; i < depth; i++) {
+        path[i]->size--;
+    }
+    tree->size--;
+
+    int refresh_from = depth - 1;
+    bptree_refresh_summary(node);
+    while (depth > 0 && node->num_keys < BPTREE_MIN_KEYS) {
+        depth--;
+        refresh_from = depth;
+        if (!bptree_fix_underflow(tree->arena, path[depth], slots[depth])) {
+            break;
+        }
+        node = path[depth];
+    }
+    for (int i = refresh_from; i >= 0; i--) {
+        bptree_refresh_summary(path[i]);
+    }
+
+    if (tree->root->num_keys == 0) {
+        BPTreeNode *old_root = tree->root;
+        tree->root = old_root->is_leaf ? NULL : old_root->children[0];
+        pool_free(&tree->arena->nodes, old_root);
+    }
+    return true;
+}
+
+bool bptree_add_car(BPTree *tree, int key, int autonomy, bool *changed) {
+    BPTreeNode *leaf;
+    int slot;
+
+    if (!bptree_find_station(tree, key, &leaf, &slot)) {
+        *changed = false;
+        return false;
+    }
+    int previous = leaf->autonomies[slot];
+    fleet_insert(tree->arena, leaf->cars[slot], autonomy);
+    leaf->autonomies[slot] = fleet_get_max(leaf->cars[slot]);
+    *changed = leaf->autonomies[slot] != previous;
+    if (*changed) {
+        bptree_refresh_path(tree, key);
+    }
+    return true;
+}
+
+bool bptree_remove_car(BPTree *tree, int key, int autonomy, bool *changed) {
+    BPTreeNode *leaf;
+    int slot;
+
+    *changed = false;
+    if (!bptree_find_station(tree, key, &leaf, &slot) || !fleet_remove(tree->arena, leaf->cars[slot], autonomy)) {
+        return false;
+    }
+    int previous = leaf->autonomies[slot];
+    leaf->autonomies[slot] = fleet_get_max(leaf->cars[slot]);
+    *changed = leaf->autonomies[slot] != previous;
+    if (*changed) {
+        bptree_refresh_path(tree, key);
+    }
+    return true;
+}
+
+void workspace_init(Workspace *workspace) {
+    workspace->stations = NULL;
+    workspace->autonomies = NULL;
+    workspace->predecessors = NULL;
+    workspace->frontier = NULL;
+    workspace->visited = NULL;
+    workspace->cars = NULL;
+    workspace->capacity = 0;
+    workspace->search_capacity = 0;
+    workspace->car_capacity = 0;
+    workspace->allocations = 0;
+    workspace->queries = 0;
+}
+
+void workspace_destroy(Workspace *workspace) {
+    free(workspace->stations);
+    free(workspace->autonomies);
+    free(workspace->predecessors);
+    free(workspace->frontier);
+    free(workspace->visited);
+    free(workspace->cars);
+    workspace_init(workspace);
+}
+
+void workspace_reserve(Workspace *workspace, int size) {
+    if (size <= workspace->capacity) {
+        return;
+    }
+
+    int capacity = workspace->capacity * 2;
+    if (capacity < size) {
+        capacity = size;
+    }
+    workspace->stations = (int *)realloc(workspace->stations, capacity * sizeof(int));
+    workspace->autonomies = (int *)realloc(workspace->autonomies, capacity * sizeof(int));
+    workspace->predecessors = (int *)realloc(workspace->predecessors, capacity * sizeof(int));
+    if (workspace->stations == NULL || workspace->autonomies == NULL || workspace->predecessors == NULL) {
+        printf("memory allocation error!\n");
+        exit(1);
+    }
+    workspace->capacity = capacity;
+    workspace->allocations += 3;
+}
+
+void workspace_reserve_search(Workspace *workspace, int size) {
+    if (size <= workspace->search_capacity) {
+        return;
+    }
+
+    int capacity = workspace->search_capacity * 2;
+    if (capacity < size) {
+        capacity = size;
+    }
+    workspace->frontier = (int *)realloc(workspace->frontier, capacity * sizeof(int));
+    workspace->visited = (bool *)realloc(workspace->visited, capacity * sizeof(bool));
+    if (workspace->frontier == NULL || workspace->visited == NULL) {
+        printf("memory allocation error!\n");
+        exit(1);
+    }
+    workspace->search_capacity = capacity;
+    workspace->allocations += 2;
+}
+
+int *workspace_reserve_cars(Workspace *workspace, int size) {
+    if (size > workspace->car_capacity) {
+        int capacity = workspace->car_capacity * 2;
+        if (capacity < size) {
+            capacity = size;
+        }
+
+        workspace->cars = (int *)realloc(workspace->cars, capacity * sizeof(int));
+        if (workspace->cars == NULL) {
+            printf("memory allocation error!\n");
+            exit(1);
+        }
+        workspace->car_capacity = capacity;
+        workspace->allocations++;
+    }
+    return workspace->cars;
+}
+
+void mutation_log_record(MutationLog *log, int key) {
+    log->keys[log->version % MUTATION_LOG_SIZE] = key;
+    log->version++;
+}
+
+bool mutation_log_touches(const MutationLog *log, unsigned long long version, int low, int high) {
+    if (log->version - version > MUTATION_LOG_SIZE) {
+        return true;
+    }
+    for (unsigned long long i = version; i < log->version; i++) {
+        int key = log->keys[i % MUTATION_LOG_SIZE];
+        if (key >= low && key <= high) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void mutation_log_record_all(MutationLog *log) {
+    log->version += MUTATION_LOG_SIZE + 1;
+}
+
+void route_cache_init(RouteCache *cache, int capacity) {
+    cache->entries = NULL;
+    cache->buckets = NULL;
+    cache->capacity = capacity > 0 ? capacity : 0;
+    cache->size = 0;
+    cache->bucket_mask = 0;
+    cache->lru_head = cache->lru_tail = -1;
+    cache->hits = cache->misses = cache->invalidations = 0;
+    cache->format = OUTPUT_TEXT;
+    cache->allocations = 0;
+    for (int i = 0; i < ROUTE_CACHE_TEXT_CLASSES; i++) {
+        pool_init(&cache->texts[i], (size_t)ROUTE_CACHE_MIN_TEXT << i);
+    }
+    if (cache->capacity == 0) {
+        return;
+    }
+
+    unsigned int buckets = 1;
+    while (buckets < 2u * cache->capacity) {
+        buckets *= 2;
+    }
+    cache->entries = (RouteCacheEntry *)malloc(cache->capacity * sizeof(RouteCacheEntry));
+    cache->buckets = (int *)malloc(buckets * sizeof(int));
+    if (cache->entries == NULL || cache->buckets == NULL) {
+        printf("memory allocation error!\n");
+        exit(1);
+    }
+    cache->bucket_mask = buckets - 1;
+    for (unsigned int i = 0; i < buckets; i++) {
+        cache->buckets[i] = -1;
+    }
+}
+
+void route_cache_destroy(RouteCache *cache) {
+    for (int i = 0; i < ROUTE_CACHE_TEXT_CLASSES; i++) {
+        pool_destroy(&cache->texts[i]);
+    }
+    free(cache->entries);
+    free(cache->buckets);
+    route_cache_init(cache, 0);
+}
+
+void route_cache_set_format(RouteCache *cache, OutputFormat format) {
+    size_t hits = cache->hits, misses = cache->misses, invalidations = cache->invalidations;
+    size_t allocations = cache->allocations;
+
+    if (cache->format == format) {
+        return;
+    }
+    int capacity = cache->capacity;
+    route_cache_destroy(cache);
+    route_cache_init(cache, capacity);
+    cache->hits = hits;
+    cache->misses = misses;
+    cache->invalidations = invalidations;
+    cache->allocations = allocations;
+    cache->format = format;
+}
+
+int route_cache_text_class(size_t length) {
+    int text_class = 0;
+
+    while (((size_t)ROUTE_CACHE_MIN_TEXT << text_class) < length) {
+        text_class++;
+    }
+    return text_class;
+}
+
+unsigned int route_cache_bucket(const RouteCache *cache, int start, int end) {
+    unsigned long long hash = ((unsigned long long)(unsigned int)start << 32) | (unsigned int)end;
+
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return (unsigned int)hash & cache->bucket_mask;
+}
+
+int route_cache_find(const RouteCache *cache, int start, int end) {
+    if (cache->capacity == 0) {
+        return -1;
+    }
+
+    int index = cache->buckets[route_cache_bucket(cache, start, end)];
+    while (index != -1 && (cache->entries[index].start != start || cache->entries[index].end != end)) {
+        index = cache->entries[index].bucket_next;
+    }
+    return index;
+}
+
+void route_cache_lru_unlink(RouteCache *cache, int index) {
+    RouteCacheEntry *entry = &cache->entries[index];
+
+    if (entry->lru_prev != -1) {
+        cache->entries[entry->lru_prev].lru_next = entry->lru_next;
+    } else {
+        cache->lru_head = entry->lru_next;
+    }
+    if (entry->lru_next != -1) {
+        cache->entries[entry->lru_next].lru_prev = entry->lru_prev;
+    } else {
+        cache->lru_tail = entry->lru_prev;
+    }
+}
+
+void route_cache_touch(RouteCache *cache, int index) {
+    RouteCacheEntry *entry = &cache->entries[index];
+
+    if (cache->lru_head == index) {
+        return;
+    }
+    route_cache_lru_unlink(cache, index);
+    entry->lru_prev = -1;
+    entry->lru_next = cache->lru_head;
+    if (cache->lru_head != -1) {
+        cache->entries[cache->lru_head].lru_prev = index;
+    }
+    cache->lru_head = index;
+    if (cache->lru_tail == -1) {
+        cache->lru_tail = index;
+    }
+}
+
+void route_cache_store(RouteCache *cache, int start, int end, unsigned long long version, const char *text, size_t length) {
+    if (cache->capacity == 0 || length > ROUTE_CACHE_MAX_TEXT) {
+        return;
+    }
+
+    int index = route_cache_find(cache, start, end);
+    RouteCacheEntry *entry;
+
+    if (index == -1) {
+        if (cache->size < cache->capacity) {
+            index = cache->size++;
+            entry = &cache->entries[index];
+            entry->text = NULL;
+        } else {
+            index = cache->lru_tail;
+            entry = &cache->entries[index];
+            route_cache_lru_unlink(cache, index);
+
+            int *link = &cache->buckets[route_cache_bucket(cache, entry->start, entry->end)];
+            while (*link != index) {
+                link = &cache->entries[*link].bucket_next;
+            }
+            *link = entry->bucket_next;
+        }
+
+        unsigned int bucket = route_cache_bucket(cache, start, end);
+        entry->start = start;
+        entry->end = end;
+        entry->bucket_next = cache->buckets[bucket];
+        cache->buckets[bucket] = index;
+
+        entry->lru_prev = -1;
+        entry->lru_next = cache->lru_head;
+        if (cache->lru_head != -1) {
+            cache->entries[cache->lru_head].lru_prev = index;
+        }
+        cache->lru_head = index;
+        if (cache->lru_tail == -1) {
+            cache->lru_tail = index;
+        }
+    } else {
+        entry = &cache->entries[index];
+        route_cache_touch(cache, index);
+    }
+
+    int text_class = route_cache_text_class(length);
+    if (entry->text == NULL || entry->text_class != text_class) {
+        Pool *pool = &cache->texts[text_class];
+        size_t slabs = pool->slab_count;
+
+        if (entry->text != NULL) {
+            pool_free(&cache->texts[entry->text_class], entry->text);
+        }
+        entry->text = (char *)pool_alloc(pool);
+        entry->text_class = text_class;
+        cache->allocations += pool->slab_count - slabs;
+    }
+    memcpy(entry->text, text, length);
+    entry->length = length;
+    entry->version = version;
+}
+
+void engine_init(Engine *engine, PlannerKind planner, int cache_capacity) {
+    arena_init(&engine->arena);
+    engine->tree.root = NULL;
+    engine->tree.size = 0;
+    engine->tree.arena = &engine->arena;
+    workspace_init(&engine->workspace);
+    engine->log.version = 0;
+    route_cache_init(&engine->cache, cache_capacity);
+    jump_tables_init(&engine->jumps);
+    version_index_init(&engine->versions, &engine->arena.versions);
+    engine->run.keys = NULL;
+    engine->run.fleets = NULL;
+    engine->run.count = engine->run.capacity = 0;
+    engine->run.builds = engine->run.stations = 0;
+    engine->planner = planner;
+    engine->layers = NULL;
+    engine->gap_rejections = 0;
+}
+
+void engine_destroy(Engine *engine) {
+    arena_destroy(&engine->arena);
+    engine->tree.root = NULL;
+    engine->tree.size = 0;
+    workspace_destroy(&engine->workspace);
+    route_cache_destroy(&engine->cache);
+    jump_tables_destroy(&engine->jumps);
+    free(engine->run.keys);
+    free(engine->run.fleets);
+}
+
+bool engine_add_station(Engine *engine, int key, int size, int *autonomies) {
+    Fleet *fleet = fleet_create(&engine->arena, size, autonomies);
+    StationRun *run = &engine->run;
+
+    if (run->count > 0 ? key > run->keys[run->count - 1] : key > bptree_max_key(&engine->tree)) {
+        if (run->count == run->capacity) {
+            run->capacity = run->capacity > 0 ? 2 * run->capacity : 1024;
+            run->keys = (int *)realloc(run->keys, run->capacity * sizeof(int));
+            run->fleets = (Fleet **)realloc(run->fleets, run->capacity * sizeof(Fleet *));
+            if (run->keys == NULL || run->fleets == NULL) {
+                printf("memory allocation error!\n");
+                exit(1);
+            }
+        }
+        run->keys[run->count] = key;
+        run->fleets[run->count] = fleet;
+        run->count++;
+        return true;
+    }
+
+    engine_flush_run(engine);
+    if (bptree_insert(&engine->tree, key, fleet)) {
+        mutation_log_record(&engine->log, key);
+        if (engine->versions.enabled) {
+            version_index_insert(&engine->versions, key, fleet_get_max(fleet));
+        }
+        return true;
+    }
+    fleet_destroy(&engine->arena, fleet);
+    return false;
+}
+
+void engine_flush_run(Engine *engine) {
+    StationRun *run = &engine->run;
+    BPTree *tree = &engine->tree;
+
+    if (run->count == 0) {
+        return;
+    }
+
+    if (run->count >= tree->size) {
+        int existing = tree->size;
+        int total = existing + run->count;
+
+        if (total > run->capacity) {
+            run->keys = (int *)realloc(run->keys, total * sizeof(int));
+            run->fleets = (Fleet **)realloc(run->fleets, total * sizeof(Fleet *));
+            if (run->keys == NULL || run->fleets == NULL) {
+                printf("memory allocation error!\n");
+                exit(1);
+            }
+            run->capacity = total;
+        }
+        memmove(run->keys + existing, run->keys, run->count * sizeof(int));
+        memmove(run->fleets + existing, run->fleets, run->count * sizeof(Fleet *));
+        bptree_detach(tree, run->keys, run->fleets);
+        bptree_build(tree, run->keys, run->fleets, total);
+        for (int i = existing; i < total; i++) {
+            mutation_log_record(&engine->log, run->keys[i]);
+        }
+        if (engine->versions.enabled) {
+            version_index_build(&engine->versions, tree);
+        }
+        run->builds++;
+        run->stations += run->count;
+    } else {
+        for (int i = 0; i < run->count; i++) {
+            bptree_insert(tree, run->keys[i], run->fleets[i]);
+            mutation_log_record(&engine->log, run->keys[i]);
+            if (engine->versions.enabled) {
+                version_index_insert(&engine->versions, run->keys[i], fleet_get_max(run->fleets[i]));
+            }
+        }
+    }
+    run->count = 0;
+
+    if (run->capacity > STATION_RUN_RETAINED) {
+        free(run->keys);
+        free(run->fleets);
+        run->keys = NULL;
+        run->fleets = NULL;
+        run->capacity = 0;
+    }
+}
+
+bool engine_remove_station(Engine *engine, int key) {
+    if (bptree_remove(&engine->tree, key)) {
+        mutation_log_record(&engine->log, key);
+        if (engine->versions.enabled) {
+            version_index_remove(&engine->versions, key);
+        }
+        return true;
+    }
+    return false;
+}
+
+bool engine_add_car(Engine *engine, int key, int autonomy) {
+    bool changed;
+
+    if (!bptree_add_car(&engine->tree, key, autonomy, &changed)) {
+        return false;
+    }
+    if (changed) {
+        mutation_log_record(&engine->log, key);
+        engine_publish_autonomy(engine, key);
+    }
+    return true;
+}
+
+bool engine_remove_car(Engine *engine, int key, int autonomy) {
+    bool changed;
+
+    if (!bptree_remove_car(&engine->tree, key, autonomy, &changed)) {
+        return false;
+    }
+    if (changed) {
+        mutation_log_record(&engine->log, key);
+        engine_publish_autonomy(engine, key);
+    }
+    return true;
+}
+
+void engine_publish_autonomy(Engine *engine, int key) {
+    BPTreeNode *leaf;
+    int slot;
+
+    if (engine->versions.enabled && bptree_find_station(&engine->tree, key, &leaf, &slot)) {
+        version_index_update(&engine->versions, key, leaf->autonomies[slot]);
+    }
+}
+
+void engine_plan_route(Engine *engine, int start, int end, OutputWriter *out) {
+    Workspace *workspace = &engine->workspace;
+    RouteCache *cache = &engine->cache;
+
+    if (start == end) {
+        writer_write_station_route(out, start);
+        return;
+    }
+
+    int low = start < end ? start : end;
+    int high = start < end ? end : start;
+    StationRange range;
+
+    if (cache->capacity > 0) {
+        int index = route_cache_find(cache, start, end);
+        if (index != -1) {
+            RouteCacheEntry *entry = &cache->entries[index];
+            if (!mutation_log_touches(&engine->log, entry->version, low, high)) {
+                entry->version = engine->log.version;
+                route_cache_touch(cache, index);
+                writer_write(out, entry->text, entry->length);
+                cache->hits++;
+                return;
+            }
+            cache->invalidations++;
+        }
+        cache->misses++;
+    }
+    size_t answer_start = out->length;
+
+    if (engine->planner == PLANNER_JUMP && engine_jump_tables_ready(engine, low, high)) {
+        jump_plan(&engine->jumps, start, end, workspace, out);
+        engine->jumps.queries++;
+    } else if (engine->planner != PLANNER_BFS && bptree_has_gap(&engine->tree, start, end)) {
+        writer_write_no_route(out);
+        engine->gap_rejections++;
+    } else {
+        engine_extract_range(engine, low, high, &range);
+        if (engine->layers != NULL && engine->planner != PLANNER_BFS && range.size >= engine->layers->threshold) {
+            layer_pool_plan(engine->layers, &range, start, end, workspace->predecessors, out);
+        } else {
+            path_plan(&range, start, end, engine->planner, workspace, out);
+        }
+    }
+    workspace->queries++;
+
+    route_cache_store(cache, start, end, engine->log.version, out->buffer + answer_start, out->length - answer_start);
+}
+
+void engine_plan_routes(Engine *engine, int start, const int *targets, int count, OutputWriter *out) {
+    Workspace *workspace = &engine->workspace;
+    int low = start;
+    int high = start;
+    StationRange range;
+
+    for (int i = 0; i < count; i++) {
+        low = targets[i] < low ? targets[i] : low;
+        high = targets[i] > high ? targets[i] : high;
+    }
+
+    engine_extract_range(engine, low, high, &range);
+
+    int source = path_find_station(&range, start);
+    bool planned = engine->planner != PLANNER_BFS && source != -1;
+    for (int i = 0; planned && i < count; i++) {
+        planned = path_find_station(&range, targets[i]) != -1;
+    }
+    if (!planned) {
+        for (int i = 0; i < count; i++) {
+            engine_plan_route(engine, start, targets[i], out);
+        }
+        return;
+    }
+
+    StationRange forward = {range.stations + source, range.autonomies + source, range.size - source};
+    StationRange reverse = {range.stations, range.autonomies, source + 1};
+    int *predecessors = workspace->predecessors;
+    LayerPool *layers = engine->layers != NULL && range.size >= engine->layers->threshold ? engine->layers : NULL;
+    int forward_extent = 0;
+    int reverse_extent = source;
+    if (high > start) {
+        forward_extent = layers != NULL ? layer_pool_forward_extent(layers, &forward, predecessors + source)
+                                        : path_plan_forward_extent(&forward, predecessors + source);
+    }
+    if (low < start) {
+        reverse_extent = layers != NULL ? layer_pool_reverse_extent(layers, &reverse, predecessors)
+                                        : path_plan_reverse_extent(&reverse, predecessors);
+    }
+    instrument_range(range.size);
+
+    for (int i = 0; i < count; i++) {
+        int target = path_find_station(&range, targets[i]);
+        size_t answer_start = out->length;
+
+        if (target == source) {
+            writer_write_station_route(out, start);
+        } else if (target > source && target - source <= forward_extent) {
+            path_print_route(forward.stations, predecessors + source, 0, target - source, out);
+        } else if (target < source && target >= reverse_extent) {
+            path_print_route(reverse.stations, predecessors, source, target, out);
+        } else {
+            writer_write_no_route(out);
+        }
+        route_cache_store(&engine->cache, start, targets[i], engine->log.version, out->buffer + answer_start,
+                          out->length - answer_start);
+    }
+    workspace->queries += count;
+}
+
+void engine_execute(Engine *engine, CommandKind kind, InputReader *reader, CommandArguments *arguments,
+                    OutputWriter *out) {
+    if (kind == COMMAND_ADD_STATION) {
+        reader_next_int(reader, &arguments->key);
+        reader_next_int(reader, &arguments->fleet_size);
+
+        int *elements = workspace_reserve_cars(&engine->workspace, arguments->fleet_size);
+        for (int i = 0; i < arguments->fleet_size; i++) {
+            reader_next_int(reader, &arguments->element);
+            elements[i] = arguments->element;
+        }
+        writer_write_outcome(out, engine_add_station(engine, arguments->key, arguments->fleet_size, elements),
+                             "aggiunta\n", "non aggiunta\n");
+
+    } else if (kind == COMMAND_REMOVE_STATION) {
+        reader_next_int(reader, &arguments->key);
+
+        writer_write_outcome(out, engine_remove_station(engine, arguments->key), "demolita\n", "non demolita\n");
+
+    } else if (kind == COMMAND_ADD_CAR) {
+        reader_next_int(reader, &arguments->key);
+        reader_next_int(reader, &arguments->element);
+
+        writer_write_outcome(out, engine_add_car(engine, arguments->key, arguments->element), "aggiunta\n",
+                             "non aggiunta\n");
+
+    } else if (kind == COMMAND_REMOVE_CAR) {
+        reader_next_int(reader, &arguments->key);
+        reader_next_int(reader, &arguments->element);
+
+        writer_write_outcome(out, engine_remove_car(engine, arguments->key, arguments->element), "rottamata\n",
+                             "non rottamata\n");
+
+    } else if (kind == COMMAND_PLAN_ROUTE) {
+        reader_next_int(reader, &arguments->start);
+        reader_next_int(reader, &arguments->end);
+
+        engine_plan_route(engine, arguments->start, arguments->end, out);
+
+    } else if (kind == COMMAND_PLAN_ROUTES) {
+        reader_next_int(reader, &arguments->start);
+        reader_next_int(reader, &arguments->count);
+
+        int *targets = workspace_reserve_cars(&engine->workspace, arguments->count);
+        for (int i = 0; i < arguments->count; i++) {
+            reader_next_int(reader, &arguments->element);
+            targets[i] = arguments->element;
+        }
+        engine_plan_routes(engine, arguments->start, targets, arguments->count, out);
+
+    } else if (kind == COMMAND_SAVE || kind == COMMAND_LOAD) {
+        char path[PATH_MAX];
+        const char *token;
+        int length;
+
+        path[0] = '\0';
+        if (reader_next_token(reader, &token, &length) && length < PATH_MAX) {
+            memcpy(path, token, length);
+            path[length] = '\0';
+        }
+        if (kind == COMMAND_SAVE) {
+            writer_write_outcome(out, path[0] != '\0' && engine_save(engine, path), "salvato\n", "non salvato\n");
+        } else {
+            writer_write_outcome(out, path[0] != '\0' && engine_load(engine, path), "caricato\n", "non caricato\n");
+        }
+    }
+}
+
+void engine_extract_range(Engine *engine, int low, int high, StationRange *range) {
+    Workspace *workspace = &engine->workspace;
+    LayerPool *layers = engine->layers;
+
+    bool in_leaf = bptree_range_view(&engine->tree, low, high, range);
+    workspace_reserve(workspace, range->size);
+    if (in_leaf) {
+        return;
+    }
+
+    if (layers != NULL && range->size >= layers->threshold) {
+        layer_pool_extract(layers, &engine->tree, bptree_rank(&engine->tree, low, false), range->size,
+                           workspace->stations, workspace->autonomies);
+    } else {
+        bptree_range_copy(&engine->tree, low, range->size, workspace->stations, workspace->autonomies);
+    }
+    range->stations = workspace->stations;
+    range->autonomies = workspace->autonomies;
+}
+
+void engine_report(const Engine *engine, FILE *stream) {
+    const Workspace *workspace = &engine->workspace;
+
+    arena_report(&engine->arena, stream);
+    fprintf(stream, "workspace: %d stations, %d searched, %d cars, %zu allocations over %zu queries\n",
+            workspace->capacity, workspace->search_capacity, workspace->car_capacity, workspace->allocations,
+            workspace->queries);
+    fprintf(stream, "route cache: %d/%d routes, %zu hits, %zu misses, %zu invalidated, %zu text slabs allocated\n",
+            engine->cache.size, engine->cache.capacity, engine->cache.hits, engine->cache.misses,
+            engine->cache.invalidations, engine->cache.allocations);
+    fprintf(stream, "gap detector: %zu routes rejected\n", engine->gap_rejections);
+    fprintf(stream, "bulk builds: %zu runs, %zu stations\n", engine->run.builds, engine->run.stations);
+    if (engine->planner == PLANNER_JUMP) {
+        fprintf(stream, "jump tables: %d stations, %d levels, %zu rebuilds, %zu routes\n", engine->jumps.size,
+                engine->jumps.levels, engine->jumps.rebuilds, engine->jumps.queries);
+    }
+    if (engine->layers != NULL) {
+        layer_pool_report(engine->layers, stream);
+    }
+}
+
+void engine_count_allocations(const Engine *engine, QueryAllocations *allocations) {
+    allocations->workspaces += engine->workspace.allocations;
+    allocations->route_cache += engine->cache.allocations;
+    allocations->jump_tables += engine->jumps.allocations;
+    if (engine->layers != NULL) {
+        allocations->threads += engine->layers->allocations;
+    }
+}
+
+bool engine_jump_tables_ready(Engine *engine, int low, int high) {
+    JumpTables *jumps = &engine->jumps;
+
+    if (jumps->built && !mutation_log_touches(&engine->log, jumps->version, low, high)) {
+        return true;
+    }
+    if (jumps->built) {
+        size_t size = bptree_rank(&engine->tree, high, true) - bptree_rank(&engine->tree, low, false);
+        if (jumps->debt + size < (size_t)engine->tree.size) {
+            jumps->debt += size;
+            return false;
+        }
+    }
+    jump_tables_build(jumps, &engine->tree, engine->log.version);
+    return true;
+}
+
+bool engine_save(const Engine *engine, const char *path) {
+    const BPTree *tree = &engine->tree;
+    SnapshotHeader header;
+    FILE *file = fopen(path, "wb");
+
+    if (file == NULL) {
+        return false;
+    }
+
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.stations = tree->size;
+    header.entries = 0;
+    header.checksum = 0;
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    unsigned long long checksum = 0xcbf29ce484222325ull;
+    for (BPTreeNode *leaf = bptree_find_leaf(tree, INT_MIN); written && leaf != NULL; leaf = leaf->next) {
+        for (int i = 0; i < leaf->num_keys; i++) {
+            SnapshotStation station = {leaf->keys[i], leaf->cars[i]->length, leaf->cars[i]->size};
+            written = written && fwrite(&station, sizeof(station), 1, file) == 1;
+            checksum = snapshot_checksum(checksum, &station, sizeof(station));
+            header.entries += station.length;
+        }
+    }
+    for (BPTreeNode *leaf = bptree_find_leaf(tree, INT_MIN); written && leaf != NULL; leaf = leaf->next) {
+        for (int i = 0; i < leaf->num_keys; i++) {
+            const Fleet *fleet = leaf->cars[i];
+            if (fleet->length == 0) {
+                continue;
+            }
+            written = written && fwrite(fleet->entries, sizeof(FleetEntry), fleet->length, file) == (size_t)fleet->length;
+            checksum = snapshot_checksum(checksum, fleet->entries, fleet->length * sizeof(FleetEntry));
+        }
+    }
+
+    header.checksum = checksum;
+    written = written && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+    return fclose(file) == 0 && written;
+}
+
+bool engine_load(Engine *engine, const char *path) {
+    struct stat info;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) {
+        return false;
+    }
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(SnapshotHeader)) {
+        close(fd);
+        return false;
+    }
+
+    size_t size = info.st_size;
+    void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+
+    const SnapshotHeader *header = (const SnapshotHeader *)mapping;
+    const SnapshotStation *stations = (const SnapshotStation *)(header + 1);
+    const FleetEntry *entries = (const FleetEntry *)(stations + header->stations);
+    bool valid = memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) == 0 &&
+                 header->version == SNAPSHOT_VERSION && header->byte_order == SNAPSHOT_BYTE_ORDER &&
+                 header->stations <= INT_MAX && header->entries <= (unsigned long long)MAX_CARS * header->stations &&
+                 size == sizeof(SnapshotHeader) + header->stations * sizeof(SnapshotStation) +
+                             header->entries * sizeof(FleetEntry);
+    valid = valid && snapshot_checksum(0xcbf29ce484222325ull, stations, size - sizeof(SnapshotHeader)) == header->checksum;
+    valid = valid && snapshot_validate(stations, header->stations, entries, header->entries);
+
+    if (valid) {
+        int count = (int)header->stations;
+        int *keys = (int *)malloc((count > 0 ? count : 1) * sizeof(int));
+        Fleet **fleets = (Fleet **)malloc((count > 0 ? count : 1) * sizeof(Fleet *));
+        if (keys == NULL || fleets == NULL) {
+            printf("memory allocation error!\n");
+            exit(1);
+        }
+
+        bptree_clear(&engine->tree);
+        for (int i = 0; i < count; i++) {
+            keys[i] = stations[i].key;
+            fleets[i] = fleet_create_entries(&engine->arena, entries, stations[i].length, stations[i].size);
+            entries += stations[i].length;
+        }
+        bptree_build(&engine->tree, keys, fleets, count);
+        free(keys);
+        free(fleets);
+        mutation_log_record_all(&engine->log);
+        if (engine->versions.enabled) {
+            version_index_build(&engine->versions, &engine->tree);
+        }
+    }
+    munmap(mapping, size);
+    return valid;
+}
+
+unsigned long long snapshot_checksum(unsigned long long hash, const void *data, size_t size) {
+    const unsigned char *bytes = (const unsigned char *)data;
+
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+bool snapshot_validate(const SnapshotStation *stations, size_t count, const FleetEntry *entries, size_t entry_count) {
+    size_t offset = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        const SnapshotStation *station = &stations[i];
+        int cars = 0;
+
+        if ((i > 0 && station->key <= stations[i - 1].key) || station->size > MAX_CARS ||
+            station->length > station->size || offset + station->length > entry_count) {
+            return false;
+        }
+        for (int j = 0; j < station->length; j++) {
+            const FleetEntry *entry = &entries[offset + j];
+            if (entry->count <= 0 || (j > 0 && entry->autonomy <= entries[offset + j - 1].autonomy)) {
+                return false;
+            }
+            cars += entry->count;
+        }
+        if (cars != station->size) {
+            return false;
+        }
+        offset += station->length;
+    }
+    return offset == entry_count;
+}
+
+void bptree_clear(BPTree *tree) {
+    if (tree->root != NULL) {
+        bptree_destroy_node(tree->arena, tree->root, true);
+    }
+    tree->root = NULL;
+    tree->size = 0;
+}
+
+void bptree_detach(BPTree *tree, int *keys, Fleet **fleets) {
+    int count = 0;
+
+    for (BPTreeNode *leaf = bptree_find_leaf(tree, INT_MIN); leaf != NULL; leaf = leaf->next) {
+        memcpy(keys + count, leaf->keys, leaf->num_keys * sizeof(int));
+        memcpy(fleets + count, leaf->cars, leaf->num_keys * sizeof(Fleet *));
+        count += leaf->num_keys;
+    }
+    if (tree->root != NULL) {
+        bptree_destroy_node(tree->arena, tree->root, false);
+    }
+    tree->root = NULL;
+    tree->size = 0;
+}
+
+void bptree_destroy_node(Arena *arena, BPTreeNode *node, bool fleets) {
+    if (node->is_leaf) {
+        for (int i = 0; fleets && i < node->num_keys; i++) {
+            fleet_destroy(arena, node->cars[i]);
+        }
+    } else {
+        for (int i = 0; i <= node->num_keys; i++) {
+            bptree_destroy_node(arena, node->children[i], fleets);
+        }
+    }
+    pool_free(&arena->nodes, node);
+}
+
+int bptree_max_key(const BPTree *tree) {
+    const BPTreeNode *node = tree->root;
+
+    if (node == NULL) {
+        return INT_MIN;
+    }
+    while (!node->is_leaf) {
+        node = node->children[node->num_keys];
+    }
+    return node->keys[node->num_keys - 1];
+}
+
+void bptree_build(BPTree *tree, const int *keys, Fleet **fleets, int count) {
+    if (count == 0) {
+        return;
+    }
+
+    int groups = bptree_build_groups(count, BPTREE_MAX_KEYS);
+    BPTreeNode **level = (BPTreeNode **)malloc(groups * sizeof(BPTreeNode *));
+    int *lows = (int *)malloc(groups * sizeof(int));
+    BPTreeNode *previous = NULL;
+
+    if (level == NULL || lows == NULL) {
+        printf("memory allocation error!\n");
+        exit(1);
+    }
+    for (int group = 0; group < groups; group++) {
+        int first = (int)((long long)count * group / groups);
+        int last = (int)((long long)count * (group + 1) / groups);
+        BPTreeNode *leaf = bptree_create_node(tree->arena, true);
+
+        for (int i = first; i < last; i++) {
+            leaf->keys[i - first] = keys[i];
+            leaf->autonomies[i - first] = fleet_get_max(fleets[i]);
+            leaf->cars[i - first] = fleets[i];
+        }
+        leaf->num_keys = leaf->size = last - first;
+        leaf->prev = previous;
+        if (previous != NULL) {
+            previous->next = leaf;
+        }
+        bptree_refresh_summary(leaf);
+        level[group] = previous = leaf;
+        lows[group] = leaf->keys[0];
+    }
+
+    while (groups > 1) {
+        int count_below = groups;
+        groups = bptree_build_groups(count_below, BPTREE_MAX_KEYS + 1);
+        for (int group = 0; group < groups; group++) {
+            int first = (int)((long long)count_below * group / groups);
+            int last = (int)((long long)count_below * (group + 1) / groups);
+            BPTreeNode *node = bptree_create_node(tree->arena, false);
+
+            for (int i = first; i < last; i++) {
+                node->children[i - first] = level[i];
+                node->size += level[i]->size;
+                if (i > first) {
+                    node->keys[i - first - 1] = lows[i];
+                }
+            }
+            node->num_keys = last - first - 1;
+            bptree_refresh_summary(node);
+            level[group] = node;
+            lows[group] = lows[first];
+        }
+    }
+
+    tree->root = level[0];
+    tree->size = count;
+    free(level);
+    free(lows);
+}
+
+int bptree_build_groups(int count, int capacity) {
+    if (count <= capacity) {
+        return 1;
+    }
+    return (count + BPTREE_BULK_FILL - 1) / BPTREE_BULK_FILL;
+}
+
+void jump_tables_init(JumpTables *jumps) {
+    jumps->stations = jumps->autonomies = NULL;
+    jumps->reach_right = jumps->reach_left = NULL;
+    jumps->lift_right = jumps->lift_left = NULL;
+    jumps->right_tree = jumps->left_tree = NULL;
+    jumps->size = 0;
+    jumps->leaves = 1;
+    jumps->levels = 1;
+    jumps->capacity = 0;
+    jumps->built = false;
+    jumps->version = 0;
+    jumps->debt = 0;
+    jumps->rebuilds = 0;
+    jumps->allocations = 0;
+    jumps->queries = 0;
+}
+
+void jump_tables_destroy(JumpTables *jumps) {
+    free(jumps->stations);
+    free(jumps->autonomies);
+    free(jumps->reach_right);
+    free(jumps->reach_left);
+    free(jumps->lift_right);
+    free(jumps->lift_left);
+    free(jumps->right_tree);
+    free(jumps->left_tree);
+    jump_tables_init(jumps);
+}
+
+void jump_tables_build(JumpTables *jumps, const BPTree *tree, unsigned long long version) {
+    int size = tree->size;
+    int leaves = 1;
+    int levels = 1;
+
+    while (leaves < size) {
+        leaves *= 2;
+    }
+    while ((1 << levels) < size) {
+        levels++;
+    }
+
+    if (jumps->capacity == 0 || size > jumps->capacity) {
+        int capacity = size > jumps->capacity * 2 ? size : jumps->capacity * 2;
+        int capacity_leaves = 1;
+        int capacity_levels = 1;
+        while (capacity_leaves < capacity) {
+            capacity_leaves *= 2;
+        }
+        while ((1 << capacity_levels) < capacity) {
+            capacity_levels++;
+        }
+
+        jumps->stations = (int *)realloc(jumps->stations, capacity * sizeof(int));
+        jumps->autonomies = (int *)realloc(jumps->autonomies, capacity * sizeof(int));
+        jumps->reach_right = (int *)realloc(jumps->reach_right, capacity * sizeof(int));
+        jumps->reach_left = (int *)realloc(jumps->reach_left, capacity * sizeof(int));
+        jumps->lift_right = (int *)realloc(jumps->lift_right, (size_t)capacity * capacity_levels * sizeof(int));
+        jumps->lift_left = (int *)realloc(jumps->lift_left, (size_t)capacity * capacity_levels * sizeof(int));
+        jumps->right_tree = (long long *)realloc(jumps->right_tree, 2 * capacity_leaves * sizeof(long long));
+        jumps->left_tree = (long long *)realloc(jumps->left_tree, 2 * capacity_leaves * sizeof(long long));
+        if (jumps->stations == NULL || jumps->autonomies == NULL || jumps->reach_right == NULL ||
+            jumps->reach_left == NULL || jumps->lift_right == NULL || jumps->lift_left == NULL ||
+            jumps->right_tree == NULL || jumps->left_tree == NULL) {
+            printf("memory allocation error!\n");
+            exit(1);
+        }
+        jumps->capacity = capacity;
+        jumps->allocations += 8;
+    }
+
+    int *stations = jumps->stations;
+    int *autonomies = jumps->autonomies;
+    if (size > 0) {
+        bptree_range_copy(tree, INT_MIN, size, stations, autonomies);
+    }
+
+    for (int i = 0; i < leaves; i++) {
+        if (i < size) {
+            jumps->right_tree[leaves + i] = (long long)stations[i] + autonomies[i];
+            jumps->left_tree[leaves + i] = (long long)autonomies[i] - stations[i];
+        } else {
+            jumps->right_tree[leaves + i] = LLONG_MIN;
+            jumps->left_tree[leaves + i] = LLONG_MIN;
+        }
+    }
+    for (int i = leaves - 1; i > 0; i--) {
+        long long left = jumps->right_tree[2 * i];
+        long long right = jumps->right_tree[2 * i + 1];
+        jumps->right_tree[i] = left > right ? left : right;
+        left = jumps->left_tree[2 * i];
+        right = jumps->left_tree[2 * i + 1];
+        jumps->left_tree[i] = left > right ? left : right;
+    }
+
+    for (int i = 0; i < size; i++) {
+        long long reach = (long long)stations[i] + autonomies[i];
+        int low = i;
+        int high = size - 1;
+        while (low < high) {
+            int middle = low + (high - low + 1) / 2;
+            if (stations[middle] <= reach) {
+                low = middle;
+            } else {
+                high = middle - 1;
+            }
+        }
+        jumps->reach_right[i] = low;
+
+        reach = (long long)stations[i] - autonomies[i];
+        low = 0;
+        high = i;
+        while (low < high) {
+            int middle = low + (high - low) / 2;
+            if (stations[middle] >= reach) {
+                high = middle;
+            } else {
+                low = middle + 1;
+            }
+        }
+        jumps->reach_left[i] = low;
+    }
+
+    for (int i = 0; i < size; i++) {
+        long long best = jump_range_max(jumps->right_tree, leaves, i, jumps->reach_right[i]);
+        jumps->lift_right[i] = jump_first_at_least(jumps->right_tree, leaves, i, best);
+
+        best = jump_range_max(jumps->left_tree, leaves, jumps->reach_left[i], i);
+        jumps->lift_left[i] = jump_first_at_least(jumps->left_tree, leaves, jumps->reach_left[i], best);
+    }
+    for (int level = 1; level < levels; level++) {
+        const int *previous_right = &jumps->lift_right[(size_t)(level - 1) * size];
+        const int *previous_left = &jumps->lift_left[(size_t)(level - 1) * size];
+        int *current_right = &jumps->lift_right[(size_t)level * size];
+        int *current_left = &jumps->lift_left[(size_t)level * size];
+
+        for (int i = 0; i < size; i++) {
+            current_right[i] = previous_right[previous_right[i]];
+            current_left[i] = previous_left[previous_left[i]];
+        }
+    }
+
+    jumps->size = size;
+    jumps->leaves = leaves;
+    jumps->levels = levels;
+    jumps->built = true;
+    jumps->version = version;
+    jumps->debt = 0;
+    jumps->rebuilds++;
+}
+
+long long jump_range_max(const long long *tree, int leaves, int low, int high) {
+    long long best = LLONG_MIN;
+
+    for (low += leaves, high += leaves + 1; low < high; low /= 2, high /= 2) {
+        if (low & 1) {
+            if (tree[low] > best) {
+                best = tree[low];
+            }
+            low++;
+        }
+        if (high & 1) {
+            high--;
+            if (tree[high] > best) {
+                best = tree[high];
+            }
+        }
+    }
+    return best;
+}
+
+int jump_first_at_least(const long long *tree, int leaves, int from, long long value) {
+    int node = from + leaves;
+
+    while (tree[node] < value) {
+        while (node & 1) {
+            node /= 2;
+        }
+        if (node == 0) {
+            return -1;
+        }
+        node++;
+    }
+    while (node < leaves) {
+        node *= 2;
+        if (tree[node] < value) {
+            node++;
+        }
+    }
+    return node - leaves;
+}
+
+int jump_hops(const JumpTables *jumps, int source, int target) {
+    bool forward = source < target;
+    const int *reach = forward ? jumps->reach_right : jumps->reach_left;
+    const int *lift = forward ? jumps->lift_right : jumps->lift_left;
+    int cursor = source;
+    int hops = 0;
+
+    if (forward ? reach[source] >= target : reach[source] <= target) {
+        return 1;
+    }
+    for (int level = jumps->levels - 1; level >= 0; level--) {
+        int next = lift[(size_t)level * jumps->size + cursor];
+        if (forward ? reach[next] < target : reach[next] > target) {
+            cursor = next;
+            hops += 1 << level;
+        }
+    }
+
+    int next = lift[cursor];
+    if (forward ? reach[next] < target : reach[next] > target) {
+        return -1;
+    }
+    return hops + 2;
+}
+
+void jump_plan(const JumpTables *jumps, int start, int end, Workspace *workspace, OutputWriter *out) {
+    const int *stations = jumps->stations;
+    int low = start < end ? start : end;
+    int high = start < end ? end : start;
+    int first = 0;
+    int last = jumps->size;
+
+    while (first < last) {
+        int middle = (first + last) / 2;
+        if (stations[middle] < low) {
+            first = middle + 1;
+        } else {
+            last = middle;
+        }
+    }
+    last = jumps->size;
+    int upper = first;
+    while (upper < last) {
+        int middle = (upper + last) / 2;
+        if (stations[middle] <= high) {
+            upper = middle + 1;
+        } else {
+            last = middle;
+        }
+    }
+    last = upper - 1;
+
+    if (first > last) {
+        writer_write_no_route(out);
+        return;
+    }
+    if (first == last) {
+        writer_write_station_route(out, stations[first]);
+        return;
+    }
+
+    int source = start < end ? first : last;
+    int target = start < end ? last : first;
+    int hops = jump_hops(jumps, source, target);
+    if (hops < 0) {
+        writer_write_no_route(out);
+        return;
+    }
+
+    workspace_reserve(workspace, hops + 1);
+    workspace_reserve_search(workspace, hops + 1);
+    int *chain = workspace->frontier;
+    int count = 0;
+    int stop = target;
+
+    chain[count++] = target;
+    if (start < end) {
+        while (stop != source) {
+            stop = jump_first_at_least(jumps->right_tree, jumps->leaves, source, stations[stop]);
+            chain[count++] = stop;
+        }
+    } else {
+        int *bounds = workspace->predecessors;
+        int cursor = source;
+        for (int layer = 1; layer < hops; layer++) {
+            bounds[layer] = jumps->reach_left[cursor];
+            cursor = jumps->lift_left[cursor];
+        }
+        for (int layer = hops - 1; layer >= 0; layer--) {
+            int layer_low = layer == 0 ? source : bounds[layer];
+            stop = jump_first_at_least(jumps->left_tree, jumps->leaves, layer_low, -(long long)stations[stop]);
+            chain[count++] = stop;
+        }
+    }
+    path_print_chain(stations, chain, count, out);
+}
+
+void version_index_init(VersionIndex *index, Pool *pool) {
+    index->root = NULL;
+    index->version = 0;
+    index->retired_head = index->retired_tail = NULL;
+    index->pool = pool;
+    index->retired_count = 0;
+    index->reclaimed = 0;
+    index->enabled = false;
+}
+
+void version_index_insert(VersionIndex *index, int key, int autonomy) {
+    VersionNode *sibling;
+
+    index->version++;
+    if (index->root == NULL) {
+        VersionNode *leaf = (VersionNode *)pool_alloc(index->pool);
+        leaf->is_leaf = true;
+        leaf->count = 1;
+        leaf->keys[0] = key;
+        leaf->autonomies[0] = autonomy;
+        index->root = leaf;
+        return;
+    }
+
+    VersionNode *root = version_node_insert(index, index->root, key, autonomy, &sibling);
+    if (sibling != NULL) {
+        VersionNode *parent = (VersionNode *)pool_alloc(index->pool);
+        parent->is_leaf = false;
+        parent->count = 2;
+        parent->keys[0] = root->keys[0];
+        parent->keys[1] = sibling->keys[0];
+        parent->children[0] = root;
+        parent->children[1] = sibling;
+        root = parent;
+    }
+    index->root = root;
+}
+
+void version_index_remove(VersionIndex *index, int key) {
+    index->version++;
+
+    VersionNode *root = version_node_remove(index, index->root, key);
+    while (root != NULL && !root->is_leaf && root->count == 1) {
+        VersionNode *child = root->children[0];
+        version_node_retire(index, root);
+        root = child;
+    }
+    index->root = root;
+}
+
+void version_index_update(VersionIndex *index, int key, int autonomy) {
+    index->version++;
+    index->root = version_node_update(index, index->root, key, autonomy);
+}
+
+void version_index_build(VersionIndex *index, const BPTree *tree) {
+    int count = (tree->size + VERSION_NODE_SIZE - 1) / VERSION_NODE_SIZE;
+    VersionNode **level = (VersionNode **)malloc((count > 0 ? count : 1) * sizeof(VersionNode *));
+    int nodes = 0;
+
+    if (level == NULL) {
+        printf("memory allocation error!\n");
+        exit(1);
+    }
+    index->version++;
+    if (index->root != NULL) {
+        version_node_retire_tree(index, index->root);
+    }
+
+    for (BPTreeNode *leaf = bptree_find_leaf(tree, INT_MIN); leaf != NULL; leaf = leaf->next) {
+        for (int i = 0; i < leaf->num_keys; i++) {
+            VersionNode *node = nodes > 0 ? level[nodes - 1] : NULL;
+            if (node == NULL || node->count == VERSION_NODE_SIZE) {
+                node = (VersionNode *)pool_alloc(index->pool);
+                node->is_leaf = true;
+                node->count = 0;
+                level[nodes++] = node;
+            }
+            node->keys[node->count] = leaf->keys[i];
+            node->autonomies[node->count] = leaf->autonomies[i];
+            node->count++;
+        }
+    }
+
+    while (nodes > 1) {
+        int parents = 0;
+        for (int i = 0; i < nodes; i += VERSION_NODE_SIZE) {
+            VersionNode *node = (VersionNode *)pool_alloc(index->pool);
+            node->is_leaf = false;
+            node->count = 0;
+            for (int j = i; j < nodes && j < i + VERSION_NODE_SIZE; j++) {
+                node->keys[node->count] = level[j]->keys[0];
+                node->children[node->count] = level[j];
+                node->count++;
+            }
+            level[parents++] = node;
+        }
+        nodes = parents;
+    }
+
+    index->root = nodes > 0 ? level[0] : NULL;
+    free(level);
+}
+
+void version_node_retire_tree(VersionIndex *index, VersionNode *node) {
+    if (!node->is_leaf) {
+        for (int i = 0; i < node->count; i++) {
+            version_node_retire_tree(index, node->children[i]);
+        }
+    }
+    version_node_retire(index, node);
+}
+
+void version_index_reclaim(VersionIndex *index, unsigned long long oldest) {
+    while (index->retired_head != NULL && index->retired_head->retired <= oldest) {
+        VersionNode *node = index->retired_head;
+        index->retired_head = node->retired_next;
+        pool_free(index->pool, node);
+        index->retired_count--;
+        index->reclaimed++;
+    }
+    if (index->retired_head == NULL) {
+        index->retired_tail = NULL;
+    }
+}
+
+int version_index_collect(const VersionNode *root, int low, int high, Workspace *workspace) {
+    int count = 0;
+
+    if (root != NULL) {
+        version_node_collect(root, low, high, workspace, &count);
+    }
+    return count;
+}
+
+VersionNode *version_node_copy(VersionIndex *index, VersionNode *node) {
+    VersionNode *copy = (VersionNode *)pool_alloc(index->pool);
+
+    memcpy(copy, node, sizeof(VersionNode));
+    version_node_retire(index, node);
+    return copy;
+}
+
+void version_node_retire(VersionIndex *index, VersionNode *node) {
+    node->retired = index->version;
+    node->retired_next = NULL;
+    if (index->retired_tail != NULL) {
+        index->retired_tail->retired_next = node;
+    } else {
+        index->retired_head = node;
+    }
+    index->retired_tail = node;
+    index->retired_count++;
+}
+
+VersionNode *version_node_split(VersionIndex *index, VersionNode *node) {
+    VersionNode *sibling = (VersionNode *)pool_alloc(index->pool);
+    int half = node->count / 2;
+
+    sibling->is_leaf = node->is_leaf;
+    sibling->count = node->count - half;
+    memcpy(sibling->keys, node->keys + half, sibling->count * sizeof(int));
+    if (node->is_leaf) {
+        memcpy(sibling->autonomies, node->autonomies + half, sibling->count * sizeof(int));
+    } else {
+        memcpy(sibling->children, node->children + half, sibling->count * sizeof(VersionNode *));
+    }
+    node->count = half;
+    return sibling;
+}
+
+int version_node_child(const VersionNode *node, int key) {
+    int low = 1, high = node->count;
+
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (node->keys[middle] <= key) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low - 1;
+}
+
+VersionNode *version_node_insert(VersionIndex *index, VersionNode *node, int key, int autonomy, VersionNode **sibling) {
+    VersionNode *copy;
+    int slot;
+
+    if (node->is_leaf) {
+        copy = version_node_copy(index, node);
+        slot = version_node_child(copy, key);
+        if (copy->keys[slot] < key) {
+            slot++;
+        }
+        memmove(copy->keys + slot + 1, copy->keys + slot, (copy->count - slot) * sizeof(int));
+        memmove(copy->autonomies + slot + 1, copy->autonomies + slot, (copy->count - slot) * sizeof(int));
+        copy->keys[slot] = key;
+        copy->autonomies[slot] = autonomy;
+    } else {
+        VersionNode *split;
+        slot = version_node_child(node, key);
+        VersionNode *child = version_node_insert(index, node->children[slot], key, autonomy, &split);
+
+        copy = version_node_copy(index, node);
+        copy->children[slot] = child;
+        if (key < copy->keys[slot]) {
+            copy->keys[slot] = key;
+        }
+        if (split == NULL) {
+            *sibling = NULL;
+            return copy;
+        }
+        slot++;
+        memmove(copy->keys + slot + 1, copy->keys + slot, (copy->count - slot) * sizeof(int));
+        memmove(copy->children + slot + 1, copy->children + slot, (copy->count - slot) * sizeof(VersionNode *));
+        copy->keys[slot] = split->keys[0];
+        copy->children[slot] = split;
+    }
+
+    copy->count++;
+    *sibling = copy->count > VERSION_NODE_SIZE ? version_node_split(index, copy) : NULL;
+    return copy;
+}
+
+VersionNode *version_node_remove(VersionIndex *index, VersionNode *node, int key) {
+    int slot = version_node_child(node, key);
+    VersionNode *copy;
+
+    if (node->is_leaf) {
+        if (node->count == 1) {
+            version_node_retire(index, node);
+            return NULL;
+        }
+        copy = version_node_copy(index, node);
+        copy->count--;
+        memmove(copy->keys + slot, copy->keys + slot + 1, (copy->count - slot) * sizeof(int));
+        memmove(copy->autonomies + slot, copy->autonomies + slot + 1, (copy->count - slot) * sizeof(int));
+        return copy;
+    }
+
+    VersionNode *child = version_node_remove(index, node->children[slot], key);
+    if (child == NULL && node->count == 1) {
+        version_node_retire(index, node);
+        return NULL;
+    }
+
+    copy = version_node_copy(index, node);
+    if (child != NULL) {
+        copy->children[slot] = child;
+    } else {
+        int lower_bound = copy->keys[0];
+        copy->count--;
+        memmove(copy->keys + slot, copy->keys + slot + 1, (copy->count - slot) * sizeof(int));
+        memmove(copy->children + slot, copy->children + slot + 1, (copy->count - slot) * sizeof(VersionNode *));
+        copy->keys[0] = lower_bound;
+    }
+    return copy;
+}
+
+VersionNode *version_node_update(VersionIndex *index, VersionNode *node, int key, int autonomy) {
+    int slot = version_node_child(node, key);
+    VersionNode *child = node->is_leaf ? NULL : version_node_update(index, node->children[slot], key, autonomy);
+    VersionNode *copy = version_node_copy(index, node);
+
+    if (copy->is_leaf) {
+        copy->autonomies[slot] = autonomy;
+    } else {
+        copy->children[slot] = child;
+    }
+    return copy;
+}
+
+void version_node_collect(const VersionNode *node, int low, int high, Workspace *workspace, int *count) {
+    int slot = version_node_child(node, low);
+
+    if (node->is_leaf) {
+        if (node->keys[slot] < low) {
+            slot++;
+        }
+        int end = slot;
+        while (end < node->count && node->keys[end] <= high) {
+            end++;
+        }
+        workspace_reserve(workspace, *count + end - slot);
+        memcpy(workspace->stations + *count, node->keys + slot, (end - slot) * sizeof(int));
+        memcpy(workspace->autonomies + *count, node->autonomies + slot, (end - slot) * sizeof(int));
+        *count += end - slot;
+        return;
+    }
+
+    for (; slot < node->count && node->keys[slot] <= high; slot++) {
+        version_node_collect(node->children[slot], low, high, workspace, count);
+    }
+}
+
+void batch_runner_init(BatchRunner *runner, Engine *engine, int thread_count) {
+    runner->engine = engine;
+    runner->thread_count = thread_count;
+    runner->size = 0;
+    runner->plan_count = 0;
+    runner->task_count = 0;
+    runner->cluster_count = 0;
+    runner->stations = runner->autonomies = NULL;
+    runner->buffer_capacity = 0;
+    runner->next_task = 0;
+    runner->running = 0;
+    runner->generation = 0;
+    runner->stop = false;
+    runner->batches = runner->planned = runner->extracted = runner->allocations = 0;
+    pthread_mutex_init(&runner->lock, NULL);
+    pthread_cond_init(&runner->start, NULL);
+    pthread_cond_init(&runner->done, NULL);
+
+    runner->workers = (BatchWorker *)malloc(thread_count * sizeof(BatchWorker));
+    if (runner->workers == NULL) {
+        printf("memory allocation error!\n");
+        exit(1);
+    }
+    for (int i = 0; i < thread_count; i++) {
+        BatchWorker *worker = &runner->workers[i];
+        worker->runner = runner;
+        workspace_init(&worker->workspace);
+        if (!writer_open(&worker->answers, -1)) {
+            printf("memory allocation error!\n");
+            exit(1);
+        }
+        if (i > 0 && pthread_create(&worker->thread, NULL, batch_worker_main, worker) != 0) {
+            printf("thread creation error!\n");
+            exit(1);
+        }
+    }
+}
+
+void batch_runner_destroy(BatchRunner *runner) {
+    pthread_mutex_lock(&runner->lock);
+    runner->stop = true;
+    pthread_cond_broadcast(&runner->start);
+    pthread_mutex_unlock(&runner->lock);
+
+    for (int i = 0; i < runner->thread_count; i++) {
+        BatchWorker *worker = &runner->workers[i];
+        if (i > 0) {
+            pthread_join(worker->thread, NULL);
+        }
+        workspace_destroy(&worker->workspace);
+        free(worker->answers.buffer);
+    }
+    free(runner->workers);
+    free(runner->stations);
+    free(runner->autonomies);
+    pthread_mutex_destroy(&runner->lock);
+    pthread_cond_destroy(&runner->start);
+    pthread_cond_destroy(&runner->done);
+}
+
+void batch_runner_add(BatchRunner *runner, int start, int end, OutputWriter *out) {
+    BatchQuery *query = &runner->queries[runner->size++];
+
+    query->start = start;
+    query->end = end;
+    if (runner->size == BATCH_MAX_QUERIES) {
+        batch_runner_run(runner, out);
+    }
+}
+
+void batch_runner_run(BatchRunner *runner, OutputWriter *out) {
+    RouteCache *cache = &runner->engine->cache;
+
+    if (runner->size == 0) {
+        return;
+    }
+
+    for (int i = 0; i < runner->thread_count; i++) {
+        runner->workers[i].answers.format = out->format;
+    }
+    batch_runner_prepare(runner);
+    if (runner->cluster_count > 0) {
+        batch_runner_dispatch(runner, BATCH_PHASE_EXTRACT, runner->cluster_count);
+    }
+    if (runner->plan_count > 0) {
+        batch_runner_dispatch(runner, BATCH_PHASE_PLAN, runner->plan_count);
+    }
+
+    for (int i = 0; i < runner->size; i++) {
+        BatchQuery *query = &runner->queries[i];
+        const char *text = runner->workers[query->worker].answers.buffer + query->offset;
+
+        writer_write(out, text, query->length);
+        if (!query->cached && query->start != query->end) {
+            route_cache_store(cache, query->start, query->end, runner->engine->log.version, text, query->length);
+        }
+    }
+    for (int i = 0; i < runner->thread_count; i++) {
+        runner->workers[i].answers.length = 0;
+    }
+    runner->planned += runner->plan_count;
+    runner->batches++;
+    runner->size = 0;
+}
+
+void batch_runner_prepare(BatchRunner *runner) {
+    Engine *engine = runner->engine;
+    RouteCache *cache = &engine->cache;
+    OutputWriter *answers = &runner->workers[0].answers;
+    int ranges = 0;
+
+    runner->plan_count = 0;
+    for (int i = 0; i < runner->size; i++) {
+        BatchQuery *query = &runner->queries[i];
+        int low = query->start < query->end ? query->start : query->end;
+        int high = query->start < query->end ? query->end : query->start;
+
+        query->kind = BATCH_QUERY_DONE;
+        query->cached = false;
+        query->worker = 0;
+        query->offset = answers->length;
+
+        if (query->start == query->end) {
+            writer_write_station_route(answers, query->start);
+        } else {
+            int index = route_cache_find(cache, query->start, query->end);
+            if (index != -1 && !mutation_log_touches(&engine->log, cache->entries[index].version, low, high)) {
+                RouteCacheEntry *entry = &cache->entries[index];
+                entry->version = engine->log.version;
+                route_cache_touch(cache, index);
+                writer_write(answers, entry->text, entry->length);
+                query->cached = true;
+                cache->hits++;
+            } else {
+                if (index != -1) {
+                    cache->invalidations++;
+                }
+                if (cache->capacity > 0) {
+                    cache->misses++;
+                }
+
+                if (engine->planner == PLANNER_JUMP && engine_jump_tables_ready(engine, low, high)) {
+                    query->kind = BATCH_QUERY_JUMP;
+                    engine->jumps.queries++;
+                } else if (engine->planner != PLANNER_BFS && bptree_has_gap(&engine->tree, query->start, query->end)) {
+                    writer_write_no_route(answers);
+                    engine->gap_rejections++;
+                } else {
+                    query->first = bptree_rank(&engine->tree, low, false);
+                    query->count = bptree_rank(&engine->tree, high, true) - query->first;
+                    if (query->count == 0) {
+                        writer_write_no_route(answers);
+                    } else {
+                        query->kind = BATCH_QUERY_RANGE;
+                        runner->order[ranges].first = query->first;
+                        runner->order[ranges].index = i;
+                        ranges++;
+                    }
+                }
+            }
+        }
+
+        query->length = answers->length - query->offset;
+        if (query->kind != BATCH_QUERY_DONE) {
+            runner->plans[runner->plan_count++] = i;
+        }
+    }
+
+    qsort(runner->order, ranges, sizeof(BatchOrder), batch_order_compare);
+    runner->cluster_count = 0;
+    size_t total = 0;
+    for (int i = 0; i < ranges; i++) {
+        BatchQuery *query = &runner->queries[runner->order[i].index];
+        int low = query->start < query->end ? query->start : query->end;
+        int high = query->start < query->end ? query->end : query->start;
+        if (runner->cluster_count == 0 ||
+            query->first >= runner->clusters[runner->cluster_count - 1].first +
+                                runner->clusters[runner->cluster_count - 1].count) {
+            BatchCluster *cluster = &runner->clusters[runner->cluster_count++];
+            cluster->low = low;
+            cluster->high = high;
+            cluster->first = query->first;
+            cluster->count = query->count;
+        } else {
+            BatchCluster *cluster = &runner->clusters[runner->cluster_count - 1];
+            if (query->first + query->count > cluster->first + cluster->count) {
+                cluster->high = high;
+                cluster->count = query->first + query->count - cluster->first;
+            }
+        }
+        query->cluster = runner->cluster_count - 1;
+    }
+    for (int i = 0; i < runner->cluster_count; i++) {
+        runner->clusters[i].offset = total;
+        total += runner->clusters[i].count;
+    }
+
+    if (total > runner->buffer_capacity) {
+        size_t capacity = runner->buffer_capacity * 2 > total ? runner->buffer_capacity * 2 : total;
+        runner->stations = (int *)realloc(runner->stations, capacity * sizeof(int));
+        runner->autonomies = (int *)realloc(runner->autonomies, capacity * sizeof(int));
+        if (runner->stations == NULL || runner->autonomies == NULL) {
+            printf("memory allocation error!\n");
+            exit(1);
+        }
+        runner->buffer_capacity = capacity;
+        runner->allocations += 2;
+    }
+}
+
+void batch_runner_dispatch(BatchRunner *runner, BatchPhase phase, int task_count) {
+    runner->phase = phase;
+    runner->task_count = task_count;
+    runner->next_task = 0;
+
+    pthread_mutex_lock(&runner->lock);
+    runner->running = runner->thread_count - 1;
+    runner->generation++;
+    pthread_cond_broadcast(&runner->start);
+    pthread_mutex_unlock(&runner->lock);
+
+    batch_runner_work(runner, &runner->workers[0]);
+
+    pthread_mutex_lock(&runner->lock);
+    while (runner->running > 0) {
+        pthread_cond_wait(&runner->done, &runner->lock);
+    }
+    pthread_mutex_unlock(&runner->lock);
+}
+
+void batch_runner_work(BatchRunner *runner, BatchWorker *worker) {
+    Engine *engine = runner->engine;
+    int task;
+
+    while ((task = __atomic_fetch_add(&runner->next_task, 1, __ATOMIC_RELAXED)) < runner->task_count) {
+        if (runner->phase == BATCH_PHASE_EXTRACT) {
+            BatchCluster *cluster = &runner->clusters[task];
+            StationRange range;
+
+            if (bptree_range_view(&engine->tree, cluster->low, cluster->high, &range)) {
+                cluster->stations = range.stations;
+                cluster->autonomies = range.autonomies;
+            } else {
+                bptree_range_copy(&engine->tree, cluster->low, cluster->count, runner->stations + cluster->offset,
+                                  runner->autonomies + cluster->offset);
+                cluster->stations = runner->stations + cluster->offset;
+                cluster->autonomies = runner->autonomies + cluster->offset;
+                __atomic_fetch_add(&runner->extracted, cluster->count, __ATOMIC_RELAXED);
+            }
+            continue;
+        }
+
+        BatchQuery *query = &runner->queries[runner->plans[task]];
+        OutputWriter *answers = &worker->answers;
+
+        query->worker = (int)(worker - runner->workers);
+        query->offset = answers->length;
+        if (query->kind == BATCH_QUERY_JUMP) {
+            jump_plan(&engine->jumps, query->start, query->end, &worker->workspace, answers);
+        } else {
+            BatchCluster *cluster = &runner->clusters[query->cluster];
+            StationRange range;
+
+            range.stations = cluster->stations + (query->first - cluster->first);
+            range.autonomies = cluster->autonomies + (query->first - cluster->first);
+            range.size = query->count;
+            workspace_reserve(&worker->workspace, range.size);
+            path_plan(&range, query->start, query->end, engine->planner, &worker->workspace, answers);
+        }
+        query->length = answers->length - query->offset;
+    }
+}
+
+void *batch_worker_main(void *argument) {
+    BatchWorker *worker = (BatchWorker *)argument;
+    BatchRunner *runner = worker->runner;
+    unsigned int generation = 0;
+
+    pthread_mutex_lock(&runner->lock);
+    while (true) {
+        while (runner->generation == generation && !runner->stop) {
+            pthread_cond_wait(&runner->start, &runner->lock);
+        }
+        if (runner->stop) {
+            break;
+        }
+        generation = runner->generation;
+        pthread_mutex_unlock(&runner->lock);
+
+        batch_runner_work(runner, worker);
+
+        pthread_mutex_lock(&runner->lock);
+        if (--runner->running == 0) {
+            pthread_cond_signal(&runner->done);
+        }
+    }
+    pthread_mutex_unlock(&runner->lock);
+    return NULL;
+}
+
+int batch_order_compare(const void *a, const void *b) {
+    const BatchOrder *left = (const BatchOrder *)a;
+    const BatchOrder *right = (const BatchOrder *)b;
+
+    if (left->first != right->first) {
+        return (left->first > right->first) - (left->first < right->first);
+    }
+    return (left->index > right->index) - (left->index < right->index);
+}
+
+void batch_runner_count_allocations(const BatchRunner *runner, QueryAllocations *allocations) {
+    for (int i = 0; i < runner->thread_count; i++) {
+        allocations->workspaces += runner->workers[i].workspace.allocations;
+        allocations->answers += runner->workers[i].answers.allocations;
+    }
+    allocations->threads += runner->allocations;
+}
+
+void batch_runner_report(const BatchRunner *runner, FILE *stream) {
+    fprintf(stream, "batches: %zu batches on %d threads, %zu queries planned, %zu stations extracted\n",
+            runner->batches, runner->thread_count, runner->planned, runner->extracted);
+}
+
+void reader_pool_init(ReaderPool *pool, Engine *engine, int thread_count) {
+    pool->engine = engine;
+    pool->thread_count = thread_count;
+    pool->submitted = pool->claimed = pool->emitted = 0;
+    pool->stop = false;
+    pool->planned = pool->immediate = pool->stalls = 0;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    engine->versions.enabled = true;
+
+    for (int i = 0; i < READER_QUEUE_SIZE; i++) {
+        OutputWriter *answer = &pool->tasks[i].answer;
+        answer->fd = -1;
+        answer->pipeline = NULL;
+        answer->allocations = 0;
+        answer->length = 0;
+        answer->capacity = READER_ANSWER_SIZE;
+        answer->buffer = (char *)malloc(answer->capacity);
+        if (answer->buffer == NULL) {
+            printf("memory allocation error!\n");
+            exit(1);
+        }
+        pool->tasks[i].done = false;
+    }
+
+    pool->workers = (ReaderWorker *)malloc(thread_count * sizeof(ReaderWorker));
+    if (pool->workers == NULL) {
+        printf("memory allocation error!\n");
+        exit(1);
+    }
+    for (int i = 0; i < thread_count; i++) {
+        ReaderWorker *worker = &pool->workers[i];
+        worker->pool = pool;
+        workspace_init(&worker->workspace);
+        if (pthread_create(&worker->thread, NULL, reader_worker_main, worker) != 0) {
+            printf("thread creation error!\n");
+            exit(1);
+        }
+    }
+}
+
+void reader_pool_finish(ReaderPool *pool, OutputWriter *out) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->emitted < pool->submitted) {
+        ReaderTask *task = &pool->tasks[pool->emitted % READER_QUEUE_SIZE];
+        while (!__atomic_load_n(&task->done, __ATOMIC_ACQUIRE)) {
+            pthread_cond_wait(&pool->done, &pool->lock);
+        }
+        pthread_mutex_unlock(&pool->lock);
+        reader_pool_drain(pool, out);
+        pthread_mutex_lock(&pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void reader_pool_destroy(ReaderPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+        workspace_destroy(&pool->workers[i].workspace);
+    }
+    for (int i = 0; i < READER_QUEUE_SIZE; i++) {
+        free(pool->tasks[i].answer.buffer);
+    }
+    free(pool->workers);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work);
+    pthread_cond_destroy(&pool->done);
+}
+
+void reader_pool_submit(ReaderPool *pool, int start, int end, OutputWriter *out) {
+    Engine *engine = pool->engine;
+    RouteCache *cache = &engine->cache;
+    int low = start < end ? start : end;
+    int high = start < end ? end : start;
+    OutputWriter *sink;
+
+    if (start == end) {
+        sink = reader_pool_sink(pool, out);
+        writer_write_station_route(sink, start);
+        pool->immediate++;
+        return;
+    }
+
+    int index = route_cache_find(cache, start, end);
+    if (index != -1) {
+        RouteCacheEntry *entry = &cache->entries[index];
+        if (!mutation_log_touches(&engine->log, entry->version, low, high)) {
+            entry->version = engine->log.version;
+            route_cache_touch(cache, index);
+            sink = reader_pool_sink(pool, out);
+            writer_write(sink, entry->text, entry->length);
+            cache->hits++;
+            pool->immediate++;
+            return;
+        }
+        cache->invalidations++;
+    }
+    if (cache->capacity > 0) {
+        cache->misses++;
+    }
+
+    if (engine->planner != PLANNER_BFS && bptree_has_gap(&engine->tree, start, end)) {
+        sink = reader_pool_sink(pool, out);
+        writer_write_no_route(sink);
+        engine->gap_rejections++;
+        pool->immediate++;
+        return;
+    }
+
+    ReaderTask *task = reader_pool_reserve(pool, out);
+    task->start = start;
+    task->end = end;
+    task->root = engine->versions.root;
+    task->version = engine->versions.version;
+    task->log_version = engine->log.version;
+    task->planned = true;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->submitted++;
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+OutputWriter *reader_pool_sink(ReaderPool *pool, OutputWriter *out) {
+    if (pool->emitted == pool->submitted) {
+        return out;
+    }
+
+    ReaderTask *task = reader_pool_reserve(pool, out);
+    if (pool->emitted == pool->submitted) {
+        return out;
+    }
+    task->version = pool->engine->versions.version;
+    task->planned = false;
+    __atomic_store_n(&task->done, true, __ATOMIC_RELEASE);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->submitted++;
+    pthread_mutex_unlock(&pool->lock);
+    return &task->answer;
+}
+
+ReaderTask *reader_pool_reserve(ReaderPool *pool, OutputWriter *out) {
+    if (pool->submitted - pool->emitted == READER_QUEUE_SIZE) {
+        ReaderTask *head = &pool->tasks[pool->emitted % READER_QUEUE_SIZE];
+
+        pool->stalls++;
+        pthread_mutex_lock(&pool->lock);
+        while (!__atomic_load_n(&head->done, __ATOMIC_ACQUIRE)) {
+            pthread_cond_wait(&pool->done, &pool->lock);
+        }
+        pthread_mutex_unlock(&pool->lock);
+        reader_pool_drain(pool, out);
+    }
+
+    ReaderTask *task = &pool->tasks[pool->submitted % READER_QUEUE_SIZE];
+    task->answer.format = out->format;
+    return task;
+}
+
+void reader_pool_drain(ReaderPool *pool, OutputWriter *out) {
+    Engine *engine = pool->engine;
+
+    while (pool->emitted < pool->submitted) {
+        ReaderTask *task = &pool->tasks[pool->emitted % READER_QUEUE_SIZE];
+        if (!__atomic_load_n(&task->done, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+
+        writer_write(out, task->answer.buffer, task->answer.length);
+        if (task->planned) {
+            route_cache_store(&engine->cache, task->start, task->end, task->log_version, task->answer.buffer,
+                              task->answer.length);
+        }
+        task->answer.length = 0;
+        task->done = false;
+        pool->emitted++;
+    }
+
+    if (pool->emitted < pool->submitted) {
+        version_index_reclaim(&engine->versions, pool->tasks[pool->emitted % READER_QUEUE_SIZE].version);
+    } else {
+        version_index_reclaim(&engine->versions, engine->versions.version);
+    }
+}
+
+void *reader_worker_main(void *argument) {
+    ReaderWorker *worker = (ReaderWorker *)argument;
+    ReaderPool *pool = worker->pool;
+    PlannerKind planner = pool->engine->planner == PLANNER_BFS ? PLANNER_BFS : PLANNER_GREEDY;
+
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        while (pool->claimed == pool->submitted && !pool->stop) {
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
+        if (pool->claimed == pool->submitted) {
+            break;
+        }
+
+        ReaderTask *task = &pool->tasks[pool->claimed++ % READER_QUEUE_SIZE];
+        if (!task->planned) {
+            continue;
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        int low = task->start < task->end ? task->start : task->end;
+        int high = task->start < task->end ? task->end : task->start;
+        StationRange range;
+
+        range.size = version_index_collect(task->root, low, high, &worker->workspace);
+        range.stations = worker->workspace.stations;
+        range.autonomies = worker->workspace.autonomies;
+        path_plan(&range, task->start, task->end, planner, &worker->workspace, &task->answer);
+        worker->workspace.queries++;
+
+        pthread_mutex_lock(&pool->lock);
+        __atomic_store_n(&task->done, true, __ATOMIC_RELEASE);
+        pool->planned++;
+        pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+void reader_pool_count_allocations(const ReaderPool *pool, QueryAllocations *allocations) {
+    for (int i = 0; i < pool->thread_count; i++) {
+        allocations->workspaces += pool->workers[i].workspace.allocations;
+    }
+    for (int i = 0; i < READER_QUEUE_SIZE; i++) {
+        allocations->answers += pool->tasks[i].answer.allocations;
+    }
+}
+
+void reader_pool_report(const ReaderPool *pool, FILE *stream) {
+    const VersionIndex *versions = &pool->engine->versions;
+
+    fprintf(stream, "readers: %d threads, %zu routes planned, %zu answered at submission, %zu stalls\n",
+            pool->thread_count, pool->planned, pool->immediate, pool->stalls);
+    fprintf(stream, "versions: %llu published, %zu nodes retired, %zu reclaimed\n", versions->version,
+            versions->retired_count, versions->reclaimed);
+}
+
+void spsc_ring_init(SpscRing *ring, size_t size, size_t batch) {
+    ring->slots = (int *)malloc(size * sizeof(int));
+    if (ring->slots == NULL) {
+        printf("memory allocation error!\n");
+        exit(1);
+    }
+    ring->mask = size - 1;
+    ring->batch = batch;
+    ring->spins = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SPSC_RING_SPINS : 0;
+    ring->head = ring->tail = ring->produced = ring->consumed = 0;
+    ring->tail_cache = ring->head_cache = 0;
+    ring->producer_waits = ring->consumer_waits = 0;
+    ring->closed = false;
+    ring->sleeping = 0;
+    pthread_mutex_init(&ring->lock, NULL);
+    pthread_cond_init(&ring->wake, NULL);
+}
+
+void spsc_ring_destroy(SpscRing *ring) {
+    free(ring->slots);
+    pthread_mutex_destroy(&ring->lock);
+    pthread_cond_destroy(&ring->wake);
+}
+
+void spsc_ring_push(SpscRing *ring, int value) {
+    if (ring->produced - ring->tail_cache > ring->mask) {
+        ring->tail_cache = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        while (ring->produced - ring->tail_cache > ring->mask) {
+            spsc_ring_publish(ring, true);
+            spsc_ring_wait(ring, &ring->tail, ring->tail_cache, &ring->producer_waits);
+            ring->tail_cache = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        }
+    }
+    ring->slots[ring->produced++ & ring->mask] = value;
+}
+
+void spsc_ring_publish(SpscRing *ring, bool urgent) {
+    if (__atomic_load_n(&ring->head, __ATOMIC_RELAXED) != ring->produced) {
+        __atomic_store_n(&ring->head, ring->produced, __ATOMIC_SEQ_CST);
+    } else if (!urgent) {
+        return;
+    }
+    if (__atomic_load_n(&ring->sleeping, __ATOMIC_SEQ_CST) > 0 &&
+        (urgent || ring->produced - __atomic_load_n(&ring->tail, __ATOMIC_RELAXED) >= ring->batch)) {
+        spsc_ring_wake(ring);
+    }
+}
+
+void spsc_ring_close(SpscRing *ring) {
+    spsc_ring_publish(ring, true);
+    __atomic_store_n(&ring->closed, true, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->sleeping, __ATOMIC_SEQ_CST) > 0) {
+        spsc_ring_wake(ring);
+    }
+}
+
+bool spsc_ring_pop(SpscRing *ring, int *value) {
+    if (ring->consumed == ring->head_cache) {
+        ring->head_cache = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        while (ring->consumed == ring->head_cache) {
+            if (__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE)) {
+                ring->head_cache = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+                if (ring->consumed == ring->head_cache) {
+                    return false;
+                }
+                break;
+            }
+            spsc_ring_release(ring);
+            spsc_ring_wait(ring, &ring->head, ring->head_cache, &ring->consumer_waits);
+            ring->head_cache = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        }
+    }
+    *value = ring->slots[ring->consumed++ & ring->mask];
+    return true;
+}
+
+void spsc_ring_release(SpscRing *ring) {
+    if (__atomic_load_n(&ring->tail, __ATOMIC_RELAXED) == ring->consumed) {
+        return;
+    }
+    __atomic_store_n(&ring->tail, ring->consumed, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->sleeping, __ATOMIC_SEQ_CST) > 0 &&
+        ring->mask + 1 - (__atomic_load_n(&ring->head, __ATOMIC_RELAXED) - ring->consumed) >= ring->batch) {
+        spsc_ring_wake(ring);
+    }
+}
+
+void spsc_ring_wait(SpscRing *ring, const size_t *index, size_t value, size_t *waits) {
+    for (int spin = 0; spin < ring->spins; spin++) {
+        if (__atomic_load_n(index, __ATOMIC_ACQUIRE) != value || __atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE)) {
+            return;
+        }
+#ifdef SCAN_KERNELS_X86
+        _mm_pause();
+#endif
+    }
+
+    pthread_mutex_lock(&ring->lock);
+    __atomic_fetch_add(&ring->sleeping, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(index, __ATOMIC_SEQ_CST) == value && !__atomic_load_n(&ring->closed, __ATOMIC_SEQ_CST)) {
+        __atomic_fetch_add(waits, 1, __ATOMIC_RELAXED);
+        do {
+            pthread_cond_wait(&ring->wake, &ring->lock);
+        } while (__atomic_load_n(index, __ATOMIC_ACQUIRE) == value && !__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE));
+    }
+    __atomic_fetch_sub(&ring->sleeping, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+void spsc_ring_wake(SpscRing *ring) {
+    pthread_mutex_lock(&ring->lock);
+    pthread_cond_broadcast(&ring->wake);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+void pipeline_start(Pipeline *pipeline, InputReader *reader, OutputWriter *out) {
+    pipeline->input = *reader;
+    pipeline->fd = out->fd;
+    pipeline->input.decoded = &pipeline->commands;
+    spsc_ring_init(&pipeline->commands, PIPELINE_RING_SIZE, PIPELINE_WAKE_BATCH);
+    spsc_ring_init(&pipeline->full, PIPELINE_OUTPUT_BLOCKS, 1);
+    spsc_ring_init(&pipeline->free, PIPELINE_OUTPUT_BLOCKS, 1);
+
+    pipeline->block = 0;
+    for (int i = 1; i < PIPELINE_OUTPUT_BLOCKS; i++) {
+        OutputBlock *block = &pipeline->blocks[i];
+        block->length = 0;
+        block->capacity = OUTPUT_BUFFER_SIZE;
+        block->buffer = (char *)malloc(block->capacity);
+        if (block->buffer == NULL) {
+            printf("memory allocation error!\n");
+            exit(1);
+        }
+        spsc_ring_push(&pipeline->free, i);
+    }
+    spsc_ring_publish(&pipeline->free, false);
+
+    reader->capacity = PATH_MAX;
+    reader->buffer = (char *)malloc(reader->capacity);
+    if (reader->buffer == NULL) {
+        printf("memory allocation error!\n");
+        exit(1);
+    }
+    reader->cursor = reader->end = reader->buffer;
+    reader->mapped = false;
+    reader->released = 0;
+    reader->commands = &pipeline->commands;
+    out->pipeline = pipeline;
+
+    if (pthread_create(&pipeline->parser, NULL, pipeline_parser_main, pipeline) != 0 ||
+        pthread_create(&pipeline->writer, NULL, pipeline_writer_main, pipeline) != 0) {
+        printf("thread creation error!\n");
+        exit(1);
+    }
+}
+
+void pipeline_stop(Pipeline *pipeline, InputReader *reader, OutputWriter *out) {
+    pipeline_flush(pipeline, out);
+    spsc_ring_close(&pipeline->full);
+    pthread_join(pipeline->writer, NULL);
+    pthread_join(pipeline->parser, NULL);
+
+    free(reader->buffer);
+    *reader = pipeline->input;
+    reader->decoded = NULL;
+    out->pipeline = NULL;
+    for (int i = 0; i < PIPELINE_OUTPUT_BLOCKS; i++) {
+        if (i != pipeline->block) {
+            free(pipeline->blocks[i].buffer);
+        }
+    }
+    spsc_ring_destroy(&pipeline->commands);
+    spsc_ring_destroy(&pipeline->full);
+    spsc_ring_destroy(&pipeline->free);
+}
+
+void pipeline_flush(Pipeline *pipeline, OutputWriter *out) {
+    OutputBlock *block = &pipeline->blocks[pipeline->block];
+
+    if (out->length == 0) {
+        return;
+    }
+    block->buffer = out->buffer;
+    block->length = out->length;
+    block->capacity = out->capacity;
+    spsc_ring_push(&pipeline->full, pipeline->block);
+    spsc_ring_publish(&pipeline->full, false);
+
+    spsc_ring_pop(&pipeline->free, &pipeline->block);
+    spsc_ring_release(&pipeline->free);
+    block = &pipeline->blocks[pipeline->block];
+    out->buffer = block->buffer;
+    out->capacity = block->capacity;
+    out->length = 0;
+}
+
+bool pipeline_next_command(SpscRing *commands, CommandKind *kind) {
+    int value;
+
+    spsc_ring_release(commands);
+    if (!spsc_ring_pop(commands, &value)) {
+        return false;
+    }
+    *kind = (CommandKind)value;
+    return true;
+}
+
+bool pipeline_next_token(InputReader *reader, const char **token, int *length) {
+    SpscRing *commands = reader->commands;
+    int size;
+
+    if (!spsc_ring_pop(commands, &size) || size < 0) {
+        return false;
+    }
+    if (size < PATH_MAX) {
+        for (int i = 0; i < size; i += (int)sizeof(int)) {
+            int word;
+            spsc_ring_pop(commands, &word);
+            memcpy(reader->buffer + i, &word, sizeof(int));
+        }
+    }
+    *token = reader->buffer;
+    *length = size;
+    return true;
+}
+
+void command_encode(InputReader *reader, CommandKind kind, CommandArguments *arguments, SpscRing *commands) {
+    spsc_ring_push(commands, kind);
+
+    if (kind == COMMAND_ADD_STATION) {
+        reader_next_int(reader, &arguments->key);
+        reader_next_int(reader, &arguments->fleet_size);
+        spsc_ring_push(commands, arguments->key);
+        spsc_ring_push(commands, arguments->fleet_size);
+        for (int i = 0; i < arguments->fleet_size; i++) {
+            reader_next_int(reader, &arguments->element);
+            spsc_ring_push(commands, arguments->element);
+        }
+
+    } else if (kind == COMMAND_REMOVE_STATION) {
+        reader_next_int(reader, &arguments->key);
+        spsc_ring_push(commands, arguments->key);
+
+    } else if (kind == COMMAND_ADD_CAR || kind == COMMAND_REMOVE_CAR) {
+        reader_next_int(reader, &arguments->key);
+        reader_next_int(reader, &arguments->element);
+        spsc_ring_push(commands, arguments->key);
+        spsc_ring_push(commands, arguments->element);
+
+    } else if (kind == COMMAND_PLAN_ROUTE) {
+        reader_next_int(reader, &arguments->start);
+        reader_next_int(reader, &arguments->end);
+        spsc_ring_push(commands, arguments->start);
+        spsc_ring_push(commands, arguments->end);
+
+    } else if (kind == COMMAND_PLAN_ROUTES) {
+        reader_next_int(reader, &arguments->start);
+        reader_next_int(reader, &arguments->count);
+        spsc_ring_push(commands, arguments->start);
+        spsc_ring_push(commands, arguments->count);
+        for (int i = 0; i < arguments->count; i++) {
+            reader_next_int(reader, &arguments->element);
+            spsc_ring_push(commands, arguments->element);
+        }
+
+    } else if (kind == COMMAND_SAVE || kind == COMMAND_LOAD) {
+        const char *token;
+        int length;
+
+        if (!reader_next_token(reader, &token, &length)) {
+            length = -1;
+        }
+        spsc_ring_push(commands, length);
+        for (int i = 0; i < length && length < PATH_MAX; i += (int)sizeof(int)) {
+            int word = 0;
+            memcpy(&word, token + i, length - i < (int)sizeof(int) ? length - i : (int)sizeof(int));
+            spsc_ring_push(commands, word);
+        }
+    }
+}
+
+void *pipeline_parser_main(void *argument) {
+    Pipeline *pipeline = (Pipeline *)argument;
+    CommandArguments arguments = {0};
+    CommandKind kind;
+
+    while (reader_next_command(&pipeline->input, &kind)) {
+        command_encode(&pipeline->input, kind, &arguments, &pipeline->commands);
+        spsc_ring_publish(&pipeline->commands, false);
+    }
+    spsc_ring_close(&pipeline->commands);
+    return NULL;
+}
+
+void *pipeline_writer_main(void *argument) {
+    Pipeline *pipeline = (Pipeline *)argument;
+    int index;
+
+    while (spsc_ring_pop(&pipeline->full, &index)) {
+        OutputBlock *block = &pipeline->blocks[index];
+
+        writer_send(pipeline->fd, block->buffer, block->length);
+        spsc_ring_release(&pipeline->full);
+        spsc_ring_push(&pipeline->free, index);
+        spsc_ring_publish(&pipeline->free, false);
+    }
+    return NULL;
+}
+
+void pipeline_report(const Pipeline *pipeline, FILE *stream) {
+    fprintf(stream, "pipeline: %zu words decoded, %zu blocks written, sleeps: parser %zu, engine %zu, writer %zu\n",
+            __atomic_load_n(&pipeline->commands.head, __ATOMIC_RELAXED),
+            __atomic_load_n(&pipeline->full.tail, __ATOMIC_RELAXED),
+            __atomic_load_n(&pipeline->commands.producer_waits, __ATOMIC_RELAXED),
+            __atomic_load_n(&pipeline->commands.consumer_waits, __ATOMIC_RELAXED) +
+                __atomic_load_n(&pipeline->free.consumer_waits, __ATOMIC_RELAXED),
+            __atomic_load_n(&pipeline->full.consumer_waits, __ATOMIC_RELAXED));
+}
+
+void shard_pool_init(ShardPool *pool, int shard_count, PlannerKind planner, int cache_capacity) {
+    pool->shard_count = shard_count;
+    pool->planner = planner;
+    pool->cache_capacity = cache_capacity;
+    pool->format = OUTPUT_TEXT;
+    pool->submitted = pool->emitted = 0;
+    pool->awaited = -1;
+    pool->stalls = 0;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (int i = 0; i < SHARD_QUEUE_SIZE; i++) {
+        OutputWriter *answer = &pool->tasks[i].answer;
+        answer->fd = -1;
+        answer->pipeline = NULL;
+        answer->allocations = 0;
+        answer->length = 0;
+        answer->capacity = READER_ANSWER_SIZE;
+        answer->buffer = (char *)malloc(answer->capacity);
+        if (answer->buffer == NULL) {
+            printf("memory allocation error!\n");
+            exit(1);
+        }
+        pool->tasks[i].done = false;
+    }
+
+    pool->shards = (Shard *)malloc(shard_count * sizeof(Shard));
+    if (pool->shards == NULL) {
+        printf("memory allocation error!\n");
+        exit(1);
+    }
+    for (int i = 0; i < shard_count; i++) {
+        Shard *shard = &pool->shards[i];
+        shard->pool = pool;
+        shard->highway_count = 0;
+        shard->highway_capacity = SHARD_HIGHWAYS_INITIAL;
+        shard->highways = (Highway *)calloc(shard->highway_capacity, sizeof(Highway));
+        shard->executed = 0;
+        if (shard->highways == NULL) {
+            printf("memory allocation error!\n");
+            exit(1);
+        }
+    }
+}
+
+void shard_pool_destroy(ShardPool *pool) {
+    for (int i = 0; i < pool->shard_count; i++) {
+        Shard *shard = &pool->shards[i];
+        for (int j = 0; j < shard->highway_capacity; j++) {
+            if (shard->highways[j].engine != NULL) {
+                engine_destroy(shard->highways[j].engine);
+                free(shard->highways[j].engine);
+            }
+        }
+        free(shard->highways);
+    }
+    for (int i = 0; i < SHARD_QUEUE_SIZE; i++) {
+        free(pool->tasks[i].answer.buffer);
+    }
+    free(pool->shards);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->done);
+}
+
+void shard_pool_run(ShardPool *pool, InputReader *reader, OutputWriter *out, LatencyHistogram *latencies) {
+    CommandArguments arguments = {0};
+    unsigned long long command_start = latencies != NULL ? latency_now() : 0;
+    CommandKind kind;
+    int id;
+
+    pool->format = out->format;
+    for (int i = 0; i < pool->shard_count; i++) {
+        Shard *shard = &pool->shards[i];
+
+        spsc_ring_init(&shard->commands, SHARD_RING_SIZE, SHARD_WAKE_BATCH);
+        memset(&shard->reader, 0, sizeof(InputReader));
+        shard->reader.buffer = (char *)malloc(PATH_MAX);
+        if (shard->reader.buffer == NULL) {
+            printf("memory allocation error!\n");
+            exit(1);
+        }
+        shard->reader.commands = &shard->commands;
+        if (pthread_create(&shard->thread, NULL, shard_main, shard) != 0) {
+            printf("thread creation error!\n");
+            exit(1);
+        }
+    }
+
+    while (true) {
+        if (!reader_next_int(reader, &id)) {
+            id = 0;
+        }
+        if (!reader_next_command(reader, &kind)) {
+            break;
+        }
+        if (kind != COMMAND_UNKNOWN) {
+            SpscRing *commands = &pool->shards[highway_hash(id) % pool->shard_count].commands;
+            bool barrier = kind == COMMAND_SAVE || kind == COMMAND_LOAD;
+
+            if (barrier) {
+                shard_pool_wait(pool, out, pool->submitted);
+            }
+            spsc_ring_push(commands, shard_pool_reserve(pool, out));
+            spsc_ring_push(commands, id);
+            command_encode(reader, kind, &arguments, commands);
+            spsc_ring_publish(commands, false);
+            pool->submitted++;
+            if (barrier) {
+                shard_pool_wait(pool, out, pool->submitted);
+            }
+        }
+
+        shard_pool_drain(pool, out);
+        writer_end_command(out);
+        if (latencies != NULL) {
+            unsigned long long now = latency_now();
+            latency_record(&latencies[kind], now - command_start);
+            command_start = now;
+        }
+    }
+
+    for (int i = 0; i < pool->shard_count; i++) {
+        spsc_ring_close(&pool->shards[i].commands);
+    }
+    for (int i = 0; i < pool->shard_count; i++) {
+        Shard *shard = &pool->shards[i];
+
+        pthread_join(shard->thread, NULL);
+        spsc_ring_destroy(&shard->commands);
+        free(shard->reader.buffer);
+        for (int j = 0; j < shard->highway_capacity; j++) {
+            if (shard->highways[j].engine != NULL) {
+                engine_flush_run(shard->highways[j].engine);
+            }
+        }
+    }
+    shard_pool_drain(pool, out);
+}
+
+int shard_pool_reserve(ShardPool *pool, OutputWriter *out) {
+    if (pool->submitted - pool->emitted == SHARD_QUEUE_SIZE) {
+        pool->stalls++;
+        shard_pool_wait(pool, out, pool->emitted + 1);
+    }
+
+    int slot = (int)(pool->submitted % SHARD_QUEUE_SIZE);
+    pool->tasks[slot].answer.format = out->format;
+    return slot;
+}
+
+void shard_pool_wait(ShardPool *pool, OutputWriter *out, unsigned long long emitted) {
+    for (int i = 0; i < pool->shard_count; i++) {
+        spsc_ring_publish(&pool->shards[i].commands, true);
+    }
+    shard_pool_drain(pool, out);
+    while (pool->emitted < emitted) {
+        int oldest = (int)(pool->emitted % SHARD_QUEUE_SIZE);
+        ShardTask *head = &pool->tasks[oldest];
+
+        pthread_mutex_lock(&pool->lock);
+        __atomic_store_n(&pool->awaited, oldest, __ATOMIC_SEQ_CST);
+        while (!__atomic_load_n(&head->done, __ATOMIC_SEQ_CST)) {
+            pthread_cond_wait(&pool->done, &pool->lock);
+        }
+        __atomic_store_n(&pool->awaited, -1, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&pool->lock);
+        shard_pool_drain(pool, out);
+    }
+}
+
+void shard_pool_drain(ShardPool *pool, OutputWriter *out) {
+    while (pool->emitted < pool->submitted) {
+        ShardTask *task = &pool->tasks[pool->emitted % SHARD_QUEUE_SIZE];
+        if (!__atomic_load_n(&task->done, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+
+        writer_write(out, task->answer.buffer, task->answer.length);
+        task->answer.length = 0;
+        task->done = false;
+        pool->emitted++;
+    }
+}
+
+unsigned int highway_hash(int id) {
+    unsigned long long hash = (unsigned int)id;
+
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return (unsigned int)hash;
+}
+
+Engine *shard_highway(Shard *shard, int id) {
+    unsigned int mask = shard->highway_capacity - 1;
+    unsigned int index = highway_hash(id) / shard->pool->shard_count & mask;
+
+    while (shard->highways[index].engine != NULL) {
+        if (shard->highways[index].id == id) {
+            return shard->highways[index].engine;
+        }
+        index = (index + 1) & mask;
+    }
+
+    if (2 * (shard->highway_count + 1) > shard->highway_capacity) {
+        Highway *old = shard->highways;
+        int old_capacity = shard->highway_capacity;
+
+        shard->highway_capacity *= 2;
+        shard->highways = (Highway *)calloc(shard->highway_capacity, sizeof(Highway));
+        if (shard->highways == NULL) {
+            printf("memory allocation error!\n");
+            exit(1);
+        }
+        mask = shard->highway_capacity - 1;
+        for (int i = 0; i < old_capacity; i++) {
+            if (old[i].engine != NULL) {
+                unsigned int slot = highway_hash(old[i].id) / shard->pool->shard_count & mask;
+                while (shard->highways[slot].engine != NULL) {
+                    slot = (slot + 1) & mask;
+                }
+                shard->highways[slot] = old[i];
+            }
+        }
+        free(old);
+        index = highway_hash(id) / shard->pool->shard_count & mask;
+        while (shard->highways[index].engine != NULL) {
+            index = (index + 1) & mask;
+        }
+    }
+
+    Engine *engine = (Engine *)malloc(sizeof(Engine));
+    if (engine == NULL) {
+        printf("memory allocation error!\n");
+        exit(1);
+    }
+    engine_init(engine, shard->pool->planner, shard->pool->cache_capacity);
+    route_cache_set_format(&engine->cache, shard->pool->format);
+    shard->highways[index].id = id;
+    shard->highways[index].engine = engine;
+    shard->highway_count++;
+    return engine;
+}
+
+void *shard_main(void *argument) {
+    Shard *shard = (Shard *)argument;
+    ShardPool *pool = shard->pool;
+    CommandArguments arguments = {0};
+    CommandKind kind;
+    int slot, id;
+
+    while (spsc_ring_pop(&shard->commands, &slot) && spsc_ring_pop(&shard->commands, &id) &&
+           reader_next_command(&shard->reader, &kind)) {
+        ShardTask *task = &pool->tasks[slot];
+        Engine *engine = shard_highway(shard, id);
+
+        if (kind != COMMAND_ADD_STATION) {
+            engine_flush_run(engine);
+        }
+        if (kind == COMMAND_STATS) {
+            flockfile(stderr);
+            fprintf(stderr, "highway %d:\n", id);
+            engine_report(engine, stderr);
+            funlockfile(stderr);
+        } else {
+            engine_execute(engine, kind, &shard->reader, &arguments, &task->answer);
+        }
+        shard->executed++;
+
+        __atomic_store_n(&task->done, true, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&pool->awaited, __ATOMIC_SEQ_CST) == slot) {
+            pthread_mutex_lock(&pool->lock);
+            pthread_cond_signal(&pool->done);
+            pthread_mutex_unlock(&pool->lock);
+        }
+    }
+    return NULL;
+}
+
+void shard_pool_count_allocations(const ShardPool *pool, QueryAllocations *allocations) {
+    for (int i = 0; i < pool->shard_count; i++) {
+        const Shard *shard = &pool->shards[i];
+        for (int j = 0; j < shard->highway_capacity; j++) {
+            if (shard->highways[j].engine != NULL) {
+                engine_count_allocations(shard->highways[j].engine, allocations);
+            }
+        }
+    }
+    for (int i = 0; i < SHARD_QUEUE_SIZE; i++) {
+        allocations->answers += pool->tasks[i].answer.allocations;
+    }
+}
+
+void shard_pool_report(const ShardPool *pool, FILE *stream) {
+    size_t highways = 0, executed = 0, stations = 0, hits = 0, misses = 0;
+
+    for (int i = 0; i < pool->shard_count; i++) {
+        const Shard *shard = &pool->shards[i];
+
+        highways += shard->highway_count;
+        executed += shard->executed;
+        for (int j = 0; j < shard->highway_capacity; j++) {
+            const Engine *engine = shard->highways[j].engine;
+            if (engine != NULL) {
+                stations += engine->tree.size;
+                hits += engine->cache.hits;
+                misses += engine->cache.misses;
+            }
+        }
+    }
+    fprintf(stream, "shards: %d threads, %zu highways, %zu stations, %zu commands executed, %zu stalls\n",
+            pool->shard_count, highways, stations, executed, pool->stalls);
+    fprintf(stream, "shard route caches: %zu hits, %zu misses\n", hits, misses);
+}
+
+void layer_pool_init(LayerPool *pool, int thread_count, int threshold) {
+    pool->thread_count = thread_count;
+    pool->threshold = threshold;
+    pool->reaches = NULL;
+    pool->reach_count = pool->reach_capacity = 0;
+    pool->task_count = 0;
+    pool->next_task = 0;
+    pool->running = 0;
+    pool->generation = 0;
+    pool->stop = false;
+    pool->sweeps = pool->layers = pool->tasks = pool->extracted = pool->allocations = 0;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    pool->threads = (pthread_t *)malloc(thread_count * sizeof(pthread_t));
+    if (pool->threads == NULL) {
+        printf("memory allocation error!\n");
+        exit(1);
+    }
+    for (int i = 1; i < thread_count; i++) {
+        if (pthread_create(&pool->threads[i], NULL, layer_worker_main, pool) != 0) {
+            printf("thread creation error!\n");
+            exit(1);
+        }
+    }
+}
+
+void layer_pool_destroy(LayerPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 1; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    free(pool->threads);
+    free(pool->reaches);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+}
+
+void layer_pool_extract(LayerPool *pool, const BPTree *tree, int first, int count, int *stations, int *autonomies) {
+    pool->tree = tree;
+    pool->first = first;
+    pool->count = count;
+    pool->extracted_stations = stations;
+    pool->extracted_autonomies = autonomies;
+    layer_pool_dispatch(pool, LAYER_PHASE_EXTRACT, (count + LAYER_POOL_CHUNK - 1) / LAYER_POOL_CHUNK);
+    pool->extracted += count;
+}
+
+void layer_pool_plan(LayerPool *pool, const StationRange *range, int start, int end, int *predecessors,
+                     OutputWriter *out) {
+    instrument_range(range->size);
+    if (range->size == 0) {
+        writer_write_no_route(out);
+        return;
+    }
+
+    if (start < end) {
+        if (layer_pool_forward_extent(pool, range, predecessors) == range->size - 1) {
+            path_print_route(range->stations, predecessors, 0, range->size - 1, out);
+        } else {
+            writer_write_no_route(out);
+        }
+    } else {
+        if (layer_pool_reverse_extent(pool, range, predecessors) == 0) {
+            path_print_route(range->stations, predecessors, range->size - 1, 0, out);
+        } else {
+            writer_write_no_route(out);
+        }
+    }
+}
+
+int layer_pool_forward_extent(LayerPool *pool, const StationRange *range, int *predecessors) {
+    int last = range->size - 1;
+
+    pool->stations = range->stations;
+    pool->autonomies = range->autonomies;
+    pool->predecessors = predecessors;
+    pool->forward = true;
+    pool->layer_low = pool->layer_high = 0;
+    pool->sweeps++;
+
+    while (pool->layer_high < last) {
+        long long reach = layer_pool_reach(pool);
+        int next_high = path_gallop_forward(range->stations, pool->layer_high + 1, last, reach) - 1;
+        if (next_high == pool->layer_high) {
+            break;
+        }
+
+        int tasks = (next_high - pool->layer_high - 1 + LAYER_POOL_CHUNK) / LAYER_POOL_CHUNK;
+        pool->next_low = pool->layer_high + 1;
+        pool->next_high = next_high;
+        if (tasks == 1) {
+            path_link_forward(range->stations, range->autonomies, predecessors, pool->layer_low, pool->next_low,
+                              next_high);
+        } else {
+            layer_pool_dispatch(pool, LAYER_PHASE_LINK, tasks);
+        }
+        pool->layer_low = pool->next_low;
+        pool->layer_high = next_high;
+        instrument_count(greedy_layers, 1);
+    }
+    return pool->layer_high;
+}
+
+int layer_pool_reverse_extent(LayerPool *pool, const StationRange *range, int *predecessors) {
+    pool->stations = range->stations;
+    pool->autonomies = range->autonomies;
+    pool->predecessors = predecessors;
+    pool->forward = false;
+    pool->layer_low = pool->layer_high = range->size - 1;
+    pool->sweeps++;
+
+    while (pool->layer_low > 0) {
+        long long reach = layer_pool_reach(pool);
+        int next_low = path_gallop_reverse(range->stations, pool->layer_low - 1, reach);
+        if (next_low == pool->layer_low) {
+            break;
+        }
+
+        int tasks = (pool->layer_low - 1 - next_low + LAYER_POOL_CHUNK) / LAYER_POOL_CHUNK;
+        pool->next_low = next_low;
+        pool->next_high = pool->layer_low - 1;
+        if (tasks == 1) {
+            path_link_reverse(range->stations, range->autonomies, predecessors, pool->layer_low, pool->next_high,
+                              next_low);
+        } else {
+            layer_pool_dispatch(pool, LAYER_PHASE_LINK, tasks);
+        }
+        pool->layer_high = pool->next_high;
+        pool->layer_low = next_low;
+        instrument_count(greedy_layers, 1);
+    }
+    return pool->layer_low;
+}
+
+long long layer_pool_reach(LayerPool *pool) {
+    int chunks = (pool->layer_high - pool->layer_low + LAYER_POOL_CHUNK) / LAYER_POOL_CHUNK;
+
+    if (chunks > pool->reach_capacity) {
+        int capacity = pool->reach_capacity * 2 > chunks ? pool->reach_capacity * 2 : chunks;
+        pool->reaches = (long long *)realloc(pool->reaches, capacity * sizeof(long long));
+        if (pool->reaches == NULL) {
+            printf("memory allocation error!\n");
+            exit(1);
+        }
+        pool->reach_capacity = capacity;
+        pool->allocations++;
+    }
+    pool->reach_count = chunks;
+    if (chunks == 1) {
+        const int *stations = pool->stations;
+        const int *autonomies = pool->autonomies;
+
+        pool->reaches[0] = pool->forward ? scan_kernels->max_reach(stations, autonomies, pool->layer_low, pool->layer_high)
+                                         : scan_kernels->min_reach(stations, autonomies, pool->layer_low, pool->layer_high);
+        return pool->reaches[0];
+    }
+    layer_pool_dispatch(pool, LAYER_PHASE_REACH, chunks);
+
+    long long *reaches = pool->reaches;
+    for (int i = 1; i < chunks; i++) {
+        if (pool->forward ? reaches[i] < reaches[i - 1] : reaches[i] > reaches[i - 1]) {
+            reaches[i] = reaches[i - 1];
+        }
+    }
+    pool->layers++;
+    return reaches[chunks - 1];
+}
+
+int layer_pool_first_chunk(const LayerPool *pool, int key) {
+    int low = 0;
+    int high = pool->reach_count - 1;
+
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (pool->forward ? pool->reaches[middle] >= key : pool->reaches[middle] <= key) {
+            high = middle;
+        } else {
+            low = middle + 1;
+        }
+    }
+    return low;
+}
+
+void layer_pool_dispatch(LayerPool *pool, LayerPhase phase, int task_count) {
+    pool->phase = phase;
+    pool->task_count = task_count;
+    pool->next_task = 0;
+
+    if (task_count == 1) {
+        layer_pool_work(pool);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->running = pool->thread_count - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    layer_pool_work(pool);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->running > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    pool->tasks += task_count;
+}
+
+void layer_pool_work(LayerPool *pool) {
+    const int *stations = pool->stations;
+    const int *autonomies = pool->autonomies;
+    int task;
+
+    while ((task = __atomic_fetch_add(&pool->next_task, 1, __ATOMIC_RELAXED)) < pool->task_count) {
+        if (pool->phase == LAYER_PHASE_EXTRACT) {
+            int offset = task * LAYER_POOL_CHUNK;
+            int count = pool->count - offset < LAYER_POOL_CHUNK ? pool->count - offset : LAYER_POOL_CHUNK;
+            int slot;
+            const BPTreeNode *leaf = bptree_select(pool->tree, pool->first + offset, &slot);
+
+            bptree_leaf_copy(leaf, slot, count, pool->extracted_stations + offset,
+                             pool->extracted_autonomies + offset);
+        } else if (pool->phase == LAYER_PHASE_REACH) {
+            int low = pool->layer_low + task * LAYER_POOL_CHUNK;
+            int high = low + LAYER_POOL_CHUNK - 1 < pool->layer_high ? low + LAYER_POOL_CHUNK - 1 : pool->layer_high;
+
+            pool->reaches[task] = pool->forward ? scan_kernels->max_reach(stations, autonomies, low, high)
+                                                : scan_kernels->min_reach(stations, autonomies, low, high);
+        } else if (pool->forward) {
+            int low = pool->next_low + task * LAYER_POOL_CHUNK;
+            int high = low + LAYER_POOL_CHUNK - 1 < pool->next_high ? low + LAYER_POOL_CHUNK - 1 : pool->next_high;
+            int from = pool->layer_low + layer_pool_first_chunk(pool, stations[low]) * LAYER_POOL_CHUNK;
+
+            path_link_forward(stations, autonomies, pool->predecessors, from, low, high);
+        } else {
+            int high = pool->next_high - task * LAYER_POOL_CHUNK;
+            int low = high - LAYER_POOL_CHUNK + 1 > pool->next_low ? high - LAYER_POOL_CHUNK + 1 : pool->next_low;
+            int from = pool->layer_low + layer_pool_first_chunk(pool, stations[high]) * LAYER_POOL_CHUNK;
+
+            path_link_reverse(stations, autonomies, pool->predecessors, from, high, low);
+        }
+    }
+}
+
+void *layer_worker_main(void *argument) {
+    LayerPool *pool = (LayerPool *)argument;
+    unsigned int generation = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        while (pool->generation == generation && !pool->stop) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        if (pool->stop) {
+            break;
+        }
+        generation = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        layer_pool_work(pool);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->running == 0) {
+            pthread_cond_signal(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+void layer_pool_report(const LayerPool *pool, FILE *stream) {
+    fprintf(stream, "layer pool: %zu sweeps on %d threads from %d stations, %zu layers split, %zu chunks, "
+            "%zu stations extracted\n", pool->sweeps, pool->thread_count, pool->threshold, pool->layers, pool->tasks,
+            pool->extracted);
+}
+
+void path_calculate(const StationRange *range, int start, int end, Workspace *workspace, OutputWriter *out) {
+    const int *stations = range->stations;
+    const int *autonomies = range->autonomies;
+    int size = range->size;
+
+    if (size == 0) {
+        writer_write_no_route(out);
+        return;
+    }
+
+    workspace_reserve_search(workspace, size);
+    bool *visited = workspace->visited;
+    int *predecessors = workspace->predecessors;
+    int *frontier = workspace->frontier;
+    int head = 0;
+    int tail = 0;
+
+    for (int i = 0; i < size; i++) {
+        visited[i] = false;
+        predecessors[i] = -1;
+    }
+
+    visited[0] = true;
+    predecessors[0] = 0;
+    frontier[tail++] = 0;
+
+    while (head < tail) {
+        int from_index = frontier[head++];
+
+        if (start > end) {
+            for (int block = from_index + 1; block < size; block += SCAN_MASK_WIDTH) {
+                int count = size - block < SCAN_MASK_WIDTH ? size - block : SCAN_MASK_WIDTH;
+                unsigned int mask = scan_kernels->reverse_mask(stations, autonomies, stations[from_index], block, count);
+                while (mask != 0) {
+                    int j = block + __builtin_ctz(mask);
+                    mask &= mask - 1;
+                    if (visited[j] == false) {
+                        predecessors[j] = from_index;
+                        frontier[tail++] = j;
+                        visited[j] = true;
+                        instrument_count(bfs_enqueues, 1);
+                    }
+                }
+            }
+        } else {
+            long long reach = (long long)stations[from_index] + autonomies[from_index];
+            int extent = scan_kernels->forward_extent(stations, from_index + 1, size - 1, reach);
+            for (int j = from_index + 1; j < extent; j++) {
+                if (visited[j] == false) {
+                    predecessors[j] = from_index;
+                    frontier[tail++] = j;
+                    visited[j] = true;
+                    instrument_count(bfs_enqueues, 1);
+                }
+            }
+        }
+    }
+
+    if (visited[size - 1] == false) {
+        writer_write_no_route(out);
+    } else if (start > end) {
+        path_print_reverse2(stations, predecessors, size, out);
+    } else {
+        path_print_reverse(stations, predecessors, size, out);
+    }
+}
+
+void path_plan(const StationRange *range, int start, int end, PlannerKind planner, Workspace *workspace, OutputWriter *out) {
+    instrument_range(range->size);
+    if (planner == PLANNER_BFS) {
+        path_calculate(range, start, end, workspace, out);
+        return;
+    }
+    if (range->size == 0) {
+        writer_write_no_route(out);
+        return;
+    }
+
+    int *predecessors = workspace->predecessors;
+
+    if (start < end) {
+        if (path_plan_forward(range, predecessors)) {
+            path_print_route(range->stations, predecessors, 0, range->size - 1, out);
+        } else {
+            writer_write_no_route(out);
+        }
+    } else {
+        if (path_plan_reverse(range, predecessors)) {
+            path_print_route(range->stations, predecessors, range->size - 1, 0, out);
+        } else {
+            writer_write_no_route(out);
+        }
+    }
+}
+
+bool path_plan_forward(const StationRange *range, int *predecessors) {
+    return path_plan_forward_extent(range, predecessors) == range->size - 1;
+}
+
+int path_plan_forward_extent(const StationRange *range, int *predecessors) {
+    const int *stations = range->stations;
+    const int *autonomies = range->autonomies;
+    int last = range->size - 1;
+    int layer_low = 0;
+    int layer_high = 0;
+
+    while (layer_high < last) {
+        long long reach = scan_kernels->max_reach(stations, autonomies, layer_low, layer_high);
+        int next_high = scan_kernels->forward_extent(stations, layer_high + 1, last, reach) - 1;
+        if (next_high == layer_high) {
+            break;
+        }
+
+        path_link_forward(stations, autonomies, predecessors, layer_low, layer_high + 1, next_high);
+        layer_low = layer_high + 1;
+        instrument_count(greedy_layers, 1);
+        layer_high = next_high;
+    }
+    return layer_high;
+}
+
+bool path_plan_reverse(const StationRange *range, int *predecessors) {
+    return path_plan_reverse_extent(range, predecessors) == 0;
+}
+
+int path_plan_reverse_extent(const StationRange *range, int *predecessors) {
+    const int *stations = range->stations;
+    const int *autonomies = range->autonomies;
+    int layer_low = range->size - 1;
+    int layer_high = range->size - 1;
+
+    while (layer_low > 0) {
+        long long reach = scan_kernels->min_reach(stations, autonomies, layer_low, layer_high);
+        int next_low = scan_kernels->reverse_extent(stations, layer_low - 1, reach);
+        if (next_low == layer_low) {
+            break;
+        }
+
+        path_link_reverse(stations, autonomies, predecessors, layer_low, layer_low - 1, next_low);
+        layer_high = layer_low - 1;
+        instrument_count(greedy_layers, 1);
+        layer_low = next_low;
+    }
+    return layer_low;
+}
+
+int path_find_station(const StationRange *range, int key) {
+    int low = 0;
+    int high = range->size;
+
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (range->stations[middle] < key) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low < range->size && range->stations[low] == key ? low : -1;
+}
+
+int path_lower_index(const int *stations, int low, int high, long long key) {
+    high++;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (stations[middle] < key) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+int path_gallop_forward(const int *stations, int from, int last, long long reach) {
+    int bound = last - from >= LAYER_POOL_CHUNK ? from + LAYER_POOL_CHUNK - 1 : last;
+    int extent = scan_kernels->forward_extent(stations, from, bound, reach);
+
+    return extent <= bound ? extent : path_lower_index(stations, bound + 1, last, reach + 1);
+}
+
+int path_gallop_reverse(const int *stations, int from, long long reach) {
+    int base = from >= LAYER_POOL_CHUNK ? from - LAYER_POOL_CHUNK + 1 : 0;
+    int extent = base + scan_kernels->reverse_extent(stations + base, from - base, reach);
+
+    return extent > base ? extent : path_lower_index(stations, 0, base - 1, reach);
+}
+
+void path_link_forward(const int *stations, const int *autonomies, int *predecessors, int from, int low, int high) {
+    for (int j = low; j <= high; j++) {
+        while ((long long)stations[from] + autonomies[from] < stations[j]) {
+            from++;
+        }
+        predecessors[j] = from;
+    }
+}
+
+void path_link_reverse(const int *stations, const int *autonomies, int *predecessors, int from, int high, int low) {
+    for (int j = high; j >= low; j--) {
+        while ((long long)stations[from] - autonomies[from] > stations[j]) {
+            from++;
+        }
+        predecessors[j] = from;
+    }
+}
+
+long long scan_max_reach_scalar(const int *stations, const int *autonomies, int low, int high) {
+    long long reach = LLONG_MIN;
+
+    for (int i = low; i <= high; i++) {
+        long long station_reach = (long long)stations[i] + autonomies[i];
+        if (station_reach > reach) {
+            reach = station_reach;
+        }
+    }
+    return reach;
+}
+
+long long scan_min_reach_scalar(const int *stations, const int *autonomies, int low, int high) {
+    long long reach = LLONG_MAX;
+
+    for (int i = low; i <= high; i++) {
+        long long station_reach = (long long)stations[i] - autonomies[i];
+        if (station_reach < reach) {
+            reach = station_reach;
+        }
+    }
+    return reach;
+}
+
+int scan_forward_extent_scalar(const int *stations, int from, int last, long long reach) {
+    while (from <= last && stations[from] <= reach) {
+        from++;
+    }
+    return from;
+}
 
-/**
- * @brief Prints the path in reverse order (alternate version).
- * @param stations Array of station keys.
- * @param predecessors Array of predecessors.
- * @param size Size of the arrays.
- */
-void path_print_reverse2(const int *stations, const unsigned short *predecessors, int size);
+int scan_reverse_extent_scalar(const int *stations, int from, long long reach) {
+    while (from >= 0 && stations[from] >= reach) {
+        from--;
+    }
+    return from + 1;
+}
 
-// -------------------------------------------------------------------- Functions declaration --------------------------------------------------------------------
+unsigned int scan_reverse_mask_scalar(const int *stations, const int *autonomies, int base, int from, int count) {
+    unsigned int mask = 0;
 
-// ----------------------------------------------------------------------------- Main ----------------------------------------------------------------------------
+    for (int i = 0; i < count; i++) {
+        if (autonomies[from + i] >= stations[from + i] - base) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+}
 
-int main() {
-    char command[20];
-    int heap_size, element, start, end, key;
-    TreeNode *root = NULL;
+#ifdef SCAN_KERNELS_X86
+__attribute__((target("sse4.2")))
+long long scan_max_reach_sse4(const int *stations, const int *autonomies, int low, int high) {
+    __m128i best = _mm_set1_epi64x(LLONG_MIN);
+    long long lanes[2];
+    int i = low;
 
-    while (scanf("%s", command) == 1) {
+    for (; i + 1 <= high; i += 2) {
+        __m128i keys = _mm_cvtepi32_epi64(_mm_loadl_epi64((const __m128i *)(stations + i)));
+        __m128i cars = _mm_cvtepi32_epi64(_mm_loadl_epi64((const __m128i *)(autonomies + i)));
+        __m128i reach = _mm_add_epi64(keys, cars);
+        best = _mm_blendv_epi8(best, reach, _mm_cmpgt_epi64(reach, best));
+    }
+    _mm_storeu_si128((__m128i *)lanes, best);
 
-        if (strcmp(command, "aggiungi-stazione") == 0) {
-            (void) !scanf("%d", &key);
-            (void) !scanf("%d", &heap_size);
+    long long tail = scan_max_reach_scalar(stations, autonomies, i, high);
+    long long reach = lanes[0] > lanes[1] ? lanes[0] : lanes[1];
+    return tail > reach ? tail : reach;
+}
 
-            int *elements = (int *)malloc(heap_size * sizeof(int));
-            for (int i = 0; i < heap_size; i++) {
-                (void) !scanf("%d", &element);
-                elements[i] = element;
-            }
-            MaxHeap *max_heap = max_heap_create(heap_size, elements);
-            root = tree_insert_node(root, key, max_heap);
+__attribute__((target("sse4.2")))
+long long scan_min_reach_sse4(const int *stations, const int *autonomies, int low, int high) {
+    __m128i best = _mm_set1_epi64x(LLONG_MAX);
+    long long lanes[2];
+    int i = low;
 
-            free(elements);
+    for (; i + 1 <= high; i += 2) {
+        __m128i keys = _mm_cvtepi32_epi64(_mm_loadl_epi64((const __m128i *)(stations + i)));
+        __m128i cars = _mm_cvtepi32_epi64(_mm_loadl_epi64((const __m128i *)(autonomies + i)));
+        __m128i reach = _mm_sub_epi64(keys, cars);
+        best = _mm_blendv_epi8(best, reach, _mm_cmpgt_epi64(best, reach));
+    }
+    _mm_storeu_si128((__m128i *)lanes, best);
+
+    long long tail = scan_min_reach_scalar(stations, autonomies, i, high);
+    long long reach = lanes[0] < lanes[1] ? lanes[0] : lanes[1];
+    return tail < reach ? tail : reach;
+}
 
-        } else if (strcmp(command, "demolisci-stazione") == 0) {
-            (void) !scanf("%d", &key);
+__attribute__((target("sse4.2")))
+int scan_forward_extent_sse4(const int *stations, int from, int last, long long reach) {
+    if (reach >= INT_MAX) {
+        return last + 1;
+    }
+    if (reach < INT_MIN) {
+        return from;
+    }
 
-            root = tree_remove_node(root, key);
+    __m128i bound = _mm_set1_epi32((int)reach);
+    for (; from + 3 <= last; from += 4) {
+        __m128i keys = _mm_loadu_si128((const __m128i *)(stations + from));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(keys, bound)));
+        if (mask != 0) {
+            return from + __builtin_ctz(mask);
+        }
+    }
+    return scan_forward_extent_scalar(stations, from, last, reach);
+}
 
-        } else if (strcmp(command, "aggiungi-auto") == 0) {
-            (void) !scanf("%d", &key);
-            (void) !scanf("%d", &element);
+__attribute__((target("sse4.2")))
+int scan_reverse_extent_sse4(const int *stations, int from, long long reach) {
+    if (reach > INT_MAX) {
+        return from + 1;
+    }
+    if (reach <= INT_MIN) {
+        return 0;
+    }
 
-            TreeNode *temp_node = tree_search_node(root, key);
+    __m128i bound = _mm_set1_epi32((int)reach);
+    for (; from >= 3; from -= 4) {
+        __m128i keys = _mm_loadu_si128((const __m128i *)(stations + from - 3));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(keys, bound)));
+        if (mask != 0) {
+            return from - 3 + (31 - __builtin_clz(mask)) + 1;
+        }
+    }
+    return scan_reverse_extent_scalar(stations, from, reach);
+}
 
-            if (temp_node == NULL) {
-                printf("non aggiunta\n");
-            } else {
-                max_heap_insert(temp_node->cars, element);
-                printf("aggiunta\n");
-            }
+__attribute__((target("sse4.2")))
+unsigned int scan_reverse_mask_sse4(const int *stations, const int *autonomies, int base, int from, int count) {
+    __m128i origin = _mm_set1_epi32(base);
+    unsigned int mask = 0;
+    int i = 0;
 
-        } else if (strcmp(command, "rottama-auto") == 0) {
-            (void) !scanf("%d", &key);
-            (void) !scanf("%d", &element);
+    for (; i + 4 <= count; i += 4) {
+        __m128i distances = _mm_sub_epi32(_mm_loadu_si128((const __m128i *)(stations + from + i)), origin);
+        __m128i cars = _mm_loadu_si128((const __m128i *)(autonomies + from + i));
+        unsigned int missed = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(distances, cars)));
+        mask |= (~missed & 0xfu) << i;
+    }
+    if (i < count) {
+        mask |= scan_reverse_mask_scalar(stations, autonomies, base, from + i, count - i) << i;
+    }
+    return mask;
+}
 
-            TreeNode *temp_node = tree_search_node(root, key);
+__attribute__((target("avx2")))
+long long scan_max_reach_avx2(const int *stations, const int *autonomies, int low, int high) {
+    __m256i best = _mm256_set1_epi64x(LLONG_MIN);
+    __m256i other = best;
+    long long lanes[4];
+    int i = low;
 
-            if (temp_node == NULL) {
-                printf("non rottamata\n");
-            } else {
-                max_heap_remove(temp_node->cars, element);
-            }
+    for (; i + 7 <= high; i += 8) {
+        __m256i keys = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)(stations + i)));
+        __m256i cars = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)(autonomies + i)));
+        __m256i reach = _mm256_add_epi64(keys, cars);
+        best = _mm256_blendv_epi8(best, reach, _mm256_cmpgt_epi64(reach, best));
 
-        } else if (strcmp(command, "pianifica-percorso") == 0) {
-            (void) !scanf("%d", &start);
-            (void) !scanf("%d", &end);
-            if (start == end) {
-                printf("%d\n", start);
-            } else {
-                int max_size = abs(end - start);
-                int *stations = (int *)malloc((max_size) * sizeof(int));
-                int *autonomies = (int *)malloc((max_size) * sizeof(int));
-                int count = 0;
+        keys = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)(stations + i + 4)));
+        cars = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)(autonomies + i + 4)));
+        reach = _mm256_add_epi64(keys, cars);
+        other = _mm256_blendv_epi8(other, reach, _mm256_cmpgt_epi64(reach, other));
+    }
+    best = _mm256_blendv_epi8(best, other, _mm256_cmpgt_epi64(other, best));
+    _mm256_storeu_si256((__m256i *)lanes, best);
 
-                path_array_create(root, start, end, stations, autonomies, &count);
-                path_calculate(stations, autonomies, count, start, end);
-            }
+    long long reach = scan_max_reach_scalar(stations, autonomies, i, high);
+    for (int lane = 0; lane < 4; lane++) {
+        if (lanes[lane] > reach) {
+            reach = lanes[lane];
         }
     }
-    return 0;
+    return reach;
 }
 
-// ----------------------------------------------------------------------------- Main ----------------------------------------------------------------------------
+__attribute__((target("avx2")))
+long long scan_min_reach_avx2(const int *stations, const int *autonomies, int low, int high) {
+    __m256i best = _mm256_set1_epi64x(LLONG_MAX);
+    __m256i other = best;
+    long long lanes[4];
+    int i = low;
 
-// ------------------------------------------------------------------- Functions implementation ------------------------------------------------------------------
+    for (; i + 7 <= high; i += 8) {
+        __m256i keys = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)(stations + i)));
+        __m256i cars = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)(autonomies + i)));
+        __m256i reach = _mm256_sub_epi64(keys, cars);
+        best = _mm256_blendv_epi8(best, reach, _mm256_cmpgt_epi64(best, reach));
 
-MaxHeap *max_heap_create(int size, const int *elements) {
-    MaxHeap *max_heap = (MaxHeap *)malloc(sizeof(MaxHeap));
+        keys = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)(stations + i + 4)));
+        cars = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)(autonomies + i + 4)));
+        reach = _mm256_sub_epi64(keys, cars);
+        other = _mm256_blendv_epi8(other, reach, _mm256_cmpgt_epi64(other, reach));
+    }
+    best = _mm256_blendv_epi8(best, other, _mm256_cmpgt_epi64(best, other));
+    _mm256_storeu_si256((__m256i *)lanes, best);
 
-    if (max_heap == NULL) {
-        printf("memory allocation error!");
-        return NULL;
+    long long reach = scan_min_reach_scalar(stations, autonomies, i, high);
+    for (int lane = 0; lane < 4; lane++) {
+        if (lanes[lane] < reach) {
+            reach = lanes[lane];
+        }
     }
-    max_heap->size = 0;
-    max_heap->elements = (int *)malloc(MAX_CARS * sizeof(int));
+    return reach;
+}
 
-    if (max_heap->elements == NULL) {
-        printf("memory allocation error!");
-        return NULL;
+__attribute__((target("avx2")))
+int scan_forward_extent_avx2(const int *stations, int from, int last, long long reach) {
+    if (reach >= INT_MAX) {
+        return last + 1;
+    }
+    if (reach < INT_MIN) {
+        return from;
     }
 
-    for (int i = 0; i < size; i++) {
-        max_heap_insert(max_heap, elements[i]);
+    __m256i bound = _mm256_set1_epi32((int)reach);
+    for (; from + 7 <= last; from += 8) {
+        __m256i keys = _mm256_loadu_si256((const __m256i *)(stations + from));
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(keys, bound)));
+        if (mask != 0) {
+            return from + __builtin_ctz(mask);
+        }
     }
-    return max_heap;
+    return scan_forward_extent_scalar(stations, from, last, reach);
 }
 
-void max_heapify_bottom_up(MaxHeap *max_heap, int index) {
-    int parent_index = (index - 1) / 2;
-
-    if (max_heap->elements[parent_index] < max_heap->elements[index]) {
-        int temp_element = max_heap->elements[parent_index];
-        max_heap->elements[parent_index] = max_heap->elements[index];
-        max_heap->elements[index] = temp_element;
+__attribute__((target("avx2")))
+int scan_reverse_extent_avx2(const int *stations, int from, long long reach) {
+    if (reach > INT_MAX) {
+        return from + 1;
+    }
+    if (reach <= INT_MIN) {
+        return 0;
+    }
 
-        max_heapify_bottom_up(max_heap, parent_index);
+    __m256i bound = _mm256_set1_epi32((int)reach);
+    for (; from >= 7; from -= 8) {
+        __m256i keys = _mm256_loadu_si256((const __m256i *)(stations + from - 7));
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(bound, keys)));
+        if (mask != 0) {
+            return from - 7 + (31 - __builtin_clz(mask)) + 1;
+        }
     }
+    return scan_reverse_extent_scalar(stations, from, reach);
 }
 
-void max_heapify_top_down(MaxHeap *max_heap, int index) {
-    int left = index * 2 + 1;
-    int right = index * 2 + 2;
-    int max = index;
+__attribute__((target("avx2")))
+unsigned int scan_reverse_mask_avx2(const int *stations, const int *autonomies, int base, int from, int count) {
+    __m256i origin = _mm256_set1_epi32(base);
+    unsigned int mask = 0;
+    int i = 0;
 
-    if (left >= max_heap->size || left < 0) {
-        left = -1;
+    for (; i + 8 <= count; i += 8) {
+        __m256i distances = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)(stations + from + i)), origin);
+        __m256i cars = _mm256_loadu_si256((const __m256i *)(autonomies + from + i));
+        unsigned int missed = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(distances, cars)));
+        mask |= (~missed & 0xffu) << i;
     }
-    if (right >= max_heap->size || right < 0) {
-        right = -1;
+    if (i < count) {
+        mask |= scan_reverse_mask_scalar(stations, autonomies, base, from + i, count - i) << i;
     }
+    return mask;
+}
+#endif
+
+const ScanKernels *scan_kernels_select(const char *name) {
+    static const ScanKernels scalar = {"scalar", scan_max_reach_scalar, scan_min_reach_scalar,
+                                       scan_forward_extent_scalar, scan_reverse_extent_scalar,
+                                       scan_reverse_mask_scalar};
+#ifdef SCAN_KERNELS_X86
+    static const ScanKernels sse4 = {"sse4", scan_max_reach_sse4, scan_min_reach_sse4, scan_forward_extent_sse4,
+                                     scan_reverse_extent_sse4, scan_reverse_mask_sse4};
+    static const ScanKernels avx2 = {"avx2", scan_max_reach_avx2, scan_min_reach_avx2, scan_forward_extent_avx2,
+                                     scan_reverse_extent_avx2, scan_reverse_mask_avx2};
+
+    __builtin_cpu_init();
+    bool has_avx2 = __builtin_cpu_supports("avx2");
+    bool has_sse4 = __builtin_cpu_supports("sse4.2");
 
-    if (left != -1 && max_heap->elements[left] > max_heap->elements[max]) {
-        max = left;
+    if (name == NULL) {
+        return has_avx2 ? &avx2 : has_sse4 ? &sse4 : &scalar;
     }
-    if (right != -1 && max_heap->elements[right] > max_heap->elements[max]) {
-        max = right;
+    if (strcmp(name, "avx2") == 0) {
+        return has_avx2 ? &avx2 : NULL;
     }
+    if (strcmp(name, "sse4") == 0) {
+        return has_sse4 ? &sse4 : NULL;
+    }
+#endif
+    if (name == NULL || strcmp(name, "scalar") == 0) {
+        return &scalar;
+    }
+    return NULL;
+}
 
-    if (max != index) {
-        int temp_element = max_heap->elements[max];
-        max_heap->elements[max] = max_heap->elements[index];
-        max_heap->elements[index] = temp_element;
+void scan_kernels_benchmark(FILE *stream) {
+    const char *names[] = {"scalar", "sse4", "avx2"};
+    int size = 1000000;
+    int *stations = (int *)malloc(size * sizeof(int));
+    int *autonomies = (int *)malloc(size * sizeof(int));
+    unsigned int seed = 1;
 
-        max_heapify_top_down(max_heap, max);
+    if (stations == NULL || autonomies == NULL) {
+        printf("memory allocation error!\n");
+        exit(1);
+    }
+    for (int i = 0, key = 0; i < size; i++) {
+        seed = seed * 1103515245u + 12345u;
+        key += 1 + (seed >> 16) % 16;
+        stations[i] = key;
+        autonomies[i] = (seed >> 8) % 64;
     }
-}
 
-int max_heap_get_index(MaxHeap *max_heap, int element) {
-    for (int i = 0; i < max_heap->size; i++) {
-        if (max_heap->elements[i] == element) {
-            return i;
+    fprintf(stream, "%-8s %10s %14s %14s %14s\n", "kernels", "stations", "reach ns/st", "extent ns/st", "mask ns/st");
+    for (int n = 1000; n <= size; n *= 10) {
+        for (int k = 0; k < 3; k++) {
+            const ScanKernels *kernels = scan_kernels_select(names[k]);
+            int rounds = 10000000 / n;
+            long long checksum = 0;
+            double timings[3];
+
+            if (kernels == NULL) {
+                continue;
+            }
+            for (int test = 0; test < 3; test++) {
+                struct timespec begin, finish;
+                clock_gettime(CLOCK_MONOTONIC, &begin);
+                for (int round = 0; round < rounds; round++) {
+                    if (test == 0) {
+                        checksum += kernels->max_reach(stations, autonomies, 0, n - 1);
+                        checksum += kernels->min_reach(stations, autonomies, 0, n - 1);
+                    } else if (test == 1) {
+                        checksum += kernels->forward_extent(stations, 0, n - 1, stations[n - 1]);
+                        checksum += kernels->reverse_extent(stations, n - 1, stations[0]);
+                    } else {
+                        for (int block = 0; block < n; block += SCAN_MASK_WIDTH) {
+                            int count = n - block < SCAN_MASK_WIDTH ? n - block : SCAN_MASK_WIDTH;
+                            checksum += kernels->reverse_mask(stations, autonomies, stations[0], block, count);
+                        }
+                    }
+                }
+                clock_gettime(CLOCK_MONOTONIC, &finish);
+                timings[test] = ((finish.tv_sec - begin.tv_sec) * 1e9 + (finish.tv_nsec - begin.tv_nsec)) /
+                                ((double)rounds * n);
+            }
+            fprintf(stream, "%-8s %10d %14.3f %14.3f %14.3f   (checksum %lld)\n", kernels->name, n, timings[0],
+                    timings[1], timings[2], checksum);
         }
     }
-    return -1;
+    free(stations);
+    free(autonomies);
 }
 
-int max_heap_get_parent(int index) {
-    if (index % 2 == 0) {
-        return (index / 2) - 1;
-    } else {
-        return (index / 2);
-    }
+unsigned long long latency_now() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ull + now.tv_nsec;
 }
 
-void max_heap_move_up(MaxHeap *max_heap, int index) {
-    if (index == 0) {
-        return;
+int latency_bucket(unsigned long long nanoseconds) {
+    if (nanoseconds < LATENCY_SUB_BUCKETS) {
+        return (int)nanoseconds;
     }
 
-    int parent_index = max_heap_get_parent(index);
+    int exponent = 63 - __builtin_clzll(nanoseconds);
+    int sub_bucket = (int)(nanoseconds >> (exponent - 4)) & (LATENCY_SUB_BUCKETS - 1);
+    return (exponent - 3) * LATENCY_SUB_BUCKETS + sub_bucket;
+}
 
-    if (max_heap->elements[parent_index] < max_heap->elements[index]) {
-        int temp = max_heap->elements[parent_index];
-        max_heap->elements[parent_index] = max_heap->elements[index];
-        max_heap->elements[index] = temp;
-        max_heap_move_up(max_heap, parent_index);
+void latency_record(LatencyHistogram *histogram, unsigned long long nanoseconds) {
+    histogram->counts[latency_bucket(nanoseconds)]++;
+    histogram->samples++;
+    histogram->total += nanoseconds;
+    if (nanoseconds > histogram->max) {
+        histogram->max = nanoseconds;
     }
 }
 
-void max_heap_insert(MaxHeap *max_heap, int element) {
-    if (max_heap->size < MAX_CARS) {
-        max_heap->elements[max_heap->size] = element;
-
-        max_heapify_bottom_up(max_heap, max_heap->size);
+unsigned long long latency_percentile(const LatencyHistogram *histogram, double fraction) {
+    unsigned long long rank = (unsigned long long)(fraction * histogram->samples);
+    unsigned long long seen = 0;
 
-        max_heap->size++;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen > rank) {
+            if (i < LATENCY_SUB_BUCKETS) {
+                return i;
+            }
+            int exponent = i / LATENCY_SUB_BUCKETS + 3;
+            return (unsigned long long)(LATENCY_SUB_BUCKETS + i % LATENCY_SUB_BUCKETS) << (exponent - 4);
+        }
     }
+    return histogram->max;
 }
 
-void max_heap_remove(MaxHeap *max_heap, int element) {
-    int index = max_heap_get_index(max_heap, element);
+void latency_report(const LatencyHistogram *histograms, unsigned long long elapsed, FILE *stream) {
+    const char *names[COMMAND_UNKNOWN + 1] = {"aggiungi-stazione", "demolisci-stazione", "aggiungi-auto",
+                                              "rottama-auto", "pianifica-percorso", "pianifica-percorsi", "salva",
+                                              "carica", "statistiche", "unknown"};
+    unsigned long long commands = 0;
 
-    if (index > -1) {
-        printf("rottamata\n");
-        max_heap->elements[index] = max_heap->elements[max_heap->size - 1];
-        max_heap->size--;
-        int parent_index = max_heap_get_parent(index);
-        if (index == 0 || max_heap->elements[index] < max_heap->elements[parent_index]) {
-            max_heapify_top_down(max_heap, index);
-        } else {
-            max_heap_move_up(max_heap, index);
+    fprintf(stream, "%-20s %10s %12s %10s %10s %10s %10s %10s\n", "command", "count", "ops/s", "p50 ns", "p90 ns",
+            "p99 ns", "p99.9 ns", "max ns");
+    for (int kind = 0; kind <= COMMAND_UNKNOWN; kind++) {
+        const LatencyHistogram *histogram = &histograms[kind];
+        if (histogram->samples == 0) {
+            continue;
         }
-    } else {
-        printf("non rottamata\n");
+        fprintf(stream, "%-20s %10llu %12.0f %10llu %10llu %10llu %10llu %10llu\n", names[kind], histogram->samples,
+                histogram->samples * 1e9 / (histogram->total > 0 ? histogram->total : 1),
+                latency_percentile(histogram, 0.5), latency_percentile(histogram, 0.9),
+                latency_percentile(histogram, 0.99), latency_percentile(histogram, 0.999), histogram->max);
+        commands += histogram->samples;
+    }
+    fprintf(stream, "total: %llu commands in %.3f s, %.0f commands/s\n", commands, elapsed / 1e9,
+            commands * 1e9 / (elapsed > 0 ? elapsed : 1));
+}
+
+#ifdef PATHFINDER_INSTRUMENT
+void instrument_record_range(int size) {
+    LatencyHistogram *histogram = &instrumentation.ranges;
+    unsigned long long value = size;
+    unsigned long long max = __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+
+    __atomic_fetch_add(&histogram->counts[latency_bucket(value)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->samples, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->total, value, __ATOMIC_RELAXED);
+    while (value > max &&
+           !__atomic_compare_exchange_n(&histogram->max, &max, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
     }
 }
+#endif
 
-TreeNode *tree_create_node(int key, MaxHeap *car_heap) {
-    TreeNode *temp_node = (TreeNode *)malloc(sizeof(TreeNode));
-    temp_node->key = key;
-    temp_node->left = temp_node->right = NULL;
-    temp_node->cars = car_heap;
-    return temp_node;
+void instrumentation_report(FILE *stream) {
+#ifdef PATHFINDER_INSTRUMENT
+    const Instrumentation *counters = &instrumentation;
+    const LatencyHistogram *ranges = &counters->ranges;
+
+    fprintf(stream, "tree: %llu lookups, %.2f nodes per lookup\n", counters->tree_lookups,
+            counters->tree_lookups > 0 ? (double)counters->tree_nodes / counters->tree_lookups : 0.0);
+    fprintf(stream, "fleets: %llu searches, %.2f probes per search\n", counters->fleet_searches,
+            counters->fleet_searches > 0 ? (double)counters->fleet_probes / counters->fleet_searches : 0.0);
+    fprintf(stream, "planners: %llu breadth-first enqueues, %llu greedy layers\n", counters->bfs_enqueues,
+            counters->greedy_layers);
+    fprintf(stream, "ranges: %llu planned, %.1f stations on average, p50 %llu, p99 %llu, max %llu\n", ranges->samples,
+            ranges->samples > 0 ? (double)ranges->total / ranges->samples : 0.0, latency_percentile(ranges, 0.5),
+            latency_percentile(ranges, 0.99), ranges->max);
+#else
+    fprintf(stream, "instrumentation: not compiled in, build with -DPATHFINDER_INSTRUMENT\n");
+#endif
 }
 
-TreeNode *tree_get_min_node(TreeNode *root) {
-    TreeNode *temp_node = root;
+void stats_report(const Engine *engine, const BatchRunner *runner, const ReaderPool *readers, const Pipeline *pipeline,
+                  const ShardPool *shards, const LatencyHistogram *latencies, unsigned long long elapsed,
+                  size_t answers, FILE *stream) {
+    QueryAllocations allocations = {0};
 
-    while (temp_node->left != NULL) {
-        temp_node = temp_node->left;
+    engine_report(engine, stream);
+    engine_count_allocations(engine, &allocations);
+    allocations.answers += answers;
+    if (runner != NULL) {
+        batch_runner_report(runner, stream);
+        batch_runner_count_allocations(runner, &allocations);
+    }
+    if (readers != NULL) {
+        reader_pool_report(readers, stream);
+        reader_pool_count_allocations(readers, &allocations);
     }
+    if (pipeline != NULL) {
+        pipeline_report(pipeline, stream);
+    }
+    if (shards != NULL) {
+        shard_pool_report(shards, stream);
+        shard_pool_count_allocations(shards, &allocations);
+    }
+    fprintf(stream,
+            "query allocations: %zu in total, %zu workspaces, %zu route cache slabs, %zu jump tables, %zu answers, "
+            "%zu thread buffers\n",
+            allocations.workspaces + allocations.route_cache + allocations.jump_tables + allocations.answers +
+                allocations.threads,
+            allocations.workspaces, allocations.route_cache, allocations.jump_tables, allocations.answers,
+            allocations.threads);
+    if (latencies != NULL) {
+        latency_report(latencies, elapsed, stream);
+    }
+    instrumentation_report(stream);
 
-    return temp_node;
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        fprintf(stream, "memory: %ld MiB peak resident\n", usage.ru_maxrss / 1024);
+    }
 }
 
-TreeNode *tree_search_node(TreeNode *root, int key) {
-    if (root == NULL || root->key == key) {
-        return root;
+void path_print_route(const int *stations, const int *predecessors, int source, int target, OutputWriter *out) {
+    if (out->format != OUTPUT_TEXT) {
+        path_print_binary(stations, predecessors, source, target, false, out);
+        return;
     }
 
-    if (root->key < key) {
-        return tree_search_node(root->right, key);
+    size_t length = 0;
+    for (int cursor = target;; cursor = predecessors[cursor]) {
+        length += writer_int_length(stations[cursor]) + 1;
+        if (cursor == source) {
+            break;
+        }
     }
 
-    return tree_search_node(root->left, key);
+    char *position = writer_reserve(out, length) + length;
+    *--position = '\n';
+    for (int cursor = target;; cursor = predecessors[cursor]) {
+        position = writer_format_int(position, stations[cursor]);
+        if (cursor == source) {
+            break;
+        }
+        *--position = ' ';
+    }
 }
 
-TreeNode *tree_insert_node(TreeNode *root, int key, MaxHeap *car_heap) {
-    if (root == NULL) {
-        printf("aggiunta\n");
-        return tree_create_node(key, car_heap);
+void path_print_reverse(const int *stations, const int *predecessors, int size, OutputWriter *out) {
+    if (out->format != OUTPUT_TEXT) {
+        path_print_binary(stations, predecessors, 0, size - 1, false, out);
+        return;
     }
 
-    if (key < root->key) {
-        root->left = tree_insert_node(root->left, key, car_heap);
-    } else if (key > root->key) {
-        root->right = tree_insert_node(root->right, key, car_heap);
-    } else if (key == root->key) {
-        printf("non aggiunta\n");
+    size_t length = writer_int_length(stations[0]) + 1;
+    for (int cursor_end = size - 1; cursor_end != 0; cursor_end = predecessors[cursor_end]) {
+        length += writer_int_length(stations[cursor_end]) + 1;
     }
 
-    return root;
+    char *position = writer_reserve(out, length) + length;
+    *--position = '\n';
+    for (int cursor_end = size - 1; cursor_end != 0; cursor_end = predecessors[cursor_end]) {
+        position = writer_format_int(position, stations[cursor_end]);
+        *--position = ' ';
+    }
+    writer_format_int(position, stations[0]);
 }
 
-TreeNode *tree_remove_node(TreeNode *root, int key) {
-    if (root == NULL) {
-        printf("non demolita\n");
-        return NULL;
+void path_print_binary(const int *stations, const int *predecessors, int first, int last, bool walk_order,
+                       OutputWriter *out) {
+    if (out->format == OUTPUT_KEYS) {
+        int size = 1;
+        for (int cursor = last; cursor != first; cursor = predecessors[cursor]) {
+            size++;
+        }
+
+        int *keys = (int *)writer_reserve(out, (size + 1) * sizeof(int));
+        int position = walk_order ? 1 : size;
+        keys[0] = size;
+        for (int cursor = last;; cursor = predecessors[cursor]) {
+            keys[position] = stations[cursor];
+            position += walk_order ? 1 : -1;
+            if (cursor == first) {
+                break;
+            }
+        }
+        return;
     }
 
-    if (root->key < key) {
-        root->right = tree_remove_node(root->right, key);
-    } else if (root->key > key) {
-        root->left = tree_remove_node(root->left, key);
-    } else {
-        if (root->left == NULL && root->right == NULL) {
-            free(root);
-            printf("demolita\n");
-            return NULL;
-        } else if (root->left == NULL) {
-            TreeNode *temp = root->right;
-
-            free(root);
-            printf("demolita\n");
-            return temp;
-        } else if (root->right == NULL) {
-            TreeNode *temp = root->left;
-
-            free(root);
-            printf("demolita\n");
-            return temp;
+    unsigned int count = 0;
+    size_t length = 0;
+    for (int cursor = last;; cursor = predecessors[cursor]) {
+        length += writer_varint_length(stations[cursor]);
+        count++;
+        if (cursor == first) {
+            break;
+        }
+    }
+
+    char *position = writer_reserve(out, writer_varint_length(count) + length);
+    position = writer_format_varint(position, count);
+    char *end = position + length;
+    for (int cursor = last;; cursor = predecessors[cursor]) {
+        if (walk_order) {
+            position = writer_format_varint(position, stations[cursor]);
         } else {
-            TreeNode *min_node = tree_get_min_node(root->right);
-            root->key = min_node->key;
-            root->cars = min_node->cars;
-            root->right = tree_remove_node(root->right, min_node->key);
+            end -= writer_varint_length(stations[cursor]);
+            writer_format_varint(end, stations[cursor]);
+        }
+        if (cursor == first) {
+            break;
         }
     }
-    return root;
 }
 
-Queue *queue_create() {
-    Queue *queue = (Queue *)malloc(sizeof(Queue));
-    if (queue == NULL) {
-        printf("memory allocation error!\n");
+void path_print_chain(const int *stations, const int *chain, int count, OutputWriter *out) {
+    if (out->format != OUTPUT_TEXT) {
+        writer_write_key(out, count);
+        for (int i = count - 1; i >= 0; i--) {
+            writer_write_key(out, stations[chain[i]]);
+        }
+        return;
+    }
+
+    for (int i = count - 1; i > 0; i--) {
+        writer_write_int(out, stations[chain[i]]);
+        writer_write_literal(out, " ");
     }
-    queue->head = queue->tail = NULL;
-    return queue;
+    writer_write_int(out, stations[chain[0]]);
+    writer_write_literal(out, "\n");
 }
 
-int queue_is_empty(Queue *queue) {
-    return (queue->head == NULL);
+void path_print_reverse2(const int *stations, const int *predecessors, int size, OutputWriter *out) {
+    if (out->format != OUTPUT_TEXT) {
+        path_print_binary(stations, predecessors, 0, size - 1, true, out);
+        return;
+    }
+
+    int cursor_end = size - 1;
+
+    while (cursor_end > 0 && cursor_end < size) {
+        writer_write_int(out, stations[cursor_end]);
+        writer_write_literal(out, " ");
+        cursor_end = predecessors[cursor_end];
+    }
+    writer_write_int(out, stations[0]);
+    writer_write_literal(out, "\n");
 }
 
-void queue_enqueue(Queue *queue, Edge edge) {
-    QueueNode *new_node_queue = (QueueNode *)malloc(sizeof(QueueNode));
-    if (new_node_queue == NULL) {
-        printf("memory allocation error!\n");
+bool reader_open(InputReader *reader, int fd) {
+    struct stat info;
+
+    reader->fd = fd;
+    reader->mapped = false;
+    reader->binary = false;
+    reader->released = 0;
+    reader->commands = NULL;
+    reader->decoded = NULL;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void *mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+            reader->buffer = (char *)mapping;
+            reader->capacity = info.st_size;
+            reader->cursor = reader->buffer;
+            reader->end = reader->buffer + info.st_size;
+            reader->mapped = true;
+            return true;
+        }
     }
-    new_node_queue->edge = edge;
-    new_node_queue->next = NULL;
 
-    if (queue_is_empty(queue)) {
-        queue->head = queue->tail = new_node_queue;
-    } else {
-        queue->tail->next = new_node_queue;
-        queue->tail = new_node_queue;
+    reader->capacity = INPUT_BLOCK_SIZE;
+    reader->buffer = (char *)malloc(reader->capacity);
+    if (reader->buffer == NULL) {
+        return false;
     }
+    reader->cursor = reader->end = reader->buffer;
+    return true;
 }
 
-Edge queue_dequeue(Queue *queue) {
-    if (queue_is_empty(queue)) {
-        printf("error, queue is empty!\n");
+void reader_close(InputReader *reader) {
+    if (reader->mapped) {
+        munmap(reader->buffer, reader->capacity);
+    } else {
+        free(reader->buffer);
     }
+}
 
-    QueueNode *temp_node = queue->head;
-    Edge edge = temp_node->edge;
-    queue->head = queue->head->next;
+bool reader_refill(InputReader *reader) {
+    if (reader->mapped) {
+        return false;
+    }
 
-    if (queue->head == NULL) {
-        queue->tail = NULL;
+    size_t pending = reader->end - reader->cursor;
+    if (pending == reader->capacity) {
+        char *buffer = (char *)realloc(reader->buffer, 2 * reader->capacity);
+        if (buffer == NULL) {
+            return false;
+        }
+        reader->buffer = buffer;
+        reader->capacity *= 2;
+    } else {
+        memmove(reader->buffer, reader->cursor, pending);
+    }
+    reader->cursor = reader->buffer;
+    reader->end = reader->buffer + pending;
+    if (reader->decoded != NULL) {
+        spsc_ring_publish(reader->decoded, true);
     }
 
-    free(temp_node);
-    return edge;
-}
+    ssize_t count;
+    do {
+        count = read(reader->fd, reader->buffer + pending, reader->capacity - pending);
+    } while (count < 0 && errno == EINTR);
 
-void queue_destroy(Queue *queue) {
-    while (!queue_is_empty(queue)) {
-        queue_dequeue(queue);
+    if (count <= 0) {
+        return false;
     }
-    free(queue);
+    reader->end += count;
+    return true;
 }
 
-void path_array_create(TreeNode *root, int start, int end, int *stations, int *autonomies, int *size) {
-    if (root == NULL) {
-        return;
+bool reader_skip_spaces(InputReader *reader) {
+    for (;;) {
+        while (reader->cursor < reader->end) {
+            if (!reader_is_space(*reader->cursor)) {
+                return true;
+            }
+            reader->cursor++;
+        }
+        if (!reader_refill(reader)) {
+            return false;
+        }
     }
+}
 
-    if (start < end) {
-        if (start < root->key) {
-            path_array_create(root->left, start, end, stations, autonomies, size);
+bool reader_next_token(InputReader *reader, const char **token, int *length) {
+    if (reader->commands != NULL) {
+        return pipeline_next_token(reader, token, length);
+    }
+    if (reader->binary) {
+        unsigned int size;
+        if (!reader_next_varint(reader, &size) || size > INT_MAX) {
+            return false;
         }
-        if (start <= root->key && root->key <= end) {
-            stations[*size] = root->key;
-            if (root->cars->size > 0) {
-                autonomies[*size] = root->cars->elements[0];
-            } else {
-                autonomies[*size] = 0;
+        while ((size_t)(reader->end - reader->cursor) < size) {
+            if (!reader_refill(reader)) {
+                return false;
             }
+        }
+        *token = reader->cursor;
+        *length = (int)size;
+        reader->cursor += size;
+        return true;
+    }
+    if (!reader_skip_spaces(reader)) {
+        return false;
+    }
 
-            (*size)++;
+    const char *scan = reader->cursor;
+    for (;;) {
+        while (scan < reader->end && !reader_is_space(*scan)) {
+            scan++;
         }
-        if (root->key < end) {
-            path_array_create(root->right, start, end, stations, autonomies, size);
+        if (scan < reader->end) {
+            break;
         }
-    } else {
-        if (start > root->key) {
-            path_array_create(root->right, start, end, stations, autonomies, size);
+
+        size_t scanned = scan - reader->cursor;
+        if (!reader_refill(reader)) {
+            break;
         }
-        if (end <= root->key && root->key <= start) {
-            stations[*size] = root->key;
-            if (root->cars->size > 0) {
-                autonomies[*size] = root->cars->elements[0];
-            } else {
-                autonomies[*size] = 0;
-            }
-            (*size)++;
+        scan = reader->cursor + scanned;
+    }
+
+    *token = reader->cursor;
+    *length = (int)(scan - reader->cursor);
+    reader->cursor = scan;
+    return true;
+}
+
+bool reader_next_int(InputReader *reader, int *value) {
+    if (reader->commands != NULL) {
+        return spsc_ring_pop(reader->commands, value);
+    }
+    if (reader->binary) {
+        unsigned int number;
+        if (!reader_next_varint(reader, &number)) {
+            return false;
+        }
+        *value = (int)number;
+        return true;
+    }
+    if (!reader_skip_spaces(reader)) {
+        return false;
+    }
+
+    bool negative = false;
+    if (*reader->cursor == '-' || *reader->cursor == '+') {
+        negative = *reader->cursor == '-';
+        reader->cursor++;
+        if (reader->cursor == reader->end && !reader_refill(reader)) {
+            return false;
+        }
+    }
+    if (*reader->cursor < '0' || *reader->cursor > '9') {
+        return false;
+    }
+
+    unsigned int number = 0;
+    for (;;) {
+        while (reader->cursor < reader->end && *reader->cursor >= '0' && *reader->cursor <= '9') {
+            number = number * 10 + (unsigned int)(*reader->cursor - '0');
+            reader->cursor++;
         }
-        if (root->key > end) {
-            path_array_create(root->left, start, end, stations, autonomies, size);
+        if (reader->cursor < reader->end || !reader_refill(reader)) {
+            break;
         }
     }
+
+    *value = (int)(negative ? 0u - number : number);
+    return true;
 }
 
-void path_calculate(int *stations, int *autonomies, int size, int start, int end) {
-    bool *visited = (bool *)malloc((size) * sizeof(bool));
-    unsigned short *predecessors = (unsigned short *)malloc((size) * sizeof(unsigned short));
+void reader_release(InputReader *reader) {
+    size_t parsed = (reader->cursor - reader->buffer) & ~(size_t)(sysconf(_SC_PAGESIZE) - 1);
 
-    for (int i = 0; i < size; i++) {
-        visited[i] = false;
-        predecessors[i] = -1;
+    if (parsed > reader->released) {
+        madvise(reader->buffer + reader->released, parsed - reader->released, MADV_DONTNEED);
+        reader->released = parsed;
     }
+}
 
-    Queue *queue = queue_create();
+bool reader_next_varint(InputReader *reader, unsigned int *value) {
+    unsigned int number = 0;
 
-    if (start > end) {
-        Edge el_from_q = {0, size - 1, size - 1};
-        visited[size - 1] = true;
-        queue_enqueue(queue, el_from_q);
-    } else {
-        Edge el_from_q = {0, 0, 0};
-        visited[0] = true;
-        queue_enqueue(queue, el_from_q);
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (reader->cursor == reader->end && !reader_refill(reader)) {
+            return false;
+        }
+        unsigned char byte = (unsigned char)*reader->cursor++;
+        number |= (unsigned int)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = number;
+            return true;
+        }
     }
+    return false;
+}
 
-    Edge el_from_q;
-    while (!queue_is_empty(queue)) {
-        el_from_q = queue_dequeue(queue);
-        int from_index = el_from_q.to_index;
-        predecessors[from_index] = el_from_q.from_index;
+bool reader_next_command(InputReader *reader, CommandKind *kind) {
+    if (reader->commands != NULL) {
+        return pipeline_next_command(reader->commands, kind);
+    }
+    if (reader->mapped && (size_t)(reader->cursor - reader->buffer) - reader->released >= INPUT_RELEASE_SIZE) {
+        reader_release(reader);
+    }
+    if (reader->binary) {
+        if (reader->cursor == reader->end && !reader_refill(reader)) {
+            return false;
+        }
+        *kind = command_decode((unsigned char)*reader->cursor++);
+        return true;
+    }
 
-        if (start > end) {
-            for (int j = from_index - 1; j >= 0; j--) {
-                if (visited[j] == false && autonomies[j] >= abs(stations[j] - stations[from_index])) {
-                    Edge e1 = {0, from_index, j};
+    const char *token;
+    int length;
+    if (!reader_next_token(reader, &token, &length)) {
+        return false;
+    }
+    *kind = command_parse(token, length);
+    return true;
+}
 
-                    queue_enqueue(queue, e1);
-                    visited[j] = true;
-                }
+CommandKind command_parse(const char *token, int length) {
+    switch (token[0]) {
+        case 'a':
+            if (length == 17 && memcmp(token, "aggiungi-stazione", 17) == 0) {
+                return COMMAND_ADD_STATION;
             }
-        } else {
-            for (int j = from_index + 1; j < size; j++) {
-                if (visited[j] == false && autonomies[from_index] >= abs(stations[j] - stations[from_index])) {
-                    Edge e1 = {0, from_index, j};
-
-                    queue_enqueue(queue, e1);
-                    visited[j] = true;
-                }
+            if (length == 13 && memcmp(token, "aggiungi-auto", 13) == 0) {
+                return COMMAND_ADD_CAR;
             }
-        }
+            break;
+        case 'd':
+            if (length == 18 && memcmp(token, "demolisci-stazione", 18) == 0) {
+                return COMMAND_REMOVE_STATION;
+            }
+            break;
+        case 'r':
+            if (length == 12 && memcmp(token, "rottama-auto", 12) == 0) {
+                return COMMAND_REMOVE_CAR;
+            }
+            break;
+        case 'p':
+            if (length == 18 && memcmp(token, "pianifica-percorso", 18) == 0) {
+                return COMMAND_PLAN_ROUTE;
+            }
+            if (length == 18 && memcmp(token, "pianifica-percorsi", 18) == 0) {
+                return COMMAND_PLAN_ROUTES;
+            }
+            break;
+        case 'c':
+            if (length == 6 && memcmp(token, "carica", 6) == 0) {
+                return COMMAND_LOAD;
+            }
+            break;
+        case 's':
+            if (length == 11 && memcmp(token, "statistiche", 11) == 0) {
+                return COMMAND_STATS;
+            }
+            if (length == 5 && memcmp(token, "salva", 5) == 0) {
+                return COMMAND_SAVE;
+            }
+            break;
+        default:
+            break;
+    }
+    return COMMAND_UNKNOWN;
+}
+
+CommandKind command_decode(unsigned char opcode) {
+    switch (opcode) {
+        case BINARY_ADD_STATION:
+            return COMMAND_ADD_STATION;
+        case BINARY_REMOVE_STATION:
+            return COMMAND_REMOVE_STATION;
+        case BINARY_ADD_CAR:
+            return COMMAND_ADD_CAR;
+        case BINARY_REMOVE_CAR:
+            return COMMAND_REMOVE_CAR;
+        case BINARY_PLAN_ROUTE:
+            return COMMAND_PLAN_ROUTE;
+        case BINARY_PLAN_ROUTES:
+            return COMMAND_PLAN_ROUTES;
+        case BINARY_SAVE:
+            return COMMAND_SAVE;
+        case BINARY_LOAD:
+            return COMMAND_LOAD;
+        case BINARY_STATS:
+            return COMMAND_STATS;
+        default:
+            return COMMAND_UNKNOWN;
+    }
+}
+
+bool writer_open(OutputWriter *out, int fd) {
+    out->fd = fd;
+    out->format = OUTPUT_TEXT;
+    out->pipeline = NULL;
+    out->allocations = 0;
+    out->length = 0;
+    out->capacity = OUTPUT_BUFFER_SIZE;
+    out->buffer = (char *)malloc(out->capacity);
+    if (out->buffer == NULL) {
+        return false;
+    }
+    return true;
+}
+
+void writer_close(OutputWriter *out) {
+    writer_flush(out);
+    free(out->buffer);
+}
+
+void writer_flush(OutputWriter *out) {
+    if (out->pipeline != NULL) {
+        pipeline_flush(out->pipeline, out);
+        return;
+    }
+    writer_send(out->fd, out->buffer, out->length);
+    out->length = 0;
+}
+
+void writer_send(int fd, const char *bytes, size_t length) {
+    size_t written = 0;
 
-        if (queue_is_empty(queue)) {
+    while (written < length) {
+        ssize_t count = write(fd, bytes + written, length - written);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
             break;
         }
+        written += count;
     }
+}
 
-    if (start > end) {
-        if (visited[0] == false) {
-            printf("nessun percorso\n");
-        } else {
-            path_print_reverse2(stations, predecessors, size);
+void writer_end_command(OutputWriter *out) {
+    if (out->length >= OUTPUT_FLUSH_THRESHOLD) {
+        writer_flush(out);
+    }
+}
+
+char *writer_reserve(OutputWriter *out, size_t size) {
+    if (out->length + size > out->capacity) {
+        size_t capacity = out->capacity;
+        while (out->length + size > capacity) {
+            capacity *= 2;
         }
-    } else {
-        if (visited[size - 1] == false) {
-            printf("nessun percorso\n");
-        } else {
-            path_print_reverse(stations, predecessors, size);
+
+        char *buffer = (char *)realloc(out->buffer, capacity);
+        if (buffer == NULL) {
+            printf("memory allocation error!\n");
+            exit(1);
         }
+        out->buffer = buffer;
+        out->capacity = capacity;
+        out->allocations++;
     }
 
-    free(stations);
-    free(autonomies);
-    free(visited);
-    free(predecessors);
-    queue_destroy(queue);
+    char *position = out->buffer + out->length;
+    out->length += size;
+    return position;
 }
 
-void path_print_reverse(const int *stations, const unsigned short *predecessors, int size) {
-    int cursor_end = size - 1;
-    int *stations_path_min = (int *)malloc(size * sizeof(int));
-    if (stations_path_min == NULL) {
-        printf("Memory allocation failed.\n");
-        return;
+void writer_write(OutputWriter *out, const char *text, size_t length) {
+    memcpy(writer_reserve(out, length), text, length);
+}
+
+void writer_write_int(OutputWriter *out, int value) {
+    char digits[12];
+    char *start = writer_format_int(digits + sizeof(digits), value);
+
+    writer_write(out, start, digits + sizeof(digits) - start);
+}
+
+void writer_write_outcome(OutputWriter *out, bool success, const char *success_text, const char *failure_text) {
+    if (out->format != OUTPUT_TEXT) {
+        *writer_reserve(out, 1) = success ? 1 : 0;
+    } else if (success) {
+        writer_write(out, success_text, strlen(success_text));
+    } else {
+        writer_write(out, failure_text, strlen(failure_text));
     }
+}
 
-    int real_size = 0;
-    while (cursor_end != 0) {
-        stations_path_min[real_size] = stations[cursor_end];
-        real_size++;
-        cursor_end = predecessors[cursor_end];
+void writer_write_station_route(OutputWriter *out, int key) {
+    if (out->format != OUTPUT_TEXT) {
+        writer_write_key(out, 1);
+        writer_write_key(out, key);
+        return;
     }
-    stations_path_min[real_size] = stations[0];
+    writer_write_int(out, key);
+    writer_write_literal(out, "\n");
+}
 
-    for (int i = real_size; i > 0; i--) {
-        printf("%d ", stations_path_min[i]);
+void writer_write_no_route(OutputWriter *out) {
+    if (out->format != OUTPUT_TEXT) {
+        writer_write_key(out, 0);
+        return;
     }
-    printf("%d\n", stations_path_min[0]);
+    writer_write_literal(out, "nessun percorso\n");
+}
+
+void writer_write_varint(OutputWriter *out, unsigned int value) {
+    char bytes[5];
 
-    free(stations_path_min);
+    writer_write(out, bytes, writer_format_varint(bytes, value) - bytes);
 }
 
-void path_print_reverse2(const int *stations, const unsigned short *predecessors, int size) {
-    int cursor_end = 0;
-    int *stations_path_min = (int *)malloc(size * sizeof(int));
-    if (stations_path_min == NULL) {
-        printf("Memory allocation failed.\n");
+void writer_write_key(OutputWriter *out, int value) {
+    if (out->format == OUTPUT_KEYS) {
+        memcpy(writer_reserve(out, sizeof(int)), &value, sizeof(int));
         return;
     }
+    writer_write_varint(out, value);
+}
 
-    int real_size = 0;
-    while (cursor_end < size - 1 && cursor_end >= 0) {
-        stations_path_min[real_size] = stations[cursor_end];
-        real_size++;
-        cursor_end = predecessors[cursor_end];
+char *writer_format_varint(char *position, unsigned int value) {
+    while (value >= 0x80) {
+        *position++ = (char)(value | 0x80);
+        value >>= 7;
+    }
+    *position++ = (char)value;
+    return position;
+}
+
+int writer_varint_length(unsigned int value) {
+    int length = 1;
+
+    while (value >= 0x80) {
+        value >>= 7;
+        length++;
     }
-    stations_path_min[real_size] = stations[size - 1];
+    return length;
+}
+
+char *writer_format_int(char *end, int value) {
+    static const char digit_pairs[] = "00010203040506070809101112131415161718192021222324252627282930313233343536373839404142434445464748495051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+    unsigned int number = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
 
-    for (int i = 0; i < real_size; i++) {
-        printf("%d ", stations_path_min[i]);
+    while (number >= 100) {
+        end -= 2;
+        memcpy(end, &digit_pairs[(number % 100) * 2], 2);
+        number /= 100;
+    }
+    if (number >= 10) {
+        end -= 2;
+        memcpy(end, &digit_pairs[number * 2], 2);
+    } else {
+        *--end = (char)('0' + number);
     }
-    printf("%d\n", stations_path_min[real_size]);
+    if (value < 0) {
+        *--end = '-';
+    }
+    return end;
+}
 
-    free(stations_path_min);
+int writer_int_length(int value) {
+    unsigned int number = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+    int length = value < 0 ? 2 : 1;
+
+    while (number >= 10) {
+        number /= 10;
+        length++;
+    }
+    return length;
 }
 
 // ------------------------------------------------------------------- Functions implementation ------------------------------------------------------------------
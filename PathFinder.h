@@ -0,0 +1,210 @@
+#ifndef PATHFINDER_H
+#define PATHFINDER_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+// --------------------------------------------------------------------------- Structs ---------------------------------------------------------------------------
+
+/**
+ * @brief An engine: the stations of a highway, their fleets and the route planners.
+ *
+ * A handle is not thread-safe: every call on it must come from one thread at a time. Distinct handles are independent.
+ *
+ * pathfinder_create and pathfinder_serve report a failure to allocate the handle or the buffers of the command loop to
+ * the caller. Any other failed allocation or thread creation, including in the thread pools started by
+ * pathfinder_create, prints "memory allocation error!" or "thread creation error!" on stdout and terminates the
+ * process, as the command-line program does.
+ */
+typedef struct pathfinder PathFinder;
+
+/**
+ * @brief The algorithms available to plan a route.
+ */
+typedef enum pathfinder_planner {
+    PATHFINDER_PLANNER_GREEDY,   ///< Linear-time sweep over the reachability layers.
+    PATHFINDER_PLANNER_BFS,      ///< Quadratic breadth-first search, kept as a reference.
+    PATHFINDER_PLANNER_JUMP      ///< Binary-lifting tables over a snapshot of the index, falling back to the sweep.
+} PathFinderPlanner;
+
+/**
+ * @brief A structure representing the settings of an engine.
+ *
+ * The threads, readers, binary, pipeline, latency and shards settings only change how pathfinder_serve runs. The
+ * parallel settings apply to every route planned on the calling thread, by pathfinder_serve or by the typed calls.
+ * With shards, pathfinder_serve keeps one engine per highway, apart from the one used by the typed calls.
+ */
+typedef struct pathfinder_options {
+    PathFinderPlanner planner;   ///< Route planning algorithm.
+    int cache_capacity;          ///< Number of routes kept in the LRU route cache, 0 to disable it.
+    int threads;                 ///< Threads answering the runs of consecutive queries, 1 to answer them in order.
+    int readers;                 ///< Reader threads planning against snapshots of the index, 0 for none.
+    bool binary;                 ///< True to read binary command frames and write binary responses.
+    bool pipeline;               ///< True to parse, execute and write the commands on three threads.
+    bool latency;                ///< True to measure the latency of every command.
+    int parallel;                ///< Threads planning each route over a long range, 1 to plan it on the calling thread.
+    int parallel_threshold;      ///< Minimum number of stations of a range planned by the parallel threads.
+    int shards;                  ///< Threads serving commands prefixed by a highway id, 0 to serve a single highway.
+} PathFinderOptions;
+
+// --------------------------------------------------------------------------- Structs ---------------------------------------------------------------------------
+
+// -------------------------------------------------------------------- Functions declaration --------------------------------------------------------------------
+
+/**
+ * @brief Fills the settings with the defaults: the greedy planner, a cache of 1024 routes and serial execution, with a
+ *        parallel threshold of 2^20 stations.
+ * @param options Pointer to the settings.
+ */
+void pathfinder_options_init(PathFinderOptions *options);
+
+/**
+ * @brief Checks the settings accepted by pathfinder_create.
+ * @param options Pointer to the settings.
+ * @return True if the settings are valid, false if threads, parallel or parallel threshold are below 1, readers or
+ *         shards are negative, more than one of threads, readers and parallel are enabled, or shards are enabled with
+ *         any of them or with the pipeline.
+ */
+bool pathfinder_options_valid(const PathFinderOptions *options);
+
+/**
+ * @brief Creates an engine with an empty highway.
+ * @param options Pointer to the settings, NULL for the defaults.
+ * @return The engine, or NULL if the handle cannot be allocated or the settings are invalid. Checking the settings
+ *         first with pathfinder_options_valid tells the two apart.
+ */
+PathFinder *pathfinder_create(const PathFinderOptions *options);
+
+/**
+ * @brief Stops the threads of an engine and releases it.
+ * @param pathfinder The engine, or NULL.
+ */
+void pathfinder_destroy(PathFinder *pathfinder);
+
+/**
+ * @brief Adds a station.
+ * @param pathfinder The engine.
+ * @param distance Distance of the station from the start of the highway.
+ * @param autonomies Autonomies of the cars of the station, only the first 512 of them are kept.
+ * @param count Number of cars.
+ * @return True if the station was added, false if a station already exists at that distance.
+ */
+bool pathfinder_add_station(PathFinder *pathfinder, int distance, const int *autonomies, int count);
+
+/**
+ * @brief Demolishes a station.
+ * @param pathfinder The engine.
+ * @param distance Distance of the station.
+ * @return True if the station was demolished, false if there is no station at that distance.
+ */
+bool pathfinder_remove_station(PathFinder *pathfinder, int distance);
+
+/**
+ * @brief Adds a car to a station.
+ * @param pathfinder The engine.
+ * @param distance Distance of the station.
+ * @param autonomy Autonomy of the car.
+ * @return True if there is a station at that distance, false otherwise. A station keeps at most 512 cars, so the car
+ *         of a station that already has 512 is ignored and true is still returned, as aggiungi-auto prints aggiunta.
+ */
+bool pathfinder_add_car(PathFinder *pathfinder, int distance, int autonomy);
+
+/**
+ * @brief Scraps a car of a station.
+ * @param pathfinder The engine.
+ * @param distance Distance of the station.
+ * @param autonomy Autonomy of the car.
+ * @return True if the car was scrapped, false if the station has no car with that autonomy.
+ */
+bool pathfinder_remove_car(PathFinder *pathfinder, int distance, int autonomy);
+
+/**
+ * @brief Plans the route with the fewest stops between two stations, as pianifica-percorso does.
+ * @param pathfinder The engine.
+ * @param start Distance of the first station.
+ * @param end Distance of the last station.
+ * @param stations Buffer receiving the distances of the stations of the route, from start to end.
+ * @param capacity Number of distances the buffer can hold.
+ * @return The number of stations of the route, 0 if there is no route. The buffer is only filled if the route fits,
+ *         otherwise the call can be repeated with a buffer of the returned size.
+ */
+int pathfinder_plan_route(PathFinder *pathfinder, int start, int end, int *stations, int capacity);
+
+/**
+ * @brief Plans the routes from one station to several ones, as pianifica-percorsi does.
+ *
+ * The stations covering every target are extracted once and the routes on each side of the start are planned with a
+ * single pass.
+ * @param pathfinder The engine.
+ * @param start Distance of the first station of every route.
+ * @param targets Distances of the last stations.
+ * @param count Number of targets.
+ * @param stations Buffer receiving the routes one after the other, each from start to its target.
+ * @param capacity Number of distances the buffer can hold.
+ * @param lengths Array of count elements receiving the number of stations of each route, 0 if it has no route.
+ * @return The total number of stations of the routes. The buffer is only filled if they all fit, otherwise the call
+ *         can be repeated with a buffer of the returned size.
+ */
+int pathfinder_plan_routes(PathFinder *pathfinder, int start, const int *targets, int count, int *stations,
+                           int capacity, int *lengths);
+
+/**
+ * @brief Writes the stations and their fleets to a snapshot file.
+ * @param pathfinder The engine.
+ * @param path Path of the snapshot.
+ * @return True on success, false if the file cannot be written.
+ */
+bool pathfinder_save(PathFinder *pathfinder, const char *path);
+
+/**
+ * @brief Replaces every station with the ones of a snapshot file.
+ * @param pathfinder The engine.
+ * @param path Path of the snapshot.
+ * @return True on success, false if the file is missing, corrupted or of another version.
+ */
+bool pathfinder_load(PathFinder *pathfinder, const char *path);
+
+/**
+ * @brief Executes the commands of the text or binary protocol read from a file descriptor until its end.
+ *
+ * With shards, each command is preceded by the id of its highway: a varint before the opcode in the binary protocol,
+ * an integer before the command name in the text one, where a command without it belongs to highway 0.
+ * @param pathfinder The engine.
+ * @param input_fd File descriptor of the commands.
+ * @param output_fd File descriptor the responses are written to.
+ * @return True once every command was executed, false if the buffers could not be allocated.
+ */
+bool pathfinder_serve(PathFinder *pathfinder, int input_fd, int output_fd);
+
+/**
+ * @brief Prints the statistics of an engine: pools, caches, threads, latencies if measured and peak memory.
+ * @param pathfinder The engine.
+ * @param stream The stream to print to.
+ */
+void pathfinder_report(const PathFinder *pathfinder, FILE *stream);
+
+/**
+ * @brief Prints the per-command latencies of pathfinder_serve, if they are measured.
+ * @param pathfinder The engine.
+ * @param stream The stream to print to.
+ */
+void pathfinder_report_latency(const PathFinder *pathfinder, FILE *stream);
+
+/**
+ * @brief Forces the implementation of the scans over the station arrays, for every engine of the process.
+ *
+ * By default the widest instruction set supported by the CPU is used.
+ * @param name "scalar", "sse4" or "avx2", or NULL for the default.
+ * @return True on success, false if the name is unknown or the CPU does not support it.
+ */
+bool pathfinder_select_kernels(const char *name);
+
+/**
+ * @brief Times every supported scan implementation on synthetic ranges of 10^3 to 10^6 stations.
+ * @param stream The stream to print the timings to.
+ */
+void pathfinder_benchmark_kernels(FILE *stream);
+
+// -------------------------------------------------------------------- Functions declaration --------------------------------------------------------------------
+
+#endif
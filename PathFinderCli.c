@@ -0,0 +1,104 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include "PathFinder.h"
+
+// ----------------------------------------------------------------------------- Main ----------------------------------------------------------------------------
+
+int main(int argc, char *argv[]) {
+    PathFinderOptions options;
+    PathFinder *pathfinder;
+    const char *kernel_name = NULL, *load_path = NULL, *save_path = NULL;
+    const char *stats_variable = getenv("PATHFINDER_STATS");
+    bool report_stats = false, bench_kernels = false, valid = true;
+
+    pathfinder_options_init(&options);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--planner=greedy") == 0) {
+            options.planner = PATHFINDER_PLANNER_GREEDY;
+        } else if (strcmp(argv[i], "--planner=bfs") == 0) {
+            options.planner = PATHFINDER_PLANNER_BFS;
+        } else if (strcmp(argv[i], "--planner=jump") == 0) {
+            options.planner = PATHFINDER_PLANNER_JUMP;
+        } else if (strncmp(argv[i], "--cache=", 8) == 0) {
+            options.cache_capacity = atoi(argv[i] + 8);
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            options.threads = atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "--readers=", 10) == 0) {
+            options.readers = atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "--parallel=", 11) == 0) {
+            options.parallel = atoi(argv[i] + 11);
+        } else if (strncmp(argv[i], "--parallel-threshold=", 21) == 0) {
+            options.parallel_threshold = atoi(argv[i] + 21);
+        } else if (strncmp(argv[i], "--shards=", 9) == 0) {
+            options.shards = atoi(argv[i] + 9);
+        } else if (strncmp(argv[i], "--kernels=", 10) == 0) {
+            kernel_name = argv[i] + 10;
+        } else if (strcmp(argv[i], "--bench-kernels") == 0) {
+            bench_kernels = true;
+        } else if (strcmp(argv[i], "--latency") == 0) {
+            options.latency = true;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            report_stats = true;
+        } else if (strcmp(argv[i], "--binary") == 0) {
+            options.binary = true;
+        } else if (strcmp(argv[i], "--pipeline") == 0) {
+            options.pipeline = true;
+        } else if (strncmp(argv[i], "--load=", 7) == 0) {
+            load_path = argv[i] + 7;
+        } else if (strncmp(argv[i], "--save=", 7) == 0) {
+            save_path = argv[i] + 7;
+        } else {
+            valid = false;
+            break;
+        }
+    }
+    if (stats_variable != NULL && stats_variable[0] != '\0' && strcmp(stats_variable, "0") != 0) {
+        report_stats = options.latency = true;
+    }
+    valid = valid && pathfinder_options_valid(&options) &&
+            !(options.shards > 0 && (load_path != NULL || save_path != NULL));
+    if (!valid || !pathfinder_select_kernels(kernel_name)) {
+        fprintf(stderr,
+                "usage: %s [--planner=greedy|bfs|jump] [--cache=N] [--threads=N | --readers=N | --parallel=N | "
+                "--shards=N] [--parallel-threshold=N] "
+                "[--kernels=scalar|sse4|avx2] [--bench-kernels] [--latency] [--stats] [--load=FILE] [--save=FILE] "
+                "[--binary] [--pipeline]\n",
+                argv[0]);
+        return 1;
+    }
+    if (bench_kernels) {
+        pathfinder_benchmark_kernels(stdout);
+        return 0;
+    }
+
+    pathfinder = pathfinder_create(&options);
+    if (pathfinder == NULL) {
+        printf("memory allocation error!\n");
+        return 1;
+    }
+    if (load_path != NULL && !pathfinder_load(pathfinder, load_path)) {
+        fprintf(stderr, "%s: cannot load the snapshot %s\n", argv[0], load_path);
+        pathfinder_destroy(pathfinder);
+        return 1;
+    }
+    if (!pathfinder_serve(pathfinder, STDIN_FILENO, STDOUT_FILENO)) {
+        printf("memory allocation error!\n");
+        pathfinder_destroy(pathfinder);
+        return 1;
+    }
+    if (save_path != NULL && !pathfinder_save(pathfinder, save_path)) {
+        fprintf(stderr, "%s: cannot save the snapshot %s\n", argv[0], save_path);
+    }
+    if (report_stats) {
+        pathfinder_report(pathfinder, stderr);
+    } else {
+        pathfinder_report_latency(pathfinder, stderr);
+    }
+    pathfinder_destroy(pathfinder);
+    return 0;
+}
+
+// ----------------------------------------------------------------------------- Main ----------------------------------------------------------------------------
@@ -0,0 +1,244 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#define BINARY_ADD_STATION 0x01
+#define BINARY_REMOVE_STATION 0x02
+#define BINARY_ADD_CAR 0x03
+#define BINARY_REMOVE_CAR 0x04
+#define BINARY_PLAN_ROUTE 0x05
+#define BINARY_SAVE 0x06
+#define BINARY_LOAD 0x07
+#define BINARY_STATS 0x08
+#define BINARY_PLAN_ROUTES 0x09
+#define TOKEN_SIZE 4096
+
+// --------------------------------------------------------------------------- Structs ---------------------------------------------------------------------------
+
+/**
+ * @brief A structure representing a command of the text protocol and its binary encoding.
+ */
+typedef struct command {
+    const char *name;        ///< Token of the text protocol.
+    unsigned char opcode;    ///< Opcode of the binary protocol.
+    int arguments;           ///< Number of integer arguments, -1 for a key and a list, -2 for a path.
+    const char *success;     ///< Text printed when an update succeeds, NULL for queries.
+    const char *failure;     ///< Text printed when an update fails, NULL for queries.
+} Command;
+
+/**
+ * @brief The commands, in opcode order.
+ */
+static const Command commands[] = {
+    {"aggiungi-stazione", BINARY_ADD_STATION, -1, "aggiunta", "non aggiunta"},
+    {"demolisci-stazione", BINARY_REMOVE_STATION, 1, "demolita", "non demolita"},
+    {"aggiungi-auto", BINARY_ADD_CAR, 2, "aggiunta", "non aggiunta"},
+    {"rottama-auto", BINARY_REMOVE_CAR, 2, "rottamata", "non rottamata"},
+    {"pianifica-percorso", BINARY_PLAN_ROUTE, 2, NULL, NULL},
+    {"salva", BINARY_SAVE, -2, "salvato", "non salvato"},
+    {"carica", BINARY_LOAD, -2, "caricato", "non caricato"},
+    {"statistiche", BINARY_STATS, 0, NULL, NULL},
+    {"pianifica-percorsi", BINARY_PLAN_ROUTES, -1, NULL, NULL},
+};
+
+// --------------------------------------------------------------------------- Structs ---------------------------------------------------------------------------
+
+// -------------------------------------------------------------------- Functions declaration --------------------------------------------------------------------
+
+/**
+ * @brief Writes an unsigned LEB128 varint.
+ * @param value The value, negative integers being written as their 32-bit two's complement.
+ * @param stream The stream.
+ */
+void varint_write(unsigned int value, FILE *stream);
+
+/**
+ * @brief Reads an unsigned LEB128 varint.
+ * @param value Pointer where the value is stored.
+ * @param stream The stream.
+ * @return True if a varint was read, false at the end of the stream.
+ */
+bool varint_read(unsigned int *value, FILE *stream);
+
+/**
+ * @brief Finds a command from its token or its opcode.
+ * @param name The token, or NULL to search by opcode.
+ * @param opcode The opcode, used when name is NULL.
+ * @return A pointer to the command, or NULL if it is unknown.
+ */
+const Command *command_find(const char *name, int opcode);
+
+/**
+ * @brief Converts text commands read from stdin to binary frames written to stdout.
+ * @return 0 on success, 1 on a malformed command.
+ */
+int encode(void);
+
+/**
+ * @brief Converts binary responses read from stdin to the text responses, written to stdout.
+ * @param frames The stream of the binary commands the responses answer.
+ * @return 0 on success, 1 if the responses do not match the commands.
+ */
+int decode(FILE *frames);
+
+// -------------------------------------------------------------------- Functions declaration --------------------------------------------------------------------
+
+// ----------------------------------------------------------------------------- Main ----------------------------------------------------------------------------
+
+int main(int argc, char *argv[]) {
+    if (argc == 2 && strcmp(argv[1], "encode") == 0) {
+        return encode();
+    }
+    if (argc == 3 && strcmp(argv[1], "decode") == 0) {
+        FILE *frames = fopen(argv[2], "rb");
+        if (frames == NULL) {
+            perror(argv[2]);
+            return 1;
+        }
+        int status = decode(frames);
+        fclose(frames);
+        return status;
+    }
+
+    fprintf(stderr, "usage: %s encode < COMMANDS.txt > COMMANDS.bin\n", argv[0]);
+    fprintf(stderr, "       %s decode COMMANDS.bin < RESPONSES.bin > RESPONSES.txt\n", argv[0]);
+    return 1;
+}
+
+// ----------------------------------------------------------------------------- Main ----------------------------------------------------------------------------
+
+// ------------------------------------------------------------------- Functions implementation ------------------------------------------------------------------
+
+void varint_write(unsigned int value, FILE *stream) {
+    while (value >= 0x80) {
+        putc((int)((value & 0x7f) | 0x80), stream);
+        value >>= 7;
+    }
+    putc((int)value, stream);
+}
+
+bool varint_read(unsigned int *value, FILE *stream) {
+    unsigned int number = 0;
+
+    for (int shift = 0; shift < 35; shift += 7) {
+        int byte = getc(stream);
+        if (byte == EOF) {
+            return false;
+        }
+        number |= (unsigned int)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = number;
+            return true;
+        }
+    }
+    return false;
+}
+
+const Command *command_find(const char *name, int opcode) {
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+        if (name != NULL ? strcmp(commands[i].name, name) == 0 : commands[i].opcode == opcode) {
+            return &commands[i];
+        }
+    }
+    return NULL;
+}
+
+int encode(void) {
+    char token[TOKEN_SIZE];
+
+    while (scanf("%4095s", token) == 1) {
+        const Command *command = command_find(token, 0);
+        int arguments;
+        int value;
+
+        if (command == NULL) {
+            continue;
+        }
+        putchar(command->opcode);
+
+        if (command->arguments == -2) {
+            if (scanf("%4095s", token) != 1) {
+                return 1;
+            }
+            varint_write((unsigned int)strlen(token), stdout);
+            fputs(token, stdout);
+            continue;
+        }
+
+        arguments = command->arguments;
+        if (arguments == -1) {
+            if (scanf("%d", &value) != 1 || scanf("%d", &arguments) != 1 || arguments < 0) {
+                return 1;
+            }
+            varint_write((unsigned int)value, stdout);
+            varint_write((unsigned int)arguments, stdout);
+        }
+        for (int i = 0; i < arguments; i++) {
+            if (scanf("%d", &value) != 1) {
+                return 1;
+            }
+            varint_write((unsigned int)value, stdout);
+        }
+    }
+    return 0;
+}
+
+int decode(FILE *frames) {
+    int opcode;
+
+    while ((opcode = getc(frames)) != EOF) {
+        const Command *command = command_find(NULL, opcode);
+        unsigned int count;
+        unsigned int routes;
+        unsigned int value;
+
+        if (command == NULL) {
+            continue;
+        }
+
+        count = command->arguments > 0 ? (unsigned int)command->arguments : 0;
+        if (command->arguments == -1) {
+            if (!varint_read(&value, frames) || !varint_read(&count, frames)) {
+                return 1;
+            }
+        }
+        routes = command->opcode == BINARY_PLAN_ROUTES ? count : command->opcode == BINARY_PLAN_ROUTE;
+        if (command->arguments == -2) {
+            if (!varint_read(&count, frames) || fseek(frames, count, SEEK_CUR) != 0) {
+                return 1;
+            }
+            count = 0;
+        }
+        for (unsigned int i = 0; i < count; i++) {
+            if (!varint_read(&value, frames)) {
+                return 1;
+            }
+        }
+
+        if (command->success != NULL) {
+            int outcome = getchar();
+            if (outcome == EOF) {
+                return 1;
+            }
+            puts(outcome ? command->success : command->failure);
+        }
+        for (unsigned int route = 0; route < routes; route++) {
+            if (!varint_read(&count, stdin)) {
+                return 1;
+            }
+            if (count == 0) {
+                puts("nessun percorso");
+            }
+            for (unsigned int i = 0; i < count; i++) {
+                if (!varint_read(&value, stdin)) {
+                    return 1;
+                }
+                printf(i + 1 < count ? "%d " : "%d\n", (int)value);
+            }
+        }
+    }
+    return getchar() == EOF ? 0 : 1;
+}
+
+// ------------------------------------------------------------------- Functions implementation ------------------------------------------------------------------
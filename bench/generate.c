@@ -0,0 +1,249 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#define MAX_CARS 512
+#define KEY_LIMIT 2000000000
+
+// --------------------------------------------------------------------------- Structs ---------------------------------------------------------------------------
+
+/**
+ * @brief A structure representing the stations the generated commands have added so far.
+ */
+typedef struct station_set {
+    int *keys;               ///< Keys of the stations, in no particular order.
+    int size;                ///< Number of stations.
+    int capacity;            ///< Number of keys the array can hold.
+} StationSet;
+
+/**
+ * @brief A structure representing the mix of commands of a scenario, as percentages.
+ */
+typedef struct scenario {
+    const char *name;        ///< Name used on the command line.
+    const char *description; ///< One line description.
+    int add_station;         ///< Share of aggiungi-stazione commands.
+    int remove_station;      ///< Share of demolisci-stazione commands.
+    int add_car;             ///< Share of aggiungi-auto commands.
+    int remove_car;          ///< Share of rottama-auto commands.
+    int plan_route;          ///< Share of pianifica-percorso commands.
+} Scenario;
+
+/**
+ * @brief The scenarios, the mix being used after the initial stations are added.
+ */
+static const Scenario scenarios[] = {
+    {"sorted", "stations added in increasing order, then queries over the whole highway", 5, 2, 5, 3, 85},
+    {"dense", "stations with 512 cars, car updates on full fleets", 5, 2, 40, 40, 13},
+    {"span", "few stations spread over two billion kilometers, long routes", 5, 5, 10, 10, 70},
+    {"queries", "a mid-sized highway answering mostly queries", 2, 1, 2, 2, 93},
+    {"mutations", "mostly station and car updates, few queries", 30, 20, 20, 20, 10},
+    {"mixed", "even mix of updates and queries over a dense key space", 20, 10, 15, 15, 40},
+    {"national", "a highway of millions of stations added in order, then a few queries over long ranges", 0, 0, 0, 0, 100},
+};
+
+// --------------------------------------------------------------------------- Structs ---------------------------------------------------------------------------
+
+// -------------------------------------------------------------------- Functions declaration --------------------------------------------------------------------
+
+/**
+ * @brief Draws the next pseudo-random number.
+ * @param state Pointer to the state of the xorshift generator, never 0.
+ * @return The number.
+ */
+unsigned long long random_next(unsigned long long *state);
+
+/**
+ * @brief Draws a pseudo-random integer in a range.
+ * @param state Pointer to the state of the generator.
+ * @param low The lowest value.
+ * @param high The highest value.
+ * @return The integer.
+ */
+int random_between(unsigned long long *state, int low, int high);
+
+/**
+ * @brief Adds a key to a set of stations.
+ * @param set Pointer to the set.
+ * @param key The key.
+ */
+void station_set_add(StationSet *set, int key);
+
+/**
+ * @brief Picks a random station, removing it from the set if asked.
+ * @param set Pointer to the set, not empty.
+ * @param state Pointer to the state of the generator.
+ * @param remove True to remove the station from the set.
+ * @return The key of the station.
+ */
+int station_set_pick(StationSet *set, unsigned long long *state, bool remove);
+
+/**
+ * @brief Prints an aggiungi-stazione command.
+ * @param scenario The scenario.
+ * @param set Pointer to the stations added so far.
+ * @param state Pointer to the state of the generator.
+ * @param next_key Pointer to the next key of the sorted scenario.
+ */
+void generate_add_station(const Scenario *scenario, StationSet *set, unsigned long long *state, int *next_key);
+
+/**
+ * @brief Draws the autonomy of a car for a scenario.
+ * @param scenario The scenario.
+ * @param state Pointer to the state of the generator.
+ * @return The autonomy.
+ */
+int generate_autonomy(const Scenario *scenario, unsigned long long *state);
+
+/**
+ * @brief Draws a key for a scenario.
+ * @param scenario The scenario.
+ * @param state Pointer to the state of the generator.
+ * @return The key.
+ */
+int generate_key(const Scenario *scenario, unsigned long long *state);
+
+// -------------------------------------------------------------------- Functions declaration --------------------------------------------------------------------
+
+// ----------------------------------------------------------------------------- Main ----------------------------------------------------------------------------
+
+int main(int argc, char *argv[]) {
+    const Scenario *scenario = NULL;
+    int scenario_count = sizeof(scenarios) / sizeof(scenarios[0]);
+
+    for (int i = 0; argc >= 2 && i < scenario_count; i++) {
+        if (strcmp(argv[1], scenarios[i].name) == 0) {
+            scenario = &scenarios[i];
+        }
+    }
+    if (scenario == NULL || argc > 4) {
+        fprintf(stderr, "usage: %s SCENARIO [COMMANDS] [SEED]\nscenarios:\n", argv[0]);
+        for (int i = 0; i < scenario_count; i++) {
+            fprintf(stderr, "  %-10s %s\n", scenarios[i].name, scenarios[i].description);
+        }
+        return 1;
+    }
+
+    int commands = argc >= 3 ? atoi(argv[2]) : 100000;
+    unsigned long long state = argc >= 4 ? strtoull(argv[3], NULL, 10) * 2654435761ull + 1 : 88172645463325252ull;
+    int initial = strcmp(scenario->name, "span") == 0 ? commands / 100 : commands / 5;
+    int next_key = 0;
+    StationSet set = {NULL, 0, 0};
+
+    if (strcmp(scenario->name, "national") == 0) {
+        initial = commands - 1 - commands / 100000;
+    }
+    for (int i = 0; i < initial; i++) {
+        generate_add_station(scenario, &set, &state, &next_key);
+    }
+
+    for (int i = initial; i < commands; i++) {
+        int draw = random_between(&state, 0, 99);
+
+        if (set.size < 2 || draw < scenario->add_station) {
+            generate_add_station(scenario, &set, &state, &next_key);
+        } else if ((draw -= scenario->add_station) < scenario->remove_station) {
+            printf("demolisci-stazione %d\n", station_set_pick(&set, &state, true));
+        } else if ((draw -= scenario->remove_station) < scenario->add_car) {
+            printf("aggiungi-auto %d %d\n", station_set_pick(&set, &state, false), generate_autonomy(scenario, &state));
+        } else if ((draw -= scenario->add_car) < scenario->remove_car) {
+            printf("rottama-auto %d %d\n", station_set_pick(&set, &state, false), generate_autonomy(scenario, &state));
+        } else {
+            int start = station_set_pick(&set, &state, false);
+            int end = station_set_pick(&set, &state, false);
+            printf("pianifica-percorso %d %d\n", start, end);
+        }
+    }
+
+    free(set.keys);
+    return 0;
+}
+
+// ----------------------------------------------------------------------------- Main ----------------------------------------------------------------------------
+
+// ------------------------------------------------------------------- Functions implementation ------------------------------------------------------------------
+
+unsigned long long random_next(unsigned long long *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+int random_between(unsigned long long *state, int low, int high) {
+    return low + (int)(random_next(state) % ((unsigned long long)high - low + 1));
+}
+
+void station_set_add(StationSet *set, int key) {
+    if (set->size == set->capacity) {
+        set->capacity = set->capacity > 0 ? set->capacity * 2 : 1024;
+        set->keys = (int *)realloc(set->keys, set->capacity * sizeof(int));
+        if (set->keys == NULL) {
+            printf("memory allocation error!\n");
+            exit(1);
+        }
+    }
+    set->keys[set->size++] = key;
+}
+
+int station_set_pick(StationSet *set, unsigned long long *state, bool remove) {
+    int slot = random_between(state, 0, set->size - 1);
+    int key = set->keys[slot];
+
+    if (remove) {
+        set->keys[slot] = set->keys[--set->size];
+    }
+    return key;
+}
+
+void generate_add_station(const Scenario *scenario, StationSet *set, unsigned long long *state, int *next_key) {
+    int key;
+    int cars;
+
+    if (strcmp(scenario->name, "sorted") == 0 || strcmp(scenario->name, "national") == 0) {
+        *next_key += random_between(state, 1, 100);
+        key = *next_key;
+    } else {
+        key = generate_key(scenario, state);
+    }
+    if (strcmp(scenario->name, "dense") == 0) {
+        cars = MAX_CARS;
+    } else if (strcmp(scenario->name, "national") == 0) {
+        cars = random_between(state, 1, 2);
+    } else {
+        cars = random_between(state, 0, 8);
+    }
+
+    printf("aggiungi-stazione %d %d", key, cars);
+    for (int i = 0; i < cars; i++) {
+        printf(" %d", generate_autonomy(scenario, state));
+    }
+    printf("\n");
+    station_set_add(set, key);
+}
+
+int generate_autonomy(const Scenario *scenario, unsigned long long *state) {
+    if (strcmp(scenario->name, "span") == 0) {
+        return random_between(state, 0, KEY_LIMIT / 4);
+    }
+    if (strcmp(scenario->name, "national") == 0) {
+        return random_between(state, 100, 400);
+    }
+    if (strcmp(scenario->name, "sorted") == 0) {
+        return random_between(state, 0, 400);
+    }
+    return random_between(state, 0, 2000);
+}
+
+int generate_key(const Scenario *scenario, unsigned long long *state) {
+    if (strcmp(scenario->name, "span") == 0) {
+        return random_between(state, 0, KEY_LIMIT);
+    }
+    if (strcmp(scenario->name, "mixed") == 0) {
+        return random_between(state, 0, 200000);
+    }
+    return random_between(state, 0, 20000000);
+}
+
+// ------------------------------------------------------------------- Functions implementation ------------------------------------------------------------------
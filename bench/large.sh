@@ -0,0 +1,44 @@
+#!/bin/sh
+# Loads a highway of millions of stations into a build of PathFinder.c, plans a few routes over long ranges and checks
+# the peak resident memory against a budget.
+#
+# usage: bench/large.sh PATHFINDER [-- OPTIONS...]
+#   PATHFINDER  the build to measure
+#   OPTIONS     extra options for PATHFINDER, e.g. --planner=jump
+# Environment: STATIONS (default 10000000), SEED (default 1), BUDGET in MiB (default 1024).
+
+set -e
+
+if [ $# -lt 1 ]; then
+    sed -n '5,8p' "$0" >&2
+    exit 1
+fi
+
+pathfinder=$1
+shift
+[ "$1" = "--" ] && shift
+
+bench_dir=$(cd "$(dirname "$0")" && pwd)
+work_dir=$(mktemp -d)
+trap 'rm -rf "$work_dir"' EXIT
+
+${CC:-cc} -O2 -o "$work_dir/generate" "$bench_dir/generate.c"
+
+stations=${STATIONS:-10000000}
+seed=${SEED:-1}
+budget=${BUDGET:-1024}
+
+"$work_dir/generate" national "$stations" "$seed" > "$work_dir/input.txt"
+echo "== national ($stations commands, seed $seed)"
+start=$(date +%s)
+"$pathfinder" --stats "$@" < "$work_dir/input.txt" > /dev/null 2> "$work_dir/stats.txt"
+end=$(date +%s)
+grep -e '^workspace:' -e '^bulk builds:' -e '^memory:' "$work_dir/stats.txt"
+echo "time: $((end - start)) s"
+
+resident=$(sed -n 's/^memory: \([0-9]*\) MiB.*/\1/p' "$work_dir/stats.txt")
+if [ -z "$resident" ] || [ "$resident" -gt "$budget" ]; then
+    echo "memory: OVER the budget of $budget MiB"
+    exit 1
+fi
+echo "memory: within the budget of $budget MiB"
@@ -0,0 +1,56 @@
+#!/bin/sh
+# Runs every benchmark scenario through a build of PathFinder.c and prints the per-command latency report.
+#
+# usage: bench/run.sh PATHFINDER [REFERENCE] [-- OPTIONS...]
+#   PATHFINDER  the build to measure
+#   REFERENCE   optional build whose output must match, e.g. one compiled from an older commit
+#   OPTIONS     extra options for PATHFINDER, e.g. --planner=jump
+# Environment: COMMANDS (default 200000), SEED (default 1), SCENARIOS (default: all of them).
+
+set -e
+
+if [ $# -lt 1 ]; then
+    sed -n '4,8p' "$0" >&2
+    exit 1
+fi
+
+pathfinder=$1
+shift
+reference=
+if [ $# -gt 0 ] && [ "$1" != "--" ]; then
+    reference=$1
+    shift
+fi
+[ "$1" = "--" ] && shift
+
+bench_dir=$(cd "$(dirname "$0")" && pwd)
+work_dir=$(mktemp -d)
+trap 'rm -rf "$work_dir"' EXIT
+
+${CC:-cc} -O2 -o "$work_dir/generate" "$bench_dir/generate.c"
+
+commands=${COMMANDS:-200000}
+seed=${SEED:-1}
+scenarios=${SCENARIOS:-"sorted dense span queries mutations mixed"}
+status=0
+
+for scenario in $scenarios; do
+    "$work_dir/generate" "$scenario" "$commands" "$seed" > "$work_dir/input.txt"
+    echo "== $scenario ($commands commands, seed $seed)"
+    "$pathfinder" --latency "$@" < "$work_dir/input.txt" > "$work_dir/output.txt" 2> "$work_dir/latency.txt"
+    cat "$work_dir/latency.txt"
+
+    if [ -n "$reference" ]; then
+        if ! "$reference" < "$work_dir/input.txt" > "$work_dir/expected.txt" 2> /dev/null; then
+            echo "output: the reference failed, nothing to compare"
+        elif cmp -s "$work_dir/output.txt" "$work_dir/expected.txt"; then
+            echo "output: matches the reference"
+        else
+            echo "output: DIFFERS from the reference"
+            status=1
+        fi
+    fi
+    echo
+done
+
+exit $status